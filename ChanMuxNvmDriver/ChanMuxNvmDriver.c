@@ -23,23 +23,52 @@ ChanMuxNvmDriver_ctor(
     ChanMuxNvmDriver*             self,
     const ChanMuxClientConfig_t*  config)
 {
-    // initialise ChanMux client
-    if (!ChanMuxClient_ctor(&(self->chanMuxClient), config))
+    for (size_t i = 0; i < ChanMuxNvmDriver_CHANNELS; i++)
     {
-        Debug_LOG_ERROR("ChanMuxClient_ctor() failed");
-        return false;
+        // initialise ChanMux client
+        if (!ChanMuxClient_ctor(&(self->chanMuxClient[i]), &config[i]))
+        {
+            Debug_LOG_ERROR("ChanMuxClient_ctor() failed for channel %zu", i);
+            return false;
+        }
+
+        // initialise the Proxy-NVM driver library.
+        if (!ProxyNVM_ctor(
+                &(self->proxyNVM[i]),
+                &(self->chanMuxClient[i]),
+                self->proxyBuffer[i],
+                sizeof(self->proxyBuffer[i])))
+        {
+            Debug_LOG_ERROR("ProxyNVM_ctor() failed for channel %zu", i);
+            return false;
+        }
+
+        if (!ProxyNVM_setFrameSize(
+                &(self->proxyNVM[i]),
+                ChanMuxNvmDriver_FRAME_SIZE))
+        {
+            Debug_LOG_ERROR("ProxyNVM_setFrameSize() failed for channel %zu",
+                            i);
+            return false;
+        }
+    }
+
+#if ChanMuxNvmDriver_CHANNELS > 1
+    for (size_t i = 0; i < ChanMuxNvmDriver_CHANNELS; i++)
+    {
+        self->stripes[i] = &(self->proxyNVM[i]);
     }
 
-    // initialise the Proxy-NVM driver library.
-    if (!ProxyNVM_ctor(
-            &(self->proxyNVM),
-            &(self->chanMuxClient),
-            self->proxyBuffer,
-            sizeof(self->proxyBuffer)))
+    if (!ProxyNVM_Striped_ctor(
+            &(self->striped),
+            self->stripes,
+            self->parts,
+            ChanMuxNvmDriver_CHANNELS))
     {
-        Debug_LOG_ERROR("ProxyNVM_ctor() failed");
+        Debug_LOG_ERROR("ProxyNVM_Striped_ctor() failed");
         return false;
     }
+#endif
 
     return true;
 }
@@ -50,8 +79,15 @@ void
 ChanMuxNvmDriver_dtor(
     ChanMuxNvmDriver*  self)
 {
-    ProxyNVM_dtor( ProxyNVM_TO_NVM( &(self->proxyNVM) ) );
-    ChanMuxClient_dtor( &(self->chanMuxClient) );
+#if ChanMuxNvmDriver_CHANNELS > 1
+    ProxyNVM_Striped_dtor( ProxyNVM_Striped_TO_NVM( &(self->striped) ) );
+#endif
+
+    for (size_t i = 0; i < ChanMuxNvmDriver_CHANNELS; i++)
+    {
+        ProxyNVM_dtor( ProxyNVM_TO_NVM( &(self->proxyNVM[i]) ) );
+        ChanMuxClient_dtor( &(self->chanMuxClient[i]) );
+    }
 }
 
 
@@ -60,5 +96,195 @@ Nvm*
 ChanMuxNvmDriver_get_nvm(
     ChanMuxNvmDriver*  self)
 {
-    return ProxyNVM_TO_NVM( &(self->proxyNVM) );
+#if ChanMuxNvmDriver_CHANNELS > 1
+    return ProxyNVM_Striped_TO_NVM( &(self->striped) );
+#else
+    return ProxyNVM_TO_NVM( &(self->proxyNVM[0]) );
+#endif
+}
+
+
+//------------------------------------------------------------------------------
+bool
+ChanMuxNvmDriver_enableReadAhead(
+    DECL_UNUSED_VAR(ChanMuxNvmDriver* self),
+    DECL_UNUSED_VAR(char*             buffer),
+    DECL_UNUSED_VAR(size_t            bufferSize))
+{
+#if ChanMuxNvmDriver_CHANNELS > 1
+    Debug_LOG_ERROR("%s: Not available with several channels", __func__);
+    return false;
+#else
+    ProxyNVM_enableReadAhead(&(self->proxyNVM[0]), buffer, bufferSize);
+    return true;
+#endif
+}
+
+
+//------------------------------------------------------------------------------
+void
+ChanMuxNvmDriver_enableCompression(
+    ChanMuxNvmDriver*         self,
+    ProxyNVM_CodecWorkspace*  workspace)
+{
+    for (size_t i = 0; i < ChanMuxNvmDriver_CHANNELS; i++)
+    {
+        ProxyNVM_enableCompression(&(self->proxyNVM[i]), &workspace[i]);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+bool
+ChanMuxNvmDriver_enableHashes(
+    DECL_UNUSED_VAR(ChanMuxNvmDriver* self),
+    DECL_UNUSED_VAR(uint64_t*         table),
+    DECL_UNUSED_VAR(size_t            blocks),
+    DECL_UNUSED_VAR(size_t            blockSize))
+{
+#if ChanMuxNvmDriver_CHANNELS > 1
+    Debug_LOG_ERROR("%s: Not available with several channels", __func__);
+    return false;
+#else
+    ProxyNVM_enableHashes(&(self->proxyNVM[0]), table, blocks, blockSize);
+    return true;
+#endif
+}
+
+
+//------------------------------------------------------------------------------
+bool
+ChanMuxNvmDriver_enableErasedMap(
+    DECL_UNUSED_VAR(ChanMuxNvmDriver* self),
+    DECL_UNUSED_VAR(uint32_t*         bitmap),
+    DECL_UNUSED_VAR(size_t            blocks))
+{
+#if ChanMuxNvmDriver_CHANNELS > 1
+    Debug_LOG_ERROR("%s: Not available with several channels", __func__);
+    return false;
+#else
+    ProxyNVM_enableErasedMap(&(self->proxyNVM[0]), bitmap, blocks);
+    return true;
+#endif
+}
+
+
+//------------------------------------------------------------------------------
+bool
+ChanMuxNvmDriver_scanErased(
+    ChanMuxNvmDriver*  self)
+{
+    return ProxyNVM_scanErased(&(self->proxyNVM[0]));
+}
+
+
+//------------------------------------------------------------------------------
+size_t
+ChanMuxNvmDriver_readv(
+    ChanMuxNvmDriver*  self,
+    ProxyNVM_Segment*  segments,
+    size_t             count)
+{
+#if ChanMuxNvmDriver_CHANNELS > 1
+    return ProxyNVM_Striped_readv(&(self->striped), segments, count);
+#else
+    return ProxyNVM_readv(&(self->proxyNVM[0]), segments, count);
+#endif
+}
+
+
+//------------------------------------------------------------------------------
+size_t
+ChanMuxNvmDriver_writev(
+    ChanMuxNvmDriver*  self,
+    ProxyNVM_Segment*  segments,
+    size_t             count)
+{
+#if ChanMuxNvmDriver_CHANNELS > 1
+    return ProxyNVM_Striped_writev(&(self->striped), segments, count);
+#else
+    return ProxyNVM_writev(&(self->proxyNVM[0]), segments, count);
+#endif
+}
+
+
+//------------------------------------------------------------------------------
+size_t
+ChanMuxNvmDriver_copy(
+    ChanMuxNvmDriver*  self,
+    size_t             dst,
+    size_t             src,
+    size_t             length)
+{
+#if ChanMuxNvmDriver_CHANNELS > 1
+    return ProxyNVM_Striped_copy(&(self->striped), dst, src, length);
+#else
+    return ProxyNVM_copy(&(self->proxyNVM[0]), dst, src, length);
+#endif
+}
+
+
+//------------------------------------------------------------------------------
+size_t
+ChanMuxNvmDriver_discard(
+    ChanMuxNvmDriver*  self,
+    size_t             addr,
+    size_t             length)
+{
+#if ChanMuxNvmDriver_CHANNELS > 1
+    return ProxyNVM_Striped_discard(&(self->striped), addr, length);
+#else
+    return ProxyNVM_discard(&(self->proxyNVM[0]), addr, length);
+#endif
+}
+
+
+//------------------------------------------------------------------------------
+uint32_t
+ChanMuxNvmDriver_getFeatures(
+    ChanMuxNvmDriver*  self)
+{
+    // the striped NVM makes sure all channels report the same
+    return ProxyNVM_getFeatures(&(self->proxyNVM[0]));
+}
+
+
+//------------------------------------------------------------------------------
+void
+ChanMuxNvmDriver_getStats(
+    ChanMuxNvmDriver*  self,
+    ProxyNVM_Stats*    stats)
+{
+    ProxyNVM_getStats(&(self->proxyNVM[0]), stats);
+
+    for (size_t i = 1; i < ChanMuxNvmDriver_CHANNELS; i++)
+    {
+        ProxyNVM_Stats channel;
+
+        ProxyNVM_getStats(&(self->proxyNVM[i]), &channel);
+
+        stats->framesSent     += channel.framesSent;
+        stats->framesReceived += channel.framesReceived;
+        stats->bytesSent      += channel.bytesSent;
+        stats->bytesReceived  += channel.bytesReceived;
+        stats->channelErrors  += channel.channelErrors;
+        stats->bytesUnchanged += channel.bytesUnchanged;
+        stats->bytesBlank     += channel.bytesBlank;
+        for (size_t e = 0; e < ProxyNVM_STATS_ERROR_CODES; e++)
+        {
+            stats->errors[e] += channel.errors[e];
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------
+void
+ChanMuxNvmDriver_resetStats(
+    ChanMuxNvmDriver*  self)
+{
+    for (size_t i = 0; i < ChanMuxNvmDriver_CHANNELS; i++)
+    {
+        ProxyNVM_resetStats(&(self->proxyNVM[i]));
+    }
 }
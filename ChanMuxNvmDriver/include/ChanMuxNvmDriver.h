@@ -15,17 +15,38 @@
 
 #include "ChanMux/ChanMuxClient.h"
 #include "ProxyNVM.h"
+#include "ProxyNVM_Striped.h"
 
 #include <limits.h> // needed to get PAGE_SIZE
 
+// Size of the frames exchanged with the proxy, the proxy may negotiate it
+// down. The ChanMux channel FIFOs must be able to hold a frame.
+#if !defined(ChanMuxNvmDriver_FRAME_SIZE)
+#   define ChanMuxNvmDriver_FRAME_SIZE  PAGE_SIZE
+#endif
+
+// Number of ChanMux channels to the proxy. Accesses are striped across them,
+// see ProxyNVM_Striped.h. The proxy must serve all channels with the same NVM.
+#if !defined(ChanMuxNvmDriver_CHANNELS)
+#   define ChanMuxNvmDriver_CHANNELS    1
+#endif
+
 typedef struct {
-    ProxyNVM        proxyNVM;
-    char            proxyBuffer[PAGE_SIZE];
+    ProxyNVM        proxyNVM[ChanMuxNvmDriver_CHANNELS];
+    char            proxyBuffer[ChanMuxNvmDriver_CHANNELS][PAGE_SIZE];
+
+    ChanMuxClient   chanMuxClient[ChanMuxNvmDriver_CHANNELS];
 
-    ChanMuxClient   chanMuxClient;
+#if ChanMuxNvmDriver_CHANNELS > 1
+    ProxyNVM_Striped      striped;
+    ProxyNVM*             stripes[ChanMuxNvmDriver_CHANNELS];
+    ProxyNVM_Striped_Part parts[ChanMuxNvmDriver_CHANNELS];
+#endif
 } ChanMuxNvmDriver;
 
 
+// 'config' points to ChanMuxNvmDriver_CHANNELS configurations, one for each
+// channel.
 bool
 ChanMuxNvmDriver_ctor(
     ChanMuxNvmDriver*             self,
@@ -40,3 +61,88 @@ ChanMuxNvmDriver_dtor(
 Nvm*
 ChanMuxNvmDriver_get_nvm(
     ChanMuxNvmDriver*  self);
+
+
+// The read-ahead, hashes and erased map need to see every access, so they
+// are not available with more than one channel and false is returned then.
+bool
+ChanMuxNvmDriver_enableReadAhead(
+    ChanMuxNvmDriver*  self,
+    char*              buffer,
+    size_t             bufferSize);
+
+
+// 'workspace' points to ChanMuxNvmDriver_CHANNELS workspaces, one for each
+// channel.
+void
+ChanMuxNvmDriver_enableCompression(
+    ChanMuxNvmDriver*         self,
+    ProxyNVM_CodecWorkspace*  workspace);
+
+
+// Skips unchanged blocks of writes without verifying a matching hash, see
+// ProxyNVM_enableHashes() for the risk of a collision.
+bool
+ChanMuxNvmDriver_enableHashes(
+    ChanMuxNvmDriver*  self,
+    uint64_t*          table,
+    size_t             blocks,
+    size_t             blockSize);
+
+
+bool
+ChanMuxNvmDriver_enableErasedMap(
+    ChanMuxNvmDriver*  self,
+    uint32_t*          bitmap,
+    size_t             blocks);
+
+
+bool
+ChanMuxNvmDriver_scanErased(
+    ChanMuxNvmDriver*  self);
+
+
+size_t
+ChanMuxNvmDriver_readv(
+    ChanMuxNvmDriver*  self,
+    ProxyNVM_Segment*  segments,
+    size_t             count);
+
+
+size_t
+ChanMuxNvmDriver_writev(
+    ChanMuxNvmDriver*  self,
+    ProxyNVM_Segment*  segments,
+    size_t             count);
+
+
+size_t
+ChanMuxNvmDriver_copy(
+    ChanMuxNvmDriver*  self,
+    size_t             dst,
+    size_t             src,
+    size_t             length);
+
+
+size_t
+ChanMuxNvmDriver_discard(
+    ChanMuxNvmDriver*  self,
+    size_t             addr,
+    size_t             length);
+
+
+uint32_t
+ChanMuxNvmDriver_getFeatures(
+    ChanMuxNvmDriver*  self);
+
+
+// The counters of all channels are added up.
+void
+ChanMuxNvmDriver_getStats(
+    ChanMuxNvmDriver*  self,
+    ProxyNVM_Stats*    stats);
+
+
+void
+ChanMuxNvmDriver_resetStats(
+    ChanMuxNvmDriver*  self);
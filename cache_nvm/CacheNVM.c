@@ -0,0 +1,669 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "CacheNVM.h"
+#include <string.h>
+
+/* Defines -------------------------------------------------------------------*/
+#define NO_BLOCK                ((size_t) -1)
+
+// reads and writes larger than this bypass the cache
+#define MAX_CACHED_LEN          (((self->blockCount + 3) / 4) * self->blockSize)
+
+/* Private functions prototypes ----------------------------------------------*/
+static size_t bucketOf(CacheNVM* self, size_t addr);
+static size_t lookup(CacheNVM* self, size_t addr);
+static size_t allocate(CacheNVM* self, size_t addr);
+static size_t load(CacheNVM* self, size_t addr, size_t count);
+static void drop(CacheNVM* self, size_t idx);
+static void invalidateRange(CacheNVM* self, size_t addr, size_t length);
+static bool flushPartlyCovered(CacheNVM* self, size_t addr, size_t length);
+static bool flushRun(CacheNVM* self, size_t idx);
+static void overlayDirty(CacheNVM* self, size_t addr, char* buffer,
+                         size_t length);
+
+/* Private variables ---------------------------------------------------------*/
+
+static const Nvm_Vtable CacheNvm_vtable =
+{
+    .read       = CacheNVM_read,
+    .erase      = CacheNVM_erase,
+    .getSize    = CacheNVM_getSize,
+    .write      = CacheNVM_write,
+    .dtor       = CacheNVM_dtor
+};
+
+/* Public functions ----------------------------------------------------------*/
+
+bool CacheNVM_ctor(CacheNVM* self, Nvm* lower, CacheNVM_Block* blocks,
+                   char* data, size_t blockCount, size_t blockSize)
+{
+    Debug_ASSERT_SELF(self);
+    Debug_ASSERT(lower != NULL);
+    Debug_ASSERT(blocks != NULL);
+    Debug_ASSERT(data != NULL);
+
+    if ((0 == blockCount) || (0 == blockSize))
+    {
+        Debug_LOG_ERROR("%s: Invalid cache geometry, %zu blocks of %zu bytes",
+                        __func__, blockCount, blockSize);
+        return false;
+    }
+
+    Nvm* nvm = CacheNVM_TO_NVM(self);
+
+    nvm->vtable = &CacheNvm_vtable;
+    self->lower = lower;
+    self->blocks = blocks;
+    self->data = data;
+    self->blockCount = blockCount;
+    self->blockSize = blockSize;
+    self->hand = 0;
+    self->isWriteBack = false;
+    self->flushBuf = NULL;
+    self->flushBufSize = 0;
+    self->dirtyLimit = 0;
+    self->dirtyBytes = 0;
+
+    CacheNVM_invalidate(self);
+
+    return true;
+}
+
+bool CacheNVM_enableWriteBack(CacheNVM* self, char* flushBuf,
+                              size_t flushBufSize, size_t dirtyLimit)
+{
+    Debug_ASSERT_SELF(self);
+    Debug_ASSERT(flushBuf != NULL);
+
+    if (flushBufSize < self->blockSize)
+    {
+        Debug_LOG_ERROR("%s: Flush buffer of %zu bytes can't hold a block",
+                        __func__, flushBufSize);
+        return false;
+    }
+
+    self->isWriteBack = true;
+    self->flushBuf = flushBuf;
+    self->flushBufSize = flushBufSize;
+    self->dirtyLimit = dirtyLimit;
+
+    return true;
+}
+
+size_t CacheNVM_write(Nvm* nvm, size_t addr, void const* buffer, size_t length)
+{
+    CacheNVM* self = (CacheNVM*) nvm;
+    Debug_ASSERT_SELF(self);
+    Debug_ASSERT(buffer != NULL);
+
+    if (!self->isWriteBack || (length > MAX_CACHED_LEN))
+    {
+        // dirty blocks that are only partly overwritten must reach the lower
+        // Nvm first, the others are simply replaced
+        if (!flushPartlyCovered(self, addr, length))
+        {
+            return 0;
+        }
+
+        size_t const written = self->lower->vtable->write(self->lower, addr,
+                                                          buffer, length);
+
+        // even a failed write may have changed parts of the range
+        invalidateRange(self, addr, length);
+
+        return written;
+    }
+
+    size_t const end = addr + length;
+    if ((end < addr) || (end > CacheNVM_getSize(nvm)))
+    {
+        Debug_LOG_ERROR("%s: Out of bounds: addr = %zu, length = %zu", __func__,
+                        addr, length);
+        return 0;
+    }
+
+    size_t writtenTotal = 0;
+
+    while (writtenTotal < length)
+    {
+        size_t const blockAddr = addr - (addr % self->blockSize);
+        size_t const offset = addr - blockAddr;
+        size_t const len = ((length - writtenTotal) < (self->blockSize - offset))
+                           ? (length - writtenTotal)
+                           : (self->blockSize - offset);
+        size_t idx = lookup(self, blockAddr);
+
+        if (NO_BLOCK == idx)
+        {
+            // a block that is overwritten completely doesn't have to be read
+            idx = (0 == offset) && (len == self->blockSize)
+                  ? allocate(self, blockAddr)
+                  : load(self, blockAddr, 1);
+            if (NO_BLOCK == idx)
+            {
+                break;
+            }
+        }
+
+        CacheNVM_Block* block = &self->blocks[idx];
+
+        memcpy(&self->data[(idx * self->blockSize) + offset],
+               &((char const*)buffer)[writtenTotal], len);
+        block->isReferenced = true;
+        if (!block->isDirty)
+        {
+            block->isDirty = true;
+            self->dirtyBytes += block->length;
+        }
+
+        writtenTotal += len;
+        addr += len;
+    }
+
+    if ((self->dirtyBytes >= self->dirtyLimit) && !CacheNVM_flush(self))
+    {
+        // the data is still in the cache, the flush is retried later
+        Debug_LOG_WARNING("%s: Flushing %zu dirty bytes failed", __func__,
+                          self->dirtyBytes);
+    }
+
+    return writtenTotal;
+}
+
+size_t CacheNVM_read(Nvm* nvm, size_t addr, void* buffer, size_t length)
+{
+    CacheNVM* self = (CacheNVM*) nvm;
+    Debug_ASSERT_SELF(self);
+    Debug_ASSERT(buffer != NULL);
+
+    if (length > MAX_CACHED_LEN)
+    {
+        size_t const read = self->lower->vtable->read(self->lower, addr, buffer,
+                                                      length);
+        // the lower Nvm does not have the data that is not flushed yet
+        overlayDirty(self, addr, buffer, read);
+
+        return read;
+    }
+
+    size_t readTotal = 0;
+
+    while (readTotal < length)
+    {
+        size_t const blockAddr = addr - (addr % self->blockSize);
+        size_t idx = lookup(self, blockAddr);
+
+        if (NO_BLOCK == idx)
+        {
+            // the missing blocks up to the end of the read are loaded at once
+            size_t const lastAddr = addr + (length - readTotal) - 1;
+
+            idx = load(self, blockAddr,
+                       ((lastAddr - blockAddr) / self->blockSize) + 1);
+            if (NO_BLOCK == idx)
+            {
+                break;
+            }
+        }
+
+        CacheNVM_Block* block = &self->blocks[idx];
+        size_t const offset = addr - blockAddr;
+
+        if (offset >= block->length)
+        {
+            // beyond the end of the device
+            break;
+        }
+
+        size_t const avail = block->length - offset;
+        size_t const len = ((length - readTotal) < avail)
+                           ? (length - readTotal)
+                           : avail;
+
+        memcpy(&((char*)buffer)[readTotal],
+               &self->data[(idx * self->blockSize) + offset], len);
+        block->isReferenced = true;
+
+        readTotal += len;
+        addr += len;
+    }
+
+    return readTotal;
+}
+
+size_t CacheNVM_erase(Nvm* nvm, size_t addr, size_t length)
+{
+    CacheNVM* self = (CacheNVM*) nvm;
+    Debug_ASSERT_SELF(self);
+
+    if (!flushPartlyCovered(self, addr, length))
+    {
+        return 0;
+    }
+
+    size_t const erased = self->lower->vtable->erase(self->lower, addr, length);
+
+    invalidateRange(self, addr, length);
+
+    return erased;
+}
+
+size_t CacheNVM_getSize(Nvm* nvm)
+{
+    CacheNVM* self = (CacheNVM*) nvm;
+    Debug_ASSERT_SELF(self);
+
+    return self->lower->vtable->getSize(self->lower);
+}
+
+bool CacheNVM_flush(CacheNVM* self)
+{
+    Debug_ASSERT_SELF(self);
+
+    bool ret = true;
+
+    for (size_t i = 0; (i < self->blockCount) && (self->dirtyBytes > 0); i++)
+    {
+        CacheNVM_Block const* block = &self->blocks[i];
+
+        if (!block->isDirty)
+        {
+            continue;
+        }
+
+        // runs of adjacent dirty blocks are written from their first block
+        if (block->addr >= self->blockSize)
+        {
+            size_t const prev = lookup(self, block->addr - self->blockSize);
+            if ((NO_BLOCK != prev) && self->blocks[prev].isDirty)
+            {
+                continue;
+            }
+        }
+
+        if (!flushRun(self, i))
+        {
+            ret = false;
+        }
+    }
+
+    return ret;
+}
+
+size_t CacheNVM_getDirtyBytes(CacheNVM* self)
+{
+    Debug_ASSERT_SELF(self);
+
+    return self->dirtyBytes;
+}
+
+void CacheNVM_invalidate(CacheNVM* self)
+{
+    Debug_ASSERT_SELF(self);
+
+    if (self->dirtyBytes > 0)
+    {
+        Debug_LOG_WARNING("%s: Dropping %zu dirty bytes", __func__,
+                          self->dirtyBytes);
+    }
+
+    for (size_t i = 0; i < self->blockCount; i++)
+    {
+        self->blocks[i].isValid = false;
+        self->blocks[i].isReferenced = false;
+        self->blocks[i].isDirty = false;
+        self->blocks[i].next = NO_BLOCK;
+        self->blocks[i].bucket = NO_BLOCK;
+    }
+
+    self->dirtyBytes = 0;
+}
+
+bool CacheNVM_readCached(CacheNVM* self, size_t addr, void* buffer,
+                         size_t length)
+{
+    Debug_ASSERT_SELF(self);
+    Debug_ASSERT(buffer != NULL);
+
+    size_t const end = addr + length;
+    if (end < addr)
+    {
+        return false;
+    }
+
+    // all blocks are looked up before anything is copied or referenced, the
+    // last block of the device may be short
+    for (size_t pos = addr - (addr % self->blockSize); pos < end;
+         pos += self->blockSize)
+    {
+        size_t const idx = lookup(self, pos);
+
+        if ((NO_BLOCK == idx)
+            || ((self->blocks[idx].length < self->blockSize)
+                && (end - pos > self->blocks[idx].length)))
+        {
+            return false;
+        }
+    }
+
+    size_t readTotal = 0;
+
+    while (readTotal < length)
+    {
+        size_t const blockAddr = addr - (addr % self->blockSize);
+        size_t const idx = lookup(self, blockAddr);
+        size_t const offset = addr - blockAddr;
+        size_t const avail = self->blockSize - offset;
+        size_t const len = ((length - readTotal) < avail)
+                           ? (length - readTotal)
+                           : avail;
+
+        memcpy(&((char*)buffer)[readTotal],
+               &self->data[(idx * self->blockSize) + offset], len);
+        self->blocks[idx].isReferenced = true;
+
+        readTotal += len;
+        addr += len;
+    }
+
+    return true;
+}
+
+void CacheNVM_invalidateRange(CacheNVM* self, size_t addr, size_t length)
+{
+    Debug_ASSERT_SELF(self);
+
+    invalidateRange(self, addr, length);
+}
+
+bool CacheNVM_discard(CacheNVM* self, size_t addr, size_t length)
+{
+    Debug_ASSERT_SELF(self);
+
+    if (!flushPartlyCovered(self, addr, length))
+    {
+        return false;
+    }
+
+    invalidateRange(self, addr, length);
+
+    return true;
+}
+
+void CacheNVM_dtor(Nvm* nvm)
+{
+    CacheNVM* self = (CacheNVM*) nvm;
+    Debug_ASSERT_SELF(self);
+
+    if (!CacheNVM_flush(self))
+    {
+        Debug_LOG_ERROR("%s: Losing %zu dirty bytes", __func__,
+                        self->dirtyBytes);
+    }
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+// The hash buckets are kept in the block descriptors, there is one bucket per
+// block.
+static size_t bucketOf(CacheNVM* self, size_t addr)
+{
+    return (addr / self->blockSize) % self->blockCount;
+}
+
+static size_t lookup(CacheNVM* self, size_t addr)
+{
+    size_t idx = self->blocks[bucketOf(self, addr)].bucket;
+
+    while ((NO_BLOCK != idx) && (self->blocks[idx].addr != addr))
+    {
+        idx = self->blocks[idx].next;
+    }
+
+    return idx;
+}
+
+// Assigns a free or evicted slot to the block at 'addr', without reading it.
+static size_t allocate(CacheNVM* self, size_t addr)
+{
+    size_t const size = self->lower->vtable->getSize(self->lower);
+
+    if (addr >= size)
+    {
+        return NO_BLOCK;
+    }
+
+    // CLOCK: skip and clear referenced blocks until an unreferenced one is
+    // found, this terminates after at most one round
+    while (self->blocks[self->hand].isValid
+           && self->blocks[self->hand].isReferenced)
+    {
+        self->blocks[self->hand].isReferenced = false;
+        self->hand = (self->hand + 1) % self->blockCount;
+    }
+
+    size_t const idx = self->hand;
+    CacheNVM_Block* block = &self->blocks[idx];
+
+    // Evicting a dirty block writes back all dirty blocks, this gives the
+    // longest runs and frees the cache for a while.
+    if (block->isDirty && !CacheNVM_flush(self))
+    {
+        Debug_LOG_ERROR("%s: Can't evict dirty block at addr = %zu", __func__,
+                        block->addr);
+        return NO_BLOCK;
+    }
+
+    self->hand = (self->hand + 1) % self->blockCount;
+    drop(self, idx);
+
+    size_t const bucket = bucketOf(self, addr);
+
+    block->addr = addr;
+    block->length = ((size - addr) < self->blockSize)
+                    ? (size - addr)
+                    : self->blockSize;
+    block->isValid = true;
+    block->isReferenced = false;
+    block->next = self->blocks[bucket].bucket;
+    self->blocks[bucket].bucket = idx;
+
+    return idx;
+}
+
+// Reads the block at 'addr' and up to 'count' - 1 blocks after it from the
+// lower Nvm with a single read. A following block is only added if it is not
+// cached and the CLOCK hand gives the slot right after the previous one
+// without evicting a referenced or dirty block, so the run is read into its
+// slots directly. Returns the slot of the block at 'addr'.
+static size_t load(CacheNVM* self, size_t addr, size_t count)
+{
+    size_t const first = allocate(self, addr);
+
+    if (NO_BLOCK == first)
+    {
+        return NO_BLOCK;
+    }
+
+    size_t length = self->blocks[first].length;
+    size_t n = 1;
+
+    while ((n < count)
+           && (length == n * self->blockSize)
+           && (self->hand == first + n))
+    {
+        CacheNVM_Block const* next = &self->blocks[self->hand];
+
+        if ((next->isValid && (next->isReferenced || next->isDirty))
+            || (NO_BLOCK != lookup(self, addr + length))
+            || (NO_BLOCK == allocate(self, addr + length)))
+        {
+            break;
+        }
+
+        length += self->blocks[first + n].length;
+        n++;
+    }
+
+    if (self->lower->vtable->read(self->lower, addr,
+                                  &self->data[first * self->blockSize],
+                                  length) != length)
+    {
+        Debug_LOG_ERROR("%s: Reading %zu blocks at addr = %zu failed",
+                        __func__, n, addr);
+        for (size_t i = 0; i < n; i++)
+        {
+            drop(self, first + i);
+        }
+        return NO_BLOCK;
+    }
+
+    return first;
+}
+
+static void drop(CacheNVM* self, size_t idx)
+{
+    CacheNVM_Block* block = &self->blocks[idx];
+
+    if (!block->isValid)
+    {
+        return;
+    }
+
+    size_t* link = &self->blocks[bucketOf(self, block->addr)].bucket;
+
+    while (*link != idx)
+    {
+        link = &self->blocks[*link].next;
+    }
+    *link = block->next;
+
+    if (block->isDirty)
+    {
+        self->dirtyBytes -= block->length;
+    }
+
+    block->isValid = false;
+    block->isReferenced = false;
+    block->isDirty = false;
+    block->next = NO_BLOCK;
+}
+
+static void invalidateRange(CacheNVM* self, size_t addr, size_t length)
+{
+    for (size_t i = 0; i < self->blockCount; i++)
+    {
+        CacheNVM_Block const* block = &self->blocks[i];
+
+        if (block->isValid
+            && (block->addr < addr + length)
+            && (addr < block->addr + block->length))
+        {
+            drop(self, i);
+        }
+    }
+}
+
+static bool flushPartlyCovered(CacheNVM* self, size_t addr, size_t length)
+{
+    if (0 == self->dirtyBytes)
+    {
+        return true;
+    }
+
+    for (size_t i = 0; i < self->blockCount; i++)
+    {
+        CacheNVM_Block const* block = &self->blocks[i];
+
+        if (block->isDirty
+            && (block->addr < addr + length)
+            && (addr < block->addr + block->length)
+            && ((block->addr < addr)
+                || (block->addr + block->length > addr + length)))
+        {
+            return CacheNVM_flush(self);
+        }
+    }
+
+    return true;
+}
+
+// Writes the run of adjacent dirty blocks starting with block 'idx' to the
+// lower Nvm, using as few writes as the flush buffer allows.
+static bool flushRun(CacheNVM* self, size_t idx)
+{
+    size_t addr = self->blocks[idx].addr;
+
+    while ((NO_BLOCK != idx) && self->blocks[idx].isDirty)
+    {
+        size_t const pieceAddr = addr;
+        size_t len = 0;
+
+        while ((NO_BLOCK != idx)
+               && self->blocks[idx].isDirty
+               && (len + self->blocks[idx].length <= self->flushBufSize))
+        {
+            CacheNVM_Block const* block = &self->blocks[idx];
+
+            memcpy(&self->flushBuf[len], &self->data[idx * self->blockSize],
+                   block->length);
+            len += block->length;
+            addr += block->length;
+
+            // a short block is the last one of the device
+            idx = (block->length == self->blockSize)
+                  ? lookup(self, addr)
+                  : NO_BLOCK;
+        }
+
+        if (self->lower->vtable->write(self->lower, pieceAddr, self->flushBuf,
+                                       len) != len)
+        {
+            Debug_LOG_ERROR("%s: Writing %zu bytes at addr = %zu failed",
+                            __func__, len, pieceAddr);
+            return false;
+        }
+
+        for (size_t a = pieceAddr; a < pieceAddr + len; a += self->blockSize)
+        {
+            CacheNVM_Block* block = &self->blocks[lookup(self, a)];
+
+            block->isDirty = false;
+            self->dirtyBytes -= block->length;
+        }
+    }
+
+    return true;
+}
+
+static void overlayDirty(CacheNVM* self, size_t addr, char* buffer,
+                         size_t length)
+{
+    for (size_t i = 0; (i < self->blockCount) && (self->dirtyBytes > 0); i++)
+    {
+        CacheNVM_Block const* block = &self->blocks[i];
+
+        if (!block->isDirty
+            || (block->addr >= addr + length)
+            || (addr >= block->addr + block->length))
+        {
+            continue;
+        }
+
+        size_t const from = (block->addr > addr) ? block->addr : addr;
+        size_t const to = ((block->addr + block->length) < (addr + length))
+                          ? (block->addr + block->length)
+                          : (addr + length);
+
+        memcpy(&buffer[from - addr],
+               &self->data[(i * self->blockSize) + (from - block->addr)],
+               to - from);
+    }
+}
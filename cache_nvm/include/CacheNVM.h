@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+/**
+ * @addtogroup OS
+ * @{
+ *
+ * @file
+ *
+ * @brief a implementation of the LibMem/Nvm.h interface that caches blocks
+ *  of another Nvm. It is meant to sit on top of the ProxyNVM, where every
+ *  access is a round-trip over the ChanMux channel. Reads are served from the
+ *  cache where possible. By default writes and erases are passed through and
+ *  invalidate the affected blocks, in write-back mode writes are kept in the
+ *  cache and written to the lower Nvm in large pieces when flushed. Eviction
+ *  uses the CLOCK algorithm. All memory is provided by the caller.
+ *
+ */
+#pragma once
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "lib_mem/Nvm.h"
+
+
+/* Exported macro ------------------------------------------------------------*/
+
+#define CacheNVM_TO_NVM(self) (&(self)->parent)
+
+
+/* Exported types ------------------------------------------------------------*/
+
+typedef struct CacheNVM CacheNVM;
+
+typedef struct
+{
+    size_t addr;        //!< address of the cached block, if valid
+    size_t length;      //!< valid bytes, less than a block at the device end
+    bool isValid;
+    bool isReferenced;  //!< CLOCK reference bit
+    bool isDirty;       //!< modified, but not written to the lower Nvm yet
+    size_t next;        //!< next block in the same hash bucket
+    size_t bucket;      //!< first block of hash bucket with this index
+} CacheNVM_Block;
+
+struct CacheNVM
+{
+    Nvm parent;
+    Nvm* lower;
+    CacheNVM_Block* blocks;
+    char* data;
+    size_t blockCount;
+    size_t blockSize;
+    size_t hand;        //!< CLOCK hand
+    bool isWriteBack;
+    char* flushBuf;     //!< adjacent dirty blocks are merged in here
+    size_t flushBufSize;
+    size_t dirtyLimit;  //!< flush when this many bytes are dirty
+    size_t dirtyBytes;
+};
+
+
+/* Exported constants --------------------------------------------------------*/
+/* Exported functions ------------------------------------------------------- */
+/**
+ * @brief constructor.
+ *
+ * @param self pointer to the cache
+ * @param lower the Nvm to cache
+ * @param blocks array of blockCount block descriptors
+ * @param data buffer of blockCount * blockSize bytes holding the cached data
+ * @param blockCount number of blocks in the cache
+ * @param blockSize size of a block in bytes
+ *
+ * @return true if success
+ *
+ */
+bool
+CacheNVM_ctor(CacheNVM* self, Nvm* lower, CacheNVM_Block* blocks, char* data,
+              size_t blockCount, size_t blockSize);
+/**
+ * @brief switches the cache to write-back mode.
+ *
+ * Written data is kept in the cache until CacheNVM_flush() is called, at
+ * least dirtyLimit bytes are dirty or a dirty block is evicted. A flush
+ * writes each run of adjacent dirty blocks with as few writes as the flush
+ * buffer allows.
+ *
+ * @param self pointer to the cache
+ * @param flushBuf buffer to merge adjacent dirty blocks in, must hold at
+ *  least one block
+ * @param flushBufSize size of flushBuf in bytes
+ * @param dirtyLimit number of dirty bytes that triggers a flush
+ *
+ * @return true if success
+ *
+ */
+bool
+CacheNVM_enableWriteBack(CacheNVM* self, char* flushBuf, size_t flushBufSize,
+                         size_t dirtyLimit);
+/**
+ * @brief static implementation of virtual method NVM_write()
+ *
+ * In write-through mode and for writes larger than a quarter of the cache,
+ * the data is written to the lower Nvm and the affected blocks are
+ * invalidated. Otherwise it is only written to the cache.
+ *
+ */
+size_t
+CacheNVM_write(Nvm* nvm, size_t addr, void const* buffer, size_t length);
+/**
+ * @brief static implementation of virtual method NVM_read()
+ *
+ * Reads larger than a quarter of the cache bypass it, so streaming reads do
+ * not evict the frequently used blocks.
+ * Adjacent blocks that are missing are read from the lower Nvm together, as
+ * far as the CLOCK hand gives adjacent slots for them.
+ *
+ */
+size_t
+CacheNVM_read(Nvm* nvm, size_t addr, void* buffer, size_t length);
+/**
+ * @brief static implementation of the erase method, the range is erased on
+ * the lower Nvm and the affected blocks are invalidated.
+ *
+ */
+size_t
+CacheNVM_erase(Nvm* nvm, size_t addr, size_t length);
+/**
+ * @brief static implementation of virtual method NVM_getSize()
+ *
+ */
+size_t
+CacheNVM_getSize(Nvm* nvm);
+/**
+ * @brief writes all dirty blocks to the lower Nvm.
+ *
+ * @return true if success
+ *
+ */
+bool
+CacheNVM_flush(CacheNVM* self);
+/**
+ * @brief returns the number of bytes that are not written to the lower Nvm
+ * yet.
+ *
+ */
+size_t
+CacheNVM_getDirtyBytes(CacheNVM* self);
+/**
+ * @brief drops all cached blocks, including dirty ones.
+ *
+ */
+void
+CacheNVM_invalidate(CacheNVM* self);
+/**
+ * @brief drops the cached blocks that overlap a range, including dirty ones.
+ *
+ * For ranges that were changed on the lower Nvm without going through the
+ * cache.
+ *
+ */
+void
+CacheNVM_invalidateRange(CacheNVM* self, size_t addr, size_t length);
+/**
+ * @brief reads a range only if all of its blocks are cached.
+ *
+ * Nothing is read from the lower Nvm, so a caller can collect the ranges that
+ * are not cached and read them from the lower Nvm in one go. That is only
+ * coherent while no block is dirty, i.e. in write-through mode.
+ *
+ * @return true if the whole range was copied into buffer
+ *
+ */
+bool
+CacheNVM_readCached(CacheNVM* self, size_t addr, void* buffer, size_t length);
+/**
+ * @brief drops the cached blocks of a range whose data is no longer needed.
+ *
+ * Dirty blocks inside the range are dropped without writing them, dirty
+ * blocks that reach out of it are written to the lower Nvm first.
+ *
+ * @return true if success
+ *
+ */
+bool
+CacheNVM_discard(CacheNVM* self, size_t addr, size_t length);
+
+void
+CacheNVM_dtor(Nvm* nvm);
+
+///@}
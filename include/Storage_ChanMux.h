@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+/**
+ * @file
+ * @brief   Definitions shared between the ChanMux storage component and its
+ *          clients
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Flags reported by storage_rpc_getState()
+
+// Written data is held in the write-back cache and not on the proxy yet, call
+// the flush() function of if_Storage_ChanMux to make it durable.
+#define Storage_ChanMux_STATE_FLAG_DIRTY    (1u << 0)
+
+// Badge of the RPC connections of client n of a component serving several
+// clients, see Storage_ChanMux_CLIENT_ASSIGN_BADGE()
+#define Storage_ChanMux_CLIENT_BADGE_BASE   100
+
+// Operations counted in Storage_ChanMux_Stats.ops. Copies are not available
+// as submissions.
+typedef enum
+{
+    Storage_ChanMux_OP_READ,
+    Storage_ChanMux_OP_WRITE,
+    Storage_ChanMux_OP_ERASE,
+    Storage_ChanMux_OP_COPY,
+    Storage_ChanMux_OP_DISCARD,
+    Storage_ChanMux_OP_COUNT
+} Storage_ChanMux_Op;
+
+// Number of entries in Storage_ChanMux_Stats.proxyErrors. proxyErrors[i]
+// counts the responses with error code -i from the proxy, proxyErrors[0] the
+// codes outside of this range.
+#define Storage_ChanMux_STATS_ERROR_CODES   8
+
+typedef struct
+{
+    uint64_t calls;         //!< calls that passed the parameter checks
+    uint64_t failed;        //!< calls among them that did not complete
+    uint64_t bytes;         //!< bytes read, written, erased, copied or
+                            //!< discarded
+    uint64_t ticksTotal;    //!< cumulative latency in ticks
+    uint64_t ticksMax;      //!< longest latency in ticks
+} Storage_ChanMux_OpStats;
+
+// Counters returned by the getStats() function of if_Storage_ChanMux. They
+// count since the start of the component or the last resetStats(). Latencies
+// are measured with the time stamp counter on x86 and are 0 on platforms
+// without a time source that can be read from user mode.
+typedef struct
+{
+    Storage_ChanMux_OpStats ops[Storage_ChanMux_OP_COUNT];
+    uint64_t framesSent;        //!< requests sent to the proxy
+    uint64_t framesReceived;    //!< responses received from the proxy
+    uint64_t bytesSent;         //!< bytes written to the ChanMux channel
+    uint64_t bytesReceived;     //!< bytes read from the ChanMux channel
+    uint64_t proxyErrors[Storage_ChanMux_STATS_ERROR_CODES];
+    uint64_t channelErrors;     //!< failed transfers and unexpected responses
+    uint64_t bytesUnchanged;    //!< written bytes the proxy had already
+    uint64_t bytesBlank;        //!< bytes read or erased without the proxy
+} Storage_ChanMux_Stats;
+
+// Maximum number of segments of a readv() or writev() call
+#define Storage_ChanMux_MAX_SEGMENTS        64
+
+// Segment of a readv() or writev() call of if_Storage_ChanMux. The client puts
+// an array of them into the storage dataport, the component fills in the
+// results.
+typedef struct
+{
+    uint64_t offset;        //!< offset on the storage
+    uint32_t portOffset;    //!< offset of the data in the storage dataport
+    uint32_t length;        //!< bytes to transfer
+    uint32_t done;          //!< set by the component: bytes transferred
+    int32_t  error;         //!< set by the component: OS_Error_t of the segment
+} Storage_ChanMux_Segment;
+
+// Number of entries of the submission and of the completion ring, a power of
+// two.
+#define Storage_ChanMux_RING_SIZE           64
+
+// Priority classes of submissions. Submissions of a higher class are handled
+// first, large ones of a lower class are interrupted for them. A class that
+// waits too long still gets a share. Submissions of a client whose ranges on
+// the storage overlap are handled in the order they were submitted, whatever
+// their classes, unless both are reads. A read of a higher class waits for an
+// earlier write to the same range, which is then handled first.
+typedef enum
+{
+    Storage_ChanMux_PRIO_NORMAL,    //!< default
+    Storage_ChanMux_PRIO_HIGH,      //!< latency-critical, e.g. metadata reads
+    Storage_ChanMux_PRIO_BULK,      //!< background, e.g. garbage collection
+    Storage_ChanMux_PRIO_COUNT
+} Storage_ChanMux_Prio;
+
+// Request in the submission ring. The data of reads and writes is in the
+// storage dataport, like for the if_OS_Storage functions.
+typedef struct
+{
+    uint64_t userData;      //!< copied into the completion
+    uint64_t offset;        //!< offset on the storage
+    uint32_t portOffset;    //!< offset of the data in the storage dataport
+    uint32_t length;        //!< bytes to read, write, erase or discard
+    uint32_t op;            //!< Storage_ChanMux_OP_READ, _WRITE, _ERASE or
+                            //!< _DISCARD
+    uint32_t priority;      //!< Storage_ChanMux_PRIO_xxx
+} Storage_ChanMux_Submission;
+
+// Result in the completion ring
+typedef struct
+{
+    uint64_t userData;      //!< from the submission
+    uint32_t done;          //!< bytes read, written, erased or discarded
+    int32_t  error;         //!< OS_Error_t of the request
+} Storage_ChanMux_Completion;
+
+// Layout of the ring dataport of the asynchronous component. The indices run
+// freely and are taken modulo Storage_ChanMux_RING_SIZE. The client zeroes the
+// dataport before the first use, then it adds submissions at subHead and
+// signals the kick notification. The component takes them from subTail in
+// order, adds a completion at compHead for each and signals the done
+// notification. Completions follow the priorities, not the order of the
+// submissions, and the data of a submission must stay in place until its
+// completion arrived. The client takes completions from compTail. Submissions
+// are only taken while there is room for their completions, so after reaping
+// completions from a full ring the client has to signal kick again. Each side
+// writes its indices with release and reads the other side's with acquire
+// semantics.
+typedef struct
+{
+    uint32_t subHead;       //!< written by the client
+    uint32_t subTail;       //!< written by the component
+    uint32_t compHead;      //!< written by the component
+    uint32_t compTail;      //!< written by the client
+    Storage_ChanMux_Submission sub[Storage_ChanMux_RING_SIZE];
+    Storage_ChanMux_Completion comp[Storage_ChanMux_RING_SIZE];
+} Storage_ChanMux_Rings;
@@ -8,6 +8,9 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "ProxyNVM.h"
+#include "ProxyNVM_Protocol.h"
+#include "ProxyNVM_Codec.h"
+#include "ProxyNVM_Hash.h"
 #include <string.h>
 #include <stdio.h>
 
@@ -15,10 +18,24 @@
 
 /*---------------PROTOCOL--------------------*/
 /*
+The message layout constants are in ProxyNVM_Protocol.h, which the host-side
+reference proxy in tools/proxy_nvm_host shares.
+
 Commands:
     0 -> getSize
     1 -> write
     2 -> read
+    3 -> erase
+    4 -> getFeatures
+    5 -> setFrameSize
+    6 -> readv
+    7 -> writev
+    8 -> getHashes
+    9 -> hello
+    10 -> setAddressSize
+    11 -> copy
+    12 -> discard
+    13 -> sync
 
 Retval:
     0 -> OK
@@ -63,44 +80,430 @@ Request
     [1][0x00000002][0|0|0|2]
 Response
     [2][0][0|0|0|2][0xAA][0x55]
+
+-------------------Erase---------------------------
+Request
+    [Command=3][ADDR_0|ADDR_1|ADDR_2|ADDR_3][LENGTH_0|LENGTH_1|LENGTH_2|LENGTH_3]
+Response
+    [Command=3][Retval][ERASED_0|ERASED_1|ERASED_2|ERASED_3]
+
+The proxy fills the range with 0xFF itself, so no payload is transferred.
+
+Example: Erase 1 MiB from address 0x00
+Request
+    [3][0x00000000][0|16|0|0]
+Response
+    [3][0][0|16|0|0]
+
+-------------------Copy----------------------------
+Request
+    [Command=11][ADDR_0|...|ADDR_3][LENGTH_0|...|LENGTH_3]
+    [SRC_ADDR_0|...|SRC_ADDR_3][CHUNK_SIZE_0|...|CHUNK_SIZE_3]
+Response
+    [Command=11][Retval][BYTES_0|...|BYTES_3]
+    if Retval is 0: for each chunk [Retval][BYTES_0|...|BYTES_3]
+
+Only sent if the proxy reports ProxyNVM_FEATURE_COPY. The proxy copies LENGTH
+bytes from SRC_ADDR to ADDR itself, so no payload is transferred. SRC_ADDR has
+the size of ADDR. The range is split into chunks of CHUNK_SIZE bytes, the last
+one may be shorter, and a result is reported for each one in the order of the
+addresses, like the segment results of readv. Overlapping ranges are copied
+like by memmove(): if ADDR lies above SRC_ADDR, the chunks are copied from the
+last one down. The proxy stops at the first chunk that fails, the chunks not
+copied report Retval 0 and BYTES 0. BYTES of the response header is the sum of
+the BYTES of the chunks. A Retval other than 0 in the response header means
+the request was rejected as a whole, e.g. if a range is out of bounds or the
+results don't fit into a frame, nothing follows then.
+
+Example: Copy 96 KiB from address 0x10000 to 0x40000 in 64 KiB chunks
+Request
+    [11][0x00040000][0|1|128|0][0x00010000][0|1|0|0]
+Response
+    [11][0][0|1|128|0][0][0|1|0|0][0][0|0|128|0]
+
+-------------------Discard-------------------------
+Request
+    [Command=12][ADDR_0|...|ADDR_3][LENGTH_0|...|LENGTH_3]
+Response
+    [Command=12][Retval][DISCARDED_0|...|DISCARDED_3]
+
+Only sent if the proxy reports ProxyNVM_FEATURE_DISCARD. The data of the range
+is no longer needed, the proxy may release the storage behind it, e.g. by
+punching a hole into its backing file. Until it is written again, the range
+reads as 0x00, so with ProxyNVM_FEATURE_FILL reads of it get fill responses.
+
+Example: Discard 64 KiB from address 0x10000
+Request
+    [12][0x00010000][0|1|0|0]
+Response
+    [12][0][0|1|0|0]
+
+-------------------Sync----------------------------
+Request
+    [Command=13]
+Response
+    [Command=13][Retval][RECEIVED_0|...|RECEIVED_7][SENT_0|...|SENT_7]
+
+Only sent if the proxy reports ProxyNVM_FEATURE_SYNC. RECEIVED is the number
+of bytes the proxy has received on the channel, including this request, SENT
+the number of bytes it has sent before this response. Both count from the
+start of the channel, their size doesn't depend on COMMAND_SET_ADDRESS_SIZE.
+The driver counts the same bytes on its side, see Tagged frames.
+
+Example: Sync after 300 bytes sent to and 1000 bytes received from the proxy
+Request
+    [13]
+Response
+    [13][0][0|0|0|0|0|0|1|45][0|0|0|0|0|0|3|232]
+
+-------------------Hello---------------------------
+Request
+    [Command=9]
+Response
+    [Command=9][Retval][VERSION_0|...|VERSION_3]
+    if Retval is 0: [FRAME_SIZE_0|...|FRAME_SIZE_3][WINDOW_0|...|WINDOW_3]
+                    [FEATURES_0|...|FEATURES_3]
+
+Sent before anything else. The proxy reports the protocol version it
+implements, the maximum length of a request or response message (header and
+payload) it accepts, how many requests may be outstanding at a time, and the
+ProxyNVM_FEATURE_xxx bits it supports. The driver uses the smaller of its own
+and the proxy's limits and doesn't send COMMAND_SET_FRAME_SIZE then. A proxy
+that does not know this command must answer with a Retval other than 0, the
+driver then falls back to COMMAND_GET_FEATURES.
+
+If the channel fails during the handshake, the driver fails the request that
+triggered it and starts over with the next one. This is only possible if the
+failed request wasn't sent at all, otherwise all further requests fail.
+
+Example: Proxy with version 1, 64 KiB frames, 8 outstanding requests and the
+erase command
+Request
+    [9]
+Response
+    [9][0][0|0|0|1][0|1|0|0][0|0|0|8][0|0|0|1]
+
+-------------------SetAddressSize------------------
+Request
+    [Command=10][SIZE_0|SIZE_1|SIZE_2|SIZE_3]
+Response
+    [Command=10][Retval][SIZE_0|SIZE_1|SIZE_2|SIZE_3]
+
+Only sent if the proxy reports ProxyNVM_FEATURE_WIDE and size_t has 64 bit.
+The driver proposes 8 byte fields, the proxy answers with the size it uses from
+the next request on. After that, the ADDR, LENGTH, COUNT and BYTES fields of
+all headers, segment descriptors and segment results have 8 bytes, the other
+fields keep their size:
+
+Request
+    [Command][ADDR_0|...|ADDR_7][LENGTH_0|...|LENGTH_7][...]
+Response
+    [Command][Retval][BYTES_0|...|BYTES_7][...]
+
+Without it, a proxy with 4 GiB or more of storage reports a capacity of
+0xFFFFFFFF and the rest is not accessible.
+
+Example: Switch to 8 byte fields, then get the capacity of a 6 GiB NVM
+Request
+    [10][0|0|0|8]
+Response
+    [10][0][0|0|0|8]
+Request
+    [0]
+Response
+    [0][0][0|0|0|1|128|0|0|0]
+
+-------------------GetFeatures---------------------
+Request
+    [Command=4]
+Response
+    [Command=4][Retval][FEATURES_0|FEATURES_1|FEATURES_2|FEATURES_3]
+
+FEATURES is a bitmap of ProxyNVM_FEATURE_xxx. A proxy that does not know this
+command must answer with a Retval other than 0, this is treated as "no optional
+features supported".
+
+Example: Proxy supports the erase command
+Request
+    [4]
+Response
+    [4][0][0|0|0|1]
+
+-------------------SetFrameSize--------------------
+Request
+    [Command=5][FRAME_SIZE_0|FRAME_SIZE_1|FRAME_SIZE_2|FRAME_SIZE_3]
+Response
+    [Command=5][Retval][FRAME_SIZE_0|FRAME_SIZE_1|FRAME_SIZE_2|FRAME_SIZE_3]
+
+Only sent if the proxy reports ProxyNVM_FEATURE_FRAME_SIZE. The driver proposes
+the maximum length of a request or response message (header and payload), the
+proxy answers with the length it accepts, which is never larger than proposed.
+Without it, messages are limited to the size of the driver's message buffer.
+
+Example: Use 64 KiB frames
+Request
+    [5][0|1|0|0]
+Response
+    [5][0][0|1|0|0]
+
+-------------------ReadV / WriteV------------------
+Request
+    [Command=6|7][COUNT_0|...|COUNT_3][LENGTH_0|...|LENGTH_3]
+    COUNT * [ADDR_0|...|ADDR_3][LEN_0|...|LEN_3]
+    WriteV only: the data of all segments, in order
+Response
+    [Command=6|7][Retval][BYTES_0|...|BYTES_3]
+    if Retval is 0: COUNT * [Retval][BYTES_0|...|BYTES_3]
+    ReadV only: BYTES bytes of each segment, in order
+
+Only sent if the proxy reports ProxyNVM_FEATURE_VECTORED. A frame carries
+several segments, LENGTH is the sum of their lengths. The proxy handles each
+segment on its own and reports a result for each one, BYTES of the response
+header is the sum of their BYTES. A Retval other than 0 in the response header
+means the frame was rejected as a whole, nothing follows then. The request and
+the response must both fit into a frame.
+
+Example: Read 2 bytes from address 0x02 and 1 byte from address 0x10
+Request
+    [6][0|0|0|2][0|0|0|3][0x00000002][0|0|0|2][0x00000010][0|0|0|1]
+Response
+    [6][0][0|0|0|3][0][0|0|0|2][0][0|0|0|1][0xAA][0x55][0x11]
+
+-------------------GetHashes-----------------------
+Request
+    [Command=8][ADDR_0|...|ADDR_3][LENGTH_0|...|LENGTH_3]
+    [BLOCK_SIZE_0|...|BLOCK_SIZE_3]
+Response
+    [Command=8][Retval][BYTES_0|...|BYTES_3]
+    if Retval is 0: for each block [HASH_0|...|HASH_7]
+
+Only sent if the proxy reports ProxyNVM_FEATURE_HASHES. The range is split into
+blocks of BLOCK_SIZE bytes, the last one may be shorter. HASH is the hash of a
+block as computed by ProxyNVM_hash() from ProxyNVM_HASH_INIT. The hashes must
+fit into a frame.
+
+Example: Get the hashes of two 512 byte blocks from address 0x400
+Request
+    [8][0x00000400][0|0|4|0][0|0|2|0]
+Response
+    [8][0][0|0|4|0][8 bytes hash][8 bytes hash]
+
+-------------------Tagged frames-------------------
+If the proxy reports ProxyNVM_FEATURE_TAGGED, read, write, readv and writev
+requests are sent with bit 7 of the command set and a sequence number appended to the header. The
+proxy echoes both in the response, the payload follows the sequence number:
+
+Request
+    [Command|0x80][ADDR_0|...|ADDR_3][LENGTH_0|...|LENGTH_3][TAG][...|...]
+Response
+    [Command|0x80][Retval][BYTES_0|...|BYTES_3][TAG][...|...]
+
+This allows several chunk requests of a large read or write to be outstanding
+at the same time, the proxy handles them in order.
+
+If a transfer breaks off, e.g. because a response doesn't match its request or
+the channel fails, responses of outstanding requests may still follow. Before
+the next request the driver sends a Sync request and drops everything it
+receives before the response. The response is taken only where RECEIVED
+matches the bytes the driver has sent and SENT the bytes it has received
+before it, so payload that merely looks like it isn't mistaken for it. A
+request that was sent only partly can't be recovered, the proxy takes
+whatever follows as its rest. Then, and with a proxy that doesn't support
+Sync, all further requests fail.
+
+Example: Read 2 bytes from address 0x02 as request number 5
+Request
+    [0x82][0x00000002][0|0|0|2][5]
+Response
+    [0x82][0][0|0|0|2][5][0xAA][0x55]
+
+-------------------Compressed payloads-------------
+If the proxy reports ProxyNVM_FEATURE_COMPRESSION, the payload of a write
+request may be compressed. This is marked by bit 6 of the command, the length
+of the compressed data follows the header (and the tag):
+
+Request
+    [Command=1|0x40][ADDR_0|...|ADDR_3][LENGTH_0|...|LENGTH_3]
+    [CLEN_0|...|CLEN_3][...CLEN bytes...]
+
+LENGTH is the length of the data before compression. In a read request, bit 6
+allows the proxy to compress the payload of the response in the same way:
+
+Response
+    [Command=2|0x40][Retval][BYTES_0|...|BYTES_3][CLEN_0|...|CLEN_3][...]
+
+The proxy only does this if Retval is 0 and CLEN plus its 4 bytes is smaller
+than BYTES, otherwise bit 6 is clear and the payload is sent as it is. The data
+is compressed as described in ProxyNVM_Codec.c.
+
+Example: Write 4096 zero bytes to address 0x1000, a literal 0 followed by a
+match of 4090 bytes at offset 1 and 5 literals
+Request
+    [0x41][0x00001000][0|0|16|0][0|0|0|26]
+    [0x1F][0x00][0x01|0x00][15 * 0xFF][0xF6][0x50][5 * 0x00]
+Response
+    [1][0][0|0|16|0]
+
+-------------------Fill responses------------------
+If the proxy reports ProxyNVM_FEATURE_FILL, read requests are sent with bit 5
+of the command set. This allows the proxy to answer a read of a range that
+holds the same byte everywhere, like an erased or never written one, with just
+that byte:
+
+Response
+    [Command=2|0x20][Retval][BYTES_0|...|BYTES_3][FILL]
+
+The proxy only does this if Retval is 0 and BYTES is larger than 1, otherwise
+bit 5 is clear and the payload is sent as usual. A fill response is preferred
+over a compressed one.
+
+Example: Read 4096 bytes of erased flash from address 0x1000
+Request
+    [0x22][0x00001000][0|0|16|0]
+Response
+    [0x22][0][0|0|16|0][0xFF]
 */
 /*---------------PROTOCOL--------------------*/
 
 /* Defines -------------------------------------------------------------------*/
 #define HDLC_HEADER             10
-#define MAX_MSG_LEN             (self->msgBufSize - HDLC_HEADER)
-#define REQUEST_HEADER_LEN      9
-#define RESP_HEADER_LEN         6
-#define MAX_REQ_PAYLOAD_LEN     (MAX_MSG_LEN - REQUEST_HEADER_LEN)
-#define MAX_RESP_PAYLOAD_LEN    (MAX_MSG_LEN - RESP_HEADER_LEN)
-#define ADDRESS_SIZE            4 //number of bytes for the address in the protocol
-#define LENGTH_SIZE             4 //number of bytes for the length in the protocol
-
-//INDEXES OF DIFFERENT PARTS OF THE REQUEST MESSAGE (IN A BUFFER)
-#define REQ_COMM_INDEX          0
-#define REQ_ADDR_INDEX          1
-#define REQ_LEN_INDEX           5
-#define REQ_PAYLD_INDEX         9
-
-//INDEXES OF DIFFERENT PARTS OF THE RESPONSE MESSAGE (IN A BUFFER)
-#define RESP_COMM_INDEX         0
-#define RESP_RETVAL_INDEX       1
-#define RESP_BYTES_INDEX        2
-#define RESP_PAYLD_INDEX        6
-
-//RETURN MESSAGES
-#define RET_OK                  0
-#define RET_GENERIC_ERR         -1
-#define RET_FILE_OPEN_ERR       -2
-#define RET_WRITE_ERR           -3
-#define RET_READ_ERR            -4
-#define RET_LEN_OUT_OF_BOUNDS   -5
-#define RET_ADDR_OUT_OF_BOUNDS  -6
+#define MAX_MSG_LEN             (self->maxMsgLen)
+// the payload limits leave room for the tag, so chunking is the same for
+// tagged and untagged frames
+#define MAX_REQ_PAYLOAD_LEN     (MAX_MSG_LEN - REQ_HDR_LEN - TAG_LEN)
+#define MAX_RESP_PAYLOAD_LEN    (MAX_MSG_LEN - RESP_HDR_LEN - TAG_LEN)
+// the layout depends on the negotiated size of the ADDR, LENGTH and BYTES fields
+#define REQ_HDR_LEN             REQ_HEADER_LEN_OF(self->fieldSize)
+#define RESP_HDR_LEN            RESP_HEADER_LEN_OF(self->fieldSize)
+#define SEG_DESC_SIZE           SEG_DESC_LEN_OF(self->fieldSize)
+#define SEG_RESULT_SIZE         SEG_RESULT_LEN_OF(self->fieldSize)
+// smaller write payloads are copied behind the header in msgBuf, larger ones
+// are sent from the caller's buffer with a separate ChanMux call
+#define ZERO_COPY_MIN_LEN       256
+// smallest block of the map of erased blocks
+#define ERASED_MIN_BLOCK_SIZE   512
+
+// tags are 8 bit, all outstanding requests must have distinct tags
+#if (ProxyNVM_PIPELINE_WINDOW < 1) || (ProxyNVM_PIPELINE_WINDOW > 128)
+#   error "ProxyNVM_PIPELINE_WINDOW must be in the range 1 to 128"
+#endif
+
+/* Private types -------------------------------------------------------------*/
+
+// outcome of a step of the handshake
+typedef enum
+{
+    HANDSHAKE_OK,
+    HANDSHAKE_REJECTED,     // the proxy doesn't know the command
+    HANDSHAKE_FAILED        // the channel failed, nothing is known
+} Handshake;
+
+typedef struct
+{
+    uint8_t command;
+    int8_t  retval;
+    size_t  bytes;
+    uint8_t tag;
+    bool    isCompressed;
+    bool    isFilled;
+} Response;
 
 /* Private functions prototypes ----------------------------------------------*/
-static void constructMsg(uint8_t command, size_t addr, size_t length,
-                         char const* buffer, char* message);
+static void constructMsg(ProxyNVM* self, uint8_t command, size_t addr,
+                         size_t length);
+static void writeHeader32(char* message, uint8_t command, size_t addr,
+                          size_t length);
+static void writeHeader64(char* message, uint8_t command, size_t addr,
+                          size_t length);
+static bool fitsFields(ProxyNVM* self, size_t addr, size_t length);
+static void putField(ProxyNVM* self, char* field, size_t value);
+static size_t getField(ProxyNVM* self, char const* field);
+static inline uint64_t getBE(char const* p, size_t size);
 static void logError(int8_t err, const char* func);
+static void handleError(ProxyNVM* self, int8_t err, const char* func);
+static bool hasFeature(ProxyNVM* self, uint32_t feature);
+static bool negotiate(ProxyNVM* self);
+static Handshake hello(ProxyNVM* self, size_t* maxMsgLen);
+static Handshake queryFeatures(ProxyNVM* self, size_t* maxMsgLen);
+static Handshake widenFields(ProxyNVM* self);
+static size_t eraseByWrite(ProxyNVM* self, size_t addr, size_t length,
+                           const char* func);
+static size_t maxCopyChunks(ProxyNVM* self);
+static size_t rangeRequest(ProxyNVM* self, uint8_t command, size_t addr,
+                           size_t src, size_t length, const char* func);
+static void requestInit(ProxyNVM_Request* req, uint8_t command, size_t addr,
+                        size_t src, size_t length, const char* func);
+static bool sendRange(ProxyNVM* self, ProxyNVM_Request* req);
+static size_t recvRange(ProxyNVM* self, ProxyNVM_Request const* req);
+static size_t recvCopyResults(ProxyNVM* self, ProxyNVM_Request const* req);
+static size_t transfer(ProxyNVM* self, uint8_t command, size_t addr,
+                       char* buffer, size_t length, const char* func);
+static void transferInit(ProxyNVM* self, ProxyNVM_Transfer* xfer,
+                         uint8_t command, size_t addr, char* buffer,
+                         size_t length, const char* func);
+static bool sendRequest(ProxyNVM* self, uint8_t command, bool isTagged,
+                        uint8_t tag, size_t addr, size_t length,
+                        char const* payload);
+static bool recvResponse(ProxyNVM* self, bool isTagged, Response* resp);
+static bool recvPayload(ProxyNVM* self, char* buffer, size_t length);
+static bool recvReadPayload(ProxyNVM* self, Response const* resp,
+                            char* buffer);
+static size_t compressPayload(ProxyNVM* self, size_t hdrLen,
+                              char const* payload, size_t length);
+static size_t vectored(ProxyNVM* self, uint8_t command,
+                       ProxyNVM_Segment* segs, size_t count, const char* func);
+static bool vectoredPrepare(ProxyNVM* self, uint8_t command,
+                            ProxyNVM_Segment* segs, size_t count,
+                            const char* func);
+static bool nextRun(ProxyNVM_Segment const* segs, size_t count,
+                    ProxyNVM_SegCursor* cur, size_t maxLen, size_t* addr,
+                    char** buf, size_t* len);
+static void credit(ProxyNVM_Segment* segs, size_t count,
+                   ProxyNVM_SegCursor cur, size_t len, size_t done);
+static bool nextBatchRun(ProxyNVM* self, ProxyNVM_Segment const* segs,
+                         size_t count, ProxyNVM_SegCursor* cur,
+                         ProxyNVM_Batch* batch, size_t* addr, char** buf,
+                         size_t* len);
+static void vectoredInit(ProxyNVM* self, ProxyNVM_Vectored* vx,
+                         uint8_t command, ProxyNVM_Segment* segs,
+                         size_t count, const char* func);
+static bool sendBatch(ProxyNVM* self, uint8_t command, bool isTagged,
+                      ProxyNVM_Segment const* segs, size_t count,
+                      ProxyNVM_SegCursor* cur, ProxyNVM_Batch* batch);
+static bool recvBatch(ProxyNVM* self, uint8_t command, bool isTagged,
+                      ProxyNVM_Segment* segs, size_t count,
+                      ProxyNVM_Batch const* batch, const char* func);
+static bool exchange(ProxyNVM* self, size_t requestLen);
+static bool sendAll(ProxyNVM* self, void const* buffer, size_t length);
+static bool recvAll(ProxyNVM* self, void* buffer, size_t length);
+static void breakStream(ProxyNVM* self);
+static void loseStream(ProxyNVM* self);
+static bool resync(ProxyNVM* self);
+static void readAheadIssue(ProxyNVM* self, size_t addr);
+static bool readAheadCollect(ProxyNVM* self);
+static bool readAheadDrop(ProxyNVM* self);
+static bool readAheadServe(ProxyNVM* self, size_t addr, char* buffer,
+                           size_t length, size_t* served);
+static uint64_t knownHash(uint64_t hash);
+static uint64_t erasedHashOf(size_t blockSize);
+static size_t writeChanged(ProxyNVM* self, size_t addr, char const* buffer,
+                           size_t length, const char* func);
+static bool writeRun(ProxyNVM* self, size_t addr, char const* buffer,
+                     size_t from, size_t to, size_t length, size_t* written,
+                     const char* func);
+static void hashesFetch(ProxyNVM* self, size_t first, size_t end);
+static bool hashesRequest(ProxyNVM* self, size_t first, size_t count);
+static size_t maxHashes(ProxyNVM* self);
+static bool requestHashes(ProxyNVM* self, size_t addr, size_t count,
+                          size_t blockSize);
+static uint64_t receivedHash(ProxyNVM* self, size_t i);
+static void hashesForget(ProxyNVM* self, size_t addr, size_t length);
+static void hashesErased(ProxyNVM* self, size_t addr, size_t length,
+                         size_t erased);
+static bool erasedSetUp(ProxyNVM* self);
+static bool erasedIsBlank(ProxyNVM* self, size_t addr, size_t length);
+static void erasedForget(ProxyNVM* self, size_t addr, size_t length);
+static void erasedMark(ProxyNVM* self, size_t addr, size_t length);
 
 static
 bool
@@ -133,6 +536,27 @@ bool ProxyNVM_ctor(ProxyNVM* self, ChanMuxClient* chanmux, char* msgBufer,
     self->chanmux = chanmux;
     self->msgBuf = msgBufer;
     self->msgBufSize = msgBufersize;
+    self->size = 0;
+    self->isSizeCached = false;
+    self->features = 0;
+    self->isFeaturesQueried = false;
+    self->isOutOfSync = false;
+    self->isLost = false;
+    self->streamSent = 0;
+    self->streamReceived = 0;
+    self->requestStart = 0;
+    self->version = 0;
+    self->window = ProxyNVM_PIPELINE_WINDOW;
+    self->fieldSize = ADDRESS_SIZE;
+    self->writeHeader = writeHeader32;
+    self->nextTag = 0;
+    self->maxMsgLen = msgBufersize - HDLC_HEADER;
+    memset(&self->readAhead, 0, sizeof(self->readAhead));
+    self->readAhead.nextAddr = (size_t) -1;
+    memset(&self->stats, 0, sizeof(self->stats));
+    self->codec = NULL;
+    memset(&self->hashes, 0, sizeof(self->hashes));
+    memset(&self->erased, 0, sizeof(self->erased));
 
     return retval;
 }
@@ -155,61 +579,27 @@ size_t ProxyNVM_write(Nvm* nvm, size_t addr, void const* buffer, size_t length)
         return 0;
     }
 
-    size_t writtenTotal = 0;
-    size_t bytes = 0;
-    size_t confirmedWritten = 0;
-
-    while (length > MAX_REQ_PAYLOAD_LEN)
+    if (!fitsFields(self, addr, length))
     {
-        constructMsg(COMMAND_WRITE, addr, MAX_REQ_PAYLOAD_LEN,
-                     &((char*)buffer)[writtenTotal], self->msgBuf);
-        ChanMuxClient_write(self->chanmux, self->msgBuf, MAX_MSG_LEN, &bytes);
-        ChanMuxClient_read(self->chanmux, self->msgBuf, RESP_HEADER_LEN, &bytes);
-        confirmedWritten = BitConverter_getUint32BE(&self->msgBuf[RESP_BYTES_INDEX]);
-
-        if (self->msgBuf[RESP_RETVAL_INDEX] != RET_OK)
-        {
-            logError(self->msgBuf[RESP_RETVAL_INDEX], __func__);
-            return 0;
-        }
-        if (confirmedWritten != MAX_REQ_PAYLOAD_LEN)
-        {
-            Debug_LOG_ERROR("%s: Tried to write %zu bytes, but successfully written %zu",
-                            __func__, MAX_REQ_PAYLOAD_LEN, confirmedWritten);
-            return 0;
-        }
-
-        writtenTotal += confirmedWritten;
-
-        addr += confirmedWritten;
-        length -= MAX_REQ_PAYLOAD_LEN;
+        Debug_LOG_ERROR("%s: Area exceeds the %zu byte addresses of the "
+                        "protocol: addr = %zu, length = %zu", __func__,
+                        self->fieldSize, addr, length);
+        return 0;
     }
 
-    if (length > 0)
+    if (!readAheadDrop(self))
     {
-        constructMsg(COMMAND_WRITE, addr, length, &((char*)buffer)[writtenTotal],
-                     self->msgBuf);
-        ChanMuxClient_write(self->chanmux, self->msgBuf, length + REQUEST_HEADER_LEN,
-                            &bytes);
-        ChanMuxClient_read(self->chanmux, self->msgBuf, RESP_HEADER_LEN, &bytes);
-        confirmedWritten = BitConverter_getUint32BE(&self->msgBuf[RESP_BYTES_INDEX]);
+        return 0;
+    }
 
-        if (self->msgBuf[RESP_RETVAL_INDEX] != RET_OK)
-        {
-            logError(self->msgBuf[RESP_RETVAL_INDEX], __func__);
-            return 0;
-        }
-        if (confirmedWritten != length)
-        {
-            Debug_LOG_ERROR("%s: Tried to write %zu bytes, but successfully written %zu",
-                            __func__, length, confirmedWritten);
-            return 0;
-        }
+    erasedForget(self, addr, length);
 
-        writtenTotal += confirmedWritten;
+    if (NULL != self->hashes.table)
+    {
+        return writeChanged(self, addr, buffer, length, __func__);
     }
 
-    return writtenTotal;
+    return transfer(self, COMMAND_WRITE, addr, (char*) buffer, length, __func__);
 }
 
 size_t ProxyNVM_read(Nvm* nvm, size_t addr, void* buffer, size_t length)
@@ -230,58 +620,54 @@ size_t ProxyNVM_read(Nvm* nvm, size_t addr, void* buffer, size_t length)
         return 0;
     }
 
-    size_t readTotal = 0;
-    size_t bytes = 0;
-    size_t confirmedRead = 0;
+    if (!fitsFields(self, addr, length))
+    {
+        Debug_LOG_ERROR("%s: Area exceeds the %zu byte addresses of the "
+                        "protocol: addr = %zu, length = %zu", __func__,
+                        self->fieldSize, addr, length);
+        return 0;
+    }
 
-    while (length >= MAX_RESP_PAYLOAD_LEN)
+    if (erasedIsBlank(self, addr, length))
     {
-        constructMsg(COMMAND_READ, addr, MAX_RESP_PAYLOAD_LEN, NULL, self->msgBuf);
-        ChanMuxClient_write(self->chanmux, self->msgBuf, REQUEST_HEADER_LEN, &bytes);
-        ChanMuxClient_read(self->chanmux, self->msgBuf, MAX_MSG_LEN, &bytes);
-        confirmedRead = BitConverter_getUint32BE(&self->msgBuf[RESP_BYTES_INDEX]);
+        memset(buffer, 0xFF, length);
+        self->stats.bytesBlank += length;
+        self->readAhead.nextAddr = addr + length;
+        return length;
+    }
 
-        if (self->msgBuf[RESP_RETVAL_INDEX] != RET_OK)
-        {
-            logError(self->msgBuf[RESP_RETVAL_INDEX], __func__);
-            return 0;
-        }
-        if (confirmedRead != MAX_RESP_PAYLOAD_LEN)
-        {
-            Debug_LOG_ERROR("%s: Tried to read %zu bytes, but successfully read %zu",
-                            __func__, MAX_RESP_PAYLOAD_LEN, confirmedRead);
-            return 0;
-        }
+    if (NULL == self->readAhead.buf)
+    {
+        return transfer(self, COMMAND_READ, addr, buffer, length, __func__);
+    }
 
-        memcpy(&((char*)buffer)[readTotal], &self->msgBuf[6], confirmedRead);
-        readTotal += confirmedRead;
+    size_t served = 0;
 
-        addr += (confirmedRead);
-        length -= (MAX_RESP_PAYLOAD_LEN);
+    if (!readAheadServe(self, addr, buffer, length, &served))
+    {
+        return 0;
     }
 
-    if (length > 0)
+    size_t readTotal = served;
+
+    if (served < length)
     {
-        constructMsg(COMMAND_READ, addr, length, NULL, self->msgBuf);
-        ChanMuxClient_write(self->chanmux, self->msgBuf, REQUEST_HEADER_LEN, &bytes);
-        ChanMuxClient_read(self->chanmux, self->msgBuf, length + RESP_HEADER_LEN,
-                           &bytes);
-        confirmedRead = BitConverter_getUint32BE(&self->msgBuf[RESP_BYTES_INDEX]);
+        readTotal += transfer(self, COMMAND_READ, addr + served,
+                              &((char*)buffer)[served], length - served,
+                              __func__);
+    }
 
-        if (self->msgBuf[RESP_RETVAL_INDEX] != RET_OK)
-        {
-            logError(self->msgBuf[RESP_RETVAL_INDEX], __func__);
-            return 0;
-        }
-        if (confirmedRead != length)
-        {
-            Debug_LOG_ERROR("%s: Tried to read %zu bytes, but successfully read %zu!",
-                            __func__, length, confirmedRead);
-            return 0;
-        }
+    // Reading on where the previous read ended looks like a streaming read,
+    // so request the data that comes next while the caller is busy with this
+    // one. Anything else abandons the read-ahead.
+    bool const isSequential = (addr == self->readAhead.nextAddr);
+
+    self->readAhead.nextAddr = addr + length;
 
-        memcpy(&((char*)buffer)[readTotal], &self->msgBuf[6], confirmedRead);
-        readTotal += confirmedRead;
+    if ((readTotal == length) && isSequential
+        && (0 == self->readAhead.length))
+    {
+        readAheadIssue(self, addr + length);
     }
 
     return readTotal;
@@ -304,59 +690,146 @@ size_t ProxyNVM_erase(Nvm* nvm, size_t addr, size_t length)
         return 0;
     }
 
-    size_t erasedTotal = 0;
-    size_t bytes = 0;
-    size_t confirmedErased = 0;
+    if (!fitsFields(self, addr, length))
+    {
+        Debug_LOG_ERROR("%s: Area exceeds the %zu byte addresses of the "
+                        "protocol: addr = %zu, length = %zu", __func__,
+                        self->fieldSize, addr, length);
+        return 0;
+    }
 
-    while (length > MAX_REQ_PAYLOAD_LEN)
+    if (0 == length)
     {
-        constructMsg(COMMAND_WRITE, addr, MAX_REQ_PAYLOAD_LEN, NULL, self->msgBuf);
-        ChanMuxClient_write(self->chanmux, self->msgBuf, MAX_MSG_LEN, &bytes);
-        ChanMuxClient_read(self->chanmux, self->msgBuf, RESP_HEADER_LEN, &bytes);
-        confirmedErased = BitConverter_getUint32BE(&self->msgBuf[RESP_BYTES_INDEX]);
+        return 0;
+    }
 
-        if (self->msgBuf[RESP_RETVAL_INDEX] != RET_OK)
-        {
-            logError(self->msgBuf[RESP_RETVAL_INDEX], __func__);
-            return 0;
-        }
-        if (confirmedErased != MAX_REQ_PAYLOAD_LEN)
-        {
-            Debug_LOG_ERROR("%s: Tried to erase %zu bytes, but successfully erased %zu",
-                            __func__, MAX_REQ_PAYLOAD_LEN, confirmedErased);
-            return 0;
-        }
+    if (erasedIsBlank(self, addr, length))
+    {
+        self->stats.bytesBlank += length;
+        return length;
+    }
+
+    if (!readAheadDrop(self))
+    {
+        return 0;
+    }
+
+    size_t const erased = hasFeature(self, ProxyNVM_FEATURE_ERASE)
+                          ? rangeRequest(self, COMMAND_ERASE, addr, 0, length,
+                                         __func__)
+                          : eraseByWrite(self, addr, length, __func__);
+
+    hashesErased(self, addr, length, erased);
+    erasedMark(self, addr, erased);
+
+    return erased;
+}
+
+size_t ProxyNVM_copy(ProxyNVM* self, size_t dst, size_t src, size_t length)
+{
+    Debug_ASSERT_SELF(self);
+
+    Nvm* const nvm = ProxyNVM_TO_NVM(self);
+
+    if (!isValidStorageArea(nvm, dst, length)
+        || !isValidStorageArea(nvm, src, length))
+    {
+        Debug_LOG_ERROR("%s: Unable to copy the given areas (out of bounds): "
+                        "dst = %zu, src = %zu, length = %zu", __func__, dst,
+                        src, length);
+        return 0;
+    }
+
+    if (!fitsFields(self, dst, length) || !fitsFields(self, src, length))
+    {
+        Debug_LOG_ERROR("%s: Areas exceed the %zu byte addresses of the "
+                        "protocol: dst = %zu, src = %zu, length = %zu",
+                        __func__, self->fieldSize, dst, src, length);
+        return 0;
+    }
 
-        erasedTotal += confirmedErased;
+    if ((0 == length) || (dst == src))
+    {
+        return length;
+    }
 
-        addr += confirmedErased;
-        length -= MAX_REQ_PAYLOAD_LEN;
+    if (!hasFeature(self, ProxyNVM_FEATURE_COPY))
+    {
+        Debug_LOG_ERROR("%s: Proxy does not support COMMAND_COPY", __func__);
+        return 0;
     }
 
-    if (length > 0)
+    if (!readAheadDrop(self))
     {
-        constructMsg(COMMAND_WRITE, addr, length, NULL, self->msgBuf);
-        ChanMuxClient_write(self->chanmux, self->msgBuf, length + REQUEST_HEADER_LEN,
-                            &bytes);
-        ChanMuxClient_read(self->chanmux, self->msgBuf, RESP_HEADER_LEN, &bytes);
-        confirmedErased = BitConverter_getUint32BE(&self->msgBuf[RESP_BYTES_INDEX]);
+        return 0;
+    }
 
-        if (self->msgBuf[RESP_RETVAL_INDEX] != RET_OK)
-        {
-            logError(self->msgBuf[RESP_RETVAL_INDEX], __func__);
-            return 0;
-        }
-        if (confirmedErased != length)
+    // where the destination overlaps the end of the source, copying from the
+    // start would overwrite source data before it is copied
+    bool const isBackwards = (dst > src) && ((dst - src) < length);
+    size_t const maxLen = maxCopyChunks(self) * ProxyNVM_COPY_CHUNK_SIZE;
+    size_t copied = 0;
+
+    while (copied < length)
+    {
+        size_t const left = length - copied;
+        size_t const len = (left < maxLen) ? left : maxLen;
+        size_t const offset = isBackwards ? (left - len) : copied;
+        size_t const done = rangeRequest(self, COMMAND_COPY, dst + offset,
+                                         src + offset, len, __func__);
+
+        copied += done;
+        if (done != len)
         {
-            Debug_LOG_ERROR("%s: Tried to erase %zu bytes, but successfully erased %zu",
-                            __func__, length, confirmedErased);
-            return 0;
+            break;
         }
+    }
+
+    hashesForget(self, dst, length);
+    erasedForget(self, dst, length);
+
+    return (isBackwards && (copied != length)) ? 0 : copied;
+}
+
+size_t ProxyNVM_discard(ProxyNVM* self, size_t addr, size_t length)
+{
+    Debug_ASSERT_SELF(self);
+
+    if (!isValidStorageArea(ProxyNVM_TO_NVM(self), addr, length))
+    {
+        Debug_LOG_ERROR("%s: Unable to discard the given area (out of "
+                        "bounds): addr = %zu, length = %zu", __func__, addr,
+                        length);
+        return 0;
+    }
+
+    if (!fitsFields(self, addr, length))
+    {
+        Debug_LOG_ERROR("%s: Area exceeds the %zu byte addresses of the "
+                        "protocol: addr = %zu, length = %zu", __func__,
+                        self->fieldSize, addr, length);
+        return 0;
+    }
 
-        erasedTotal += confirmedErased;
+    // keeping the data is a valid way to discard it
+    if ((0 == length) || !hasFeature(self, ProxyNVM_FEATURE_DISCARD))
+    {
+        return length;
+    }
+
+    if (!readAheadDrop(self))
+    {
+        return 0;
     }
 
-    return erasedTotal;
+    size_t const discarded = rangeRequest(self, COMMAND_DISCARD, addr, 0,
+                                          length, __func__);
+
+    // even a failed request may have changed the range
+    hashesForget(self, addr, length);
+    erasedForget(self, addr, length);
+
+    return discarded;
 }
 
 size_t ProxyNVM_getSize(Nvm* nvm)
@@ -364,74 +837,2471 @@ size_t ProxyNVM_getSize(Nvm* nvm)
     ProxyNVM* self = (ProxyNVM*) nvm;
     Debug_ASSERT_SELF(self);
 
-    size_t size = 0;
-    size_t bytes = 0;
-    constructMsg(COMMAND_GET_SIZE, 0, 0, NULL, self->msgBuf);
-    ChanMuxClient_write(self->chanmux, self->msgBuf, 1, &bytes);
+    if (!self->isSizeCached && !ProxyNVM_refreshSize(self))
+    {
+        return 0;
+    }
+
+    return self->size;
+}
+
+bool ProxyNVM_refreshSize(ProxyNVM* self)
+{
+    Debug_ASSERT_SELF(self);
 
-    ChanMuxClient_read(self->chanmux, self->msgBuf, RESP_HEADER_LEN, &bytes);
+    self->isSizeCached = false;
+
+    // the block size of the map depends on the capacity
+    if (NULL != self->erased.bits)
+    {
+        memset(self->erased.bits, 0,
+               ((self->erased.blocks + 31) / 32) * sizeof(uint32_t));
+        self->erased.blockSize = 0;
+    }
+
+    if (!readAheadDrop(self))
+    {
+        return false;
+    }
+
+    // the size of BYTES in the response is negotiated
+    if (!self->isFeaturesQueried && !negotiate(self))
+    {
+        return false;
+    }
+
+    constructMsg(self, COMMAND_GET_SIZE, 0, 0);
+
+    if (!exchange(self, 1))
+    {
+        Debug_LOG_ERROR("%s: Request failed", __func__);
+        return false;
+    }
 
     if (self->msgBuf[RESP_RETVAL_INDEX] != RET_OK)
     {
-        logError(self->msgBuf[RESP_RETVAL_INDEX], __func__);
+        handleError(self, self->msgBuf[RESP_RETVAL_INDEX], __func__);
+        return false;
     }
 
-    size = BitConverter_getUint32BE(&self->msgBuf[RESP_BYTES_INDEX]);
+    self->size = getField(self, &self->msgBuf[RESP_BYTES_INDEX]);
+    self->isSizeCached = true;
 
-    return size;
+    return true;
 }
 
-void ProxyNVM_dtor(Nvm* nvm)
+uint32_t ProxyNVM_getFeatures(ProxyNVM* self)
 {
-    DECL_UNUSED_VAR(ProxyNVM * self) = (ProxyNVM*) nvm;
     Debug_ASSERT_SELF(self);
-}
 
-/* Private functions ---------------------------------------------------------*/
-static
-bool
-isValidStorageArea(
-    Nvm* nvm,
-    size_t const offset,
-    size_t const size)
-{
-    size_t const end = offset + size;
-    // Checking integer overflow first. The end index is not part of the area,
-    // but we allow offset = end with size = 0 here
-    return ( (end >= offset) && (end <= ProxyNVM_getSize(nvm)) );
+    if (!self->isFeaturesQueried && !negotiate(self))
+    {
+        return 0;
+    }
+
+    return self->features;
 }
 
-static void constructMsg(uint8_t command, size_t addr, size_t length,
-                         char const* buffer, char* message)
+bool ProxyNVM_setFrameSize(ProxyNVM* self, size_t frameSize)
 {
-    if (sizeof(addr) > ADDRESS_SIZE)
+    Debug_ASSERT_SELF(self);
+
+    if (self->isFeaturesQueried)
     {
-        Debug_LOG_WARNING("%s: Passed address is %zu bytes, but the size of the address in the protocol is %d bytes. The address will be truncated!",
-                          __func__, sizeof(addr), ADDRESS_SIZE);
+        Debug_LOG_ERROR("%s: Frame size already negotiated", __func__);
+        return false;
     }
 
-    if (sizeof(length) > LENGTH_SIZE)
+    if (frameSize <= HDLC_HEADER + MAX_REQUEST_HEADER_LEN + TAG_LEN)
     {
-        Debug_LOG_WARNING("%s: Passed length is %zu bytes, but the size of the length in the protocol is %d bytes. The length will be truncated!",
-                          __func__, sizeof(addr), ADDRESS_SIZE);
+        Debug_LOG_ERROR("%s: Frame size %zu too small", __func__, frameSize);
+        return false;
     }
 
-    message[REQ_COMM_INDEX] = command;
-    BitConverter_putUint32BE((uint32_t) addr, &message[REQ_ADDR_INDEX]);
-    BitConverter_putUint32BE((uint32_t) length, &message[REQ_LEN_INDEX]);
+    self->maxMsgLen = frameSize - HDLC_HEADER;
 
-    if (command == COMMAND_WRITE)
-    {
-        if (buffer != NULL)
-        {
-            //real write command
-            memcpy(&(message[REQ_PAYLD_INDEX]), buffer, length);
-        }
-        else
-        {
-            //writing 0xFF => erase command
-            memset(&(message[REQ_PAYLD_INDEX]), 0xFF, length);
-        }
+    return true;
+}
+
+void ProxyNVM_enableReadAhead(ProxyNVM* self, char* buffer, size_t bufferSize)
+{
+    Debug_ASSERT_SELF(self);
+    Debug_ASSERT(buffer != NULL);
+
+    self->readAhead.buf = buffer;
+    self->readAhead.bufSize = bufferSize;
+}
+
+void ProxyNVM_enableCompression(ProxyNVM* self,
+                                ProxyNVM_CodecWorkspace* workspace)
+{
+    Debug_ASSERT_SELF(self);
+    Debug_ASSERT(workspace != NULL);
+
+    self->codec = workspace;
+}
+
+void ProxyNVM_enableHashes(ProxyNVM* self, uint64_t* table, size_t blocks,
+                           size_t blockSize)
+{
+    Debug_ASSERT_SELF(self);
+    Debug_ASSERT(table != NULL);
+    Debug_ASSERT(blockSize > 0);
+
+    memset(table, 0, blocks * sizeof(*table));
+    self->hashes.table = table;
+    self->hashes.blocks = blocks;
+    self->hashes.blockSize = blockSize;
+    self->hashes.erasedHash = erasedHashOf(blockSize);
+}
+
+void ProxyNVM_enableErasedMap(ProxyNVM* self, uint32_t* bitmap, size_t blocks)
+{
+    Debug_ASSERT_SELF(self);
+    Debug_ASSERT(bitmap != NULL);
+    Debug_ASSERT(blocks > 0);
+
+    memset(bitmap, 0, ((blocks + 31) / 32) * sizeof(*bitmap));
+    self->erased.bits = bitmap;
+    self->erased.blocks = blocks;
+    self->erased.blockSize = 0;
+}
+
+bool ProxyNVM_scanErased(ProxyNVM* self)
+{
+    Debug_ASSERT_SELF(self);
+
+    ProxyNVM_ErasedMap* const map = &self->erased;
+
+    if ((NULL == map->bits) || (0 == ProxyNVM_getSize(ProxyNVM_TO_NVM(self)))
+        || !erasedSetUp(self) || !readAheadDrop(self)
+        || !hasFeature(self, ProxyNVM_FEATURE_HASHES))
+    {
+        return false;
+    }
+
+    size_t const bs = map->blockSize;
+    size_t const blocks = self->size / bs;  // the last short one isn't used
+    uint64_t const erasedHash = erasedHashOf(bs);
+
+    for (size_t first = 0; first < blocks; )
+    {
+        size_t const count = ((blocks - first) < maxHashes(self))
+                             ? (blocks - first)
+                             : maxHashes(self);
+
+        if (!requestHashes(self, first * bs, count, bs))
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+            if (knownHash(receivedHash(self, i)) == erasedHash)
+            {
+                erasedMark(self, (first + i) * bs, bs);
+            }
+        }
+
+        first += count;
+    }
+
+    return true;
+}
+
+size_t ProxyNVM_readv(ProxyNVM* self, ProxyNVM_Segment* segments, size_t count)
+{
+    Debug_ASSERT_SELF(self);
+
+    return vectored(self, COMMAND_READV, segments, count, __func__);
+}
+
+size_t ProxyNVM_writev(ProxyNVM* self, ProxyNVM_Segment* segments, size_t count)
+{
+    Debug_ASSERT_SELF(self);
+
+    return vectored(self, COMMAND_WRITEV, segments, count, __func__);
+}
+
+size_t ProxyNVM_getChunkSize(ProxyNVM* self, uint8_t command)
+{
+    Debug_ASSERT_SELF(self);
+
+    // this negotiates the frame size on first use
+    hasFeature(self, ProxyNVM_FEATURE_TAGGED);
+
+    return (COMMAND_READ == command) ? MAX_RESP_PAYLOAD_LEN
+                                     : MAX_REQ_PAYLOAD_LEN;
+}
+
+bool ProxyNVM_startTransfer(ProxyNVM* self, ProxyNVM_Transfer* xfer,
+                            uint8_t command, size_t addr, void* buffer,
+                            size_t length)
+{
+    Debug_ASSERT_SELF(self);
+    Debug_ASSERT(xfer != NULL);
+    Debug_ASSERT((COMMAND_READ == command) || (COMMAND_WRITE == command));
+    Debug_ASSERT((buffer != NULL) || (COMMAND_WRITE == command));
+
+    if (!isValidStorageArea(ProxyNVM_TO_NVM(self), addr, length)
+        || !fitsFields(self, addr, length))
+    {
+        Debug_LOG_ERROR("%s: Area out of bounds: addr = %zu, length = %zu",
+                        __func__, addr, length);
+        return false;
+    }
+
+    if (!readAheadDrop(self))
+    {
+        return false;
+    }
+
+    if (COMMAND_WRITE == command)
+    {
+        hashesForget(self, addr, length);
+        erasedForget(self, addr, length);
+    }
+
+    transferInit(self, xfer, command, addr, buffer, length, __func__);
+
+    return true;
+}
+
+bool ProxyNVM_sendChunks(ProxyNVM* self, ProxyNVM_Transfer* xfer)
+{
+    Debug_ASSERT_SELF(self);
+    Debug_ASSERT(xfer != NULL);
+
+    // Keep the window filled, but don't issue new requests once a chunk
+    // failed. The outstanding responses still have to be drained to keep
+    // the stream in sync.
+    while (!xfer->isBroken && (xfer->sent < xfer->chunks)
+           && (xfer->failed == xfer->chunks)
+           && (xfer->sent - xfer->received < xfer->window))
+    {
+        size_t const offset = xfer->sent * xfer->chunkLen;
+        size_t const len = ((xfer->length - offset) < xfer->chunkLen)
+                           ? (xfer->length - offset)
+                           : xfer->chunkLen;
+
+        if (!sendRequest(self, xfer->command, xfer->isTagged,
+                         (uint8_t)(xfer->firstTag + xfer->sent),
+                         xfer->addr + offset, len,
+                         ((COMMAND_WRITE == xfer->command)
+                          && (NULL != xfer->buffer))
+                         ? &xfer->buffer[offset] : NULL))
+        {
+            Debug_LOG_ERROR("%s: Sending request for chunk %zu failed",
+                            xfer->func, xfer->sent);
+            xfer->isBroken = true;
+            return false;
+        }
+        xfer->sent++;
+    }
+
+    return !xfer->isBroken;
+}
+
+bool ProxyNVM_recvChunk(ProxyNVM* self, ProxyNVM_Transfer* xfer)
+{
+    Debug_ASSERT_SELF(self);
+    Debug_ASSERT(xfer != NULL);
+
+    if (xfer->isBroken || (xfer->received == xfer->sent))
+    {
+        return !xfer->isBroken;
+    }
+
+    uint8_t const command = xfer->command;
+    char* const buffer = xfer->buffer;
+    char const* const func = xfer->func;
+    size_t const idx = xfer->received++;
+    size_t const offset = idx * xfer->chunkLen;
+    size_t const len = ((xfer->length - offset) < xfer->chunkLen)
+                       ? (xfer->length - offset)
+                       : xfer->chunkLen;
+    Response resp;
+
+    if (!recvResponse(self, xfer->isTagged, &resp))
+    {
+        Debug_LOG_ERROR("%s: Receiving response for chunk %zu failed",
+                        func, idx);
+        xfer->isBroken = true;
+        return false;
+    }
+
+    // The proxy handles the requests in order, so any mismatch means the
+    // stream is out of sync and there is no way to recover.
+    if ((resp.command != command)
+        || (xfer->isTagged && (resp.tag != (uint8_t)(xfer->firstTag + idx)))
+        || (resp.bytes > len))
+    {
+        Debug_LOG_ERROR("%s: Unexpected response for chunk %zu: "
+                        "command = %u, tag = %u, bytes = %zu",
+                        func, idx, resp.command, resp.tag, resp.bytes);
+        breakStream(self);
+        xfer->isBroken = true;
+        return false;
+    }
+
+    if (resp.retval != RET_OK)
+    {
+        Debug_LOG_ERROR("%s: Chunk %zu at addr = %zu failed", func, idx,
+                        xfer->addr + offset);
+        handleError(self, resp.retval, func);
+    }
+    else if (resp.bytes != len)
+    {
+        Debug_LOG_ERROR("%s: Chunk %zu at addr = %zu, tried to transfer "
+                        "%zu bytes, but successfully transferred %zu",
+                        func, idx, xfer->addr + offset, len, resp.bytes);
+    }
+    else
+    {
+        if ((COMMAND_READ == command)
+            && !recvReadPayload(self, &resp, &buffer[offset]))
+        {
+            Debug_LOG_ERROR("%s: Receiving payload of chunk %zu failed",
+                            func, idx);
+            xfer->isBroken = true;
+            return false;
+        }
+        return true;
+    }
+
+    if (idx < xfer->failed)
+    {
+        xfer->failed = idx;
+    }
+
+    // a failed read may still carry a partial payload
+    if ((COMMAND_READ == command) && !recvReadPayload(self, &resp, NULL))
+    {
+        Debug_LOG_ERROR("%s: Receiving payload of chunk %zu failed",
+                        func, idx);
+        xfer->isBroken = true;
+        return false;
+    }
+
+    return true;
+}
+
+bool ProxyNVM_isTransferDone(ProxyNVM_Transfer const* xfer)
+{
+    Debug_ASSERT(xfer != NULL);
+
+    return xfer->isBroken
+           || ((xfer->received == xfer->sent)
+               && ((xfer->sent == xfer->chunks)
+                   || (xfer->failed < xfer->chunks)));
+}
+
+size_t ProxyNVM_getTransferred(ProxyNVM_Transfer const* xfer)
+{
+    Debug_ASSERT(xfer != NULL);
+
+    if (xfer->isBroken)
+    {
+        return 0;
+    }
+
+    return (xfer->failed == xfer->chunks)
+           ? xfer->length
+           : (xfer->failed * xfer->chunkLen);
+}
+
+bool ProxyNVM_startVectored(ProxyNVM* self, ProxyNVM_Vectored* vx,
+                            uint8_t command, ProxyNVM_Segment* segments,
+                            size_t count)
+{
+    Debug_ASSERT_SELF(self);
+    Debug_ASSERT(vx != NULL);
+    Debug_ASSERT((COMMAND_READV == command) || (COMMAND_WRITEV == command));
+
+    if (!hasFeature(self, ProxyNVM_FEATURE_VECTORED))
+    {
+        Debug_LOG_ERROR("%s: Proxy does not support COMMAND_READV/WRITEV",
+                        __func__);
+        return false;
+    }
+
+    if (!vectoredPrepare(self, command, segments, count, __func__))
+    {
+        return false;
+    }
+
+    vectoredInit(self, vx, command, segments, count, __func__);
+
+    return true;
+}
+
+bool ProxyNVM_sendFrames(ProxyNVM* self, ProxyNVM_Vectored* vx)
+{
+    Debug_ASSERT_SELF(self);
+    Debug_ASSERT(vx != NULL);
+
+    while (!vx->isBroken && !vx->isAllSent
+           && (vx->sent - vx->received < vx->window))
+    {
+        ProxyNVM_Batch* const batch = &vx->frames[vx->sent % vx->window];
+
+        if (!sendBatch(self, vx->command, vx->isTagged, vx->segs, vx->count,
+                       &vx->next, batch))
+        {
+            Debug_LOG_ERROR("%s: Sending frame %zu failed", vx->func,
+                            vx->sent);
+            vx->isBroken = true;
+            return false;
+        }
+
+        if (0 == batch->runs)
+        {
+            vx->isAllSent = true;
+        }
+        else
+        {
+            vx->sent++;
+        }
+    }
+
+    return !vx->isBroken;
+}
+
+bool ProxyNVM_recvFrame(ProxyNVM* self, ProxyNVM_Vectored* vx)
+{
+    Debug_ASSERT_SELF(self);
+    Debug_ASSERT(vx != NULL);
+
+    if (vx->isBroken || (vx->received == vx->sent))
+    {
+        return !vx->isBroken;
+    }
+
+    if (!recvBatch(self, vx->command, vx->isTagged, vx->segs, vx->count,
+                   &vx->frames[vx->received % vx->window], vx->func))
+    {
+        Debug_LOG_ERROR("%s: Receiving frame %zu failed", vx->func,
+                        vx->received);
+        vx->isBroken = true;
+        return false;
+    }
+    vx->received++;
+
+    return true;
+}
+
+bool ProxyNVM_isVectoredDone(ProxyNVM_Vectored const* vx)
+{
+    Debug_ASSERT(vx != NULL);
+
+    return vx->isBroken || (vx->isAllSent && (vx->received == vx->sent));
+}
+
+size_t ProxyNVM_getMaxCopy(ProxyNVM* self)
+{
+    Debug_ASSERT_SELF(self);
+
+    // this negotiates the frame size on first use
+    hasFeature(self, ProxyNVM_FEATURE_COPY);
+
+    return maxCopyChunks(self) * ProxyNVM_COPY_CHUNK_SIZE;
+}
+
+bool ProxyNVM_startRequest(ProxyNVM* self, ProxyNVM_Request* req,
+                           uint8_t command, size_t addr, size_t src,
+                           size_t length)
+{
+    Debug_ASSERT_SELF(self);
+    Debug_ASSERT(req != NULL);
+    Debug_ASSERT((COMMAND_ERASE == command) || (COMMAND_DISCARD == command)
+                 || (COMMAND_COPY == command));
+
+    Nvm* const nvm = ProxyNVM_TO_NVM(self);
+    bool const isCopy = (COMMAND_COPY == command);
+    uint32_t const feature = (COMMAND_ERASE == command)
+                             ? ProxyNVM_FEATURE_ERASE
+                             : isCopy ? ProxyNVM_FEATURE_COPY
+                                      : ProxyNVM_FEATURE_DISCARD;
+
+    requestInit(req, command, addr, src, length, __func__);
+
+    if (!isValidStorageArea(nvm, addr, length)
+        || !fitsFields(self, addr, length)
+        || (isCopy && (!isValidStorageArea(nvm, src, length)
+                       || !fitsFields(self, src, length))))
+    {
+        Debug_LOG_ERROR("%s: Area out of bounds: addr = %zu, src = %zu, "
+                        "length = %zu", __func__, addr, src, length);
+        return false;
+    }
+
+    if (!hasFeature(self, feature))
+    {
+        Debug_LOG_ERROR("%s: Proxy does not support command %u", __func__,
+                        command);
+        return false;
+    }
+
+    if (isCopy && (length > ProxyNVM_getMaxCopy(self)))
+    {
+        Debug_LOG_ERROR("%s: Copy of %zu bytes exceeds a single request",
+                        __func__, length);
+        return false;
+    }
+
+    if (!readAheadDrop(self))
+    {
+        return false;
+    }
+
+    return sendRange(self, req);
+}
+
+size_t ProxyNVM_finishRequest(ProxyNVM* self, ProxyNVM_Request* req)
+{
+    Debug_ASSERT_SELF(self);
+    Debug_ASSERT(req != NULL);
+
+    size_t const done = recvRange(self, req);
+
+    if (COMMAND_ERASE == req->command)
+    {
+        hashesErased(self, req->addr, req->length, done);
+        erasedMark(self, req->addr, done);
+    }
+    else
+    {
+        // even a failed request may have changed the range
+        hashesForget(self, req->addr, req->length);
+        erasedForget(self, req->addr, req->length);
+    }
+
+    req->isSent = false;
+
+    return done;
+}
+
+void ProxyNVM_getStats(ProxyNVM* self, ProxyNVM_Stats* stats)
+{
+    Debug_ASSERT_SELF(self);
+    Debug_ASSERT(stats != NULL);
+
+    *stats = self->stats;
+}
+
+void ProxyNVM_resetStats(ProxyNVM* self)
+{
+    Debug_ASSERT_SELF(self);
+
+    memset(&self->stats, 0, sizeof(self->stats));
+}
+
+void ProxyNVM_dtor(Nvm* nvm)
+{
+    DECL_UNUSED_VAR(ProxyNVM * self) = (ProxyNVM*) nvm;
+    Debug_ASSERT_SELF(self);
+}
+
+/* Private functions ---------------------------------------------------------*/
+static
+bool
+isValidStorageArea(
+    Nvm* nvm,
+    size_t const offset,
+    size_t const size)
+{
+    size_t const end = offset + size;
+    // Checking integer overflow first. The end index is not part of the area,
+    // but we allow offset = end with size = 0 here
+    return ( (end >= offset) && (end <= ProxyNVM_getSize(nvm)) );
+}
+
+static bool hasFeature(ProxyNVM* self, uint32_t feature)
+{
+    if (!self->isFeaturesQueried && !negotiate(self))
+    {
+        return false;
+    }
+
+    return (feature == (self->features & feature));
+}
+
+// Returns false if the channel failed, then the features are not known and
+// the handshake is done again on the next use.
+static bool negotiate(ProxyNVM* self)
+{
+    // without a negotiated frame size, messages must fit into msgBuf
+    size_t maxMsgLen = self->msgBufSize - HDLC_HEADER;
+
+    if (self->isLost)
+    {
+        return false;
+    }
+
+    Handshake result = hello(self, &maxMsgLen);
+
+    if (HANDSHAKE_REJECTED == result)
+    {
+        result = queryFeatures(self, &maxMsgLen);
+    }
+
+    // larger addresses don't fit into size_t anyway
+    if ((HANDSHAKE_OK == result) && (sizeof(size_t) > ADDRESS_SIZE)
+        && (self->features & ProxyNVM_FEATURE_WIDE))
+    {
+        result = widenFields(self);
+    }
+
+    if (HANDSHAKE_OK != result)
+    {
+        Debug_LOG_ERROR("%s: Handshake with the proxy failed", __func__);
+        self->features = 0;
+
+        // Without the features resync() has nothing to go by. The handshake
+        // comes first and has one request outstanding at a time, so if none
+        // of the failed one was sent the stream is still in sync. Otherwise
+        // the proxy may have taken it, and the rest of its response or the
+        // size of the fields are unknown.
+        if (self->streamSent == self->requestStart)
+        {
+            self->isOutOfSync = false;
+        }
+        else
+        {
+            loseStream(self);
+        }
+        return false;
+    }
+
+    self->isFeaturesQueried = true;
+
+    if (maxMsgLen < self->maxMsgLen)
+    {
+        self->maxMsgLen = maxMsgLen;
+    }
+
+    Debug_LOG_DEBUG("%s: proxy version %u, features 0x%08x, using frames of "
+                    "%zu bytes, %zu outstanding requests and %zu byte "
+                    "addresses", __func__, (unsigned int) self->version,
+                    (unsigned int) self->features, self->maxMsgLen,
+                    self->window, self->fieldSize);
+
+    return true;
+}
+
+// Gets the capabilities of the proxy with COMMAND_HELLO.
+static Handshake hello(ProxyNVM* self, size_t* maxMsgLen)
+{
+    constructMsg(self, COMMAND_HELLO, 0, 0);
+
+    if (!exchange(self, 1))
+    {
+        return HANDSHAKE_FAILED;
+    }
+
+    // the rest of the response only follows if it succeeded
+    if (self->msgBuf[RESP_RETVAL_INDEX] != RET_OK)
+    {
+        return HANDSHAKE_REJECTED;
+    }
+
+    if (!recvAll(self, &self->msgBuf[RESP_HEADER_LEN],
+                 HELLO_RESP_LEN - RESP_HEADER_LEN))
+    {
+        return HANDSHAKE_FAILED;
+    }
+
+    size_t const frameSize =
+        BitConverter_getUint32BE(&self->msgBuf[HELLO_FRAME_SIZE_INDEX]);
+    size_t const window =
+        BitConverter_getUint32BE(&self->msgBuf[HELLO_WINDOW_INDEX]);
+
+    self->version = BitConverter_getUint32BE(&self->msgBuf[RESP_BYTES_INDEX]);
+    self->features =
+        BitConverter_getUint32BE(&self->msgBuf[HELLO_FEATURES_INDEX]);
+
+    // a frame must at least be able to carry a header and some payload
+    if (frameSize > MAX_REQUEST_HEADER_LEN + TAG_LEN)
+    {
+        *maxMsgLen = frameSize;
+    }
+    else
+    {
+        Debug_LOG_WARNING("%s: Proxy reports frames of %zu bytes, using %zu "
+                          "bytes", __func__, frameSize, *maxMsgLen);
+    }
+
+    if ((window > 0) && (window < self->window))
+    {
+        self->window = window;
+    }
+
+    return HANDSHAKE_OK;
+}
+
+// Gets the features of a proxy without COMMAND_HELLO and negotiates the frame
+// size if it supports this.
+static Handshake queryFeatures(ProxyNVM* self, size_t* maxMsgLen)
+{
+    constructMsg(self, COMMAND_GET_FEATURES, 0, 0);
+
+    if (!exchange(self, 1))
+    {
+        return HANDSHAKE_FAILED;
+    }
+
+    // older proxies don't know the command and fail it, so they just get
+    // the plain protocol
+    self->features = (self->msgBuf[RESP_RETVAL_INDEX] == RET_OK)
+                     ? BitConverter_getUint32BE(&self->msgBuf[RESP_BYTES_INDEX])
+                     : 0;
+
+    if (self->features & ProxyNVM_FEATURE_FRAME_SIZE)
+    {
+        constructMsg(self, COMMAND_SET_FRAME_SIZE, self->maxMsgLen, 0);
+
+        if (!exchange(self, REQ_LEN_INDEX))
+        {
+            return HANDSHAKE_FAILED;
+        }
+
+        size_t const accepted =
+            BitConverter_getUint32BE(&self->msgBuf[RESP_BYTES_INDEX]);
+
+        // the proxy must never accept more than we asked for, and a frame must
+        // at least be able to carry a header and some payload
+        if ((self->msgBuf[RESP_RETVAL_INDEX] == RET_OK)
+            && (accepted <= self->maxMsgLen)
+            && (accepted > MAX_REQUEST_HEADER_LEN + TAG_LEN))
+        {
+            *maxMsgLen = accepted;
+        }
+        else
+        {
+            Debug_LOG_WARNING("%s: Proxy failed frame size negotiation, "
+                              "using %zu bytes", __func__, *maxMsgLen);
+        }
+    }
+    else if (self->maxMsgLen > *maxMsgLen)
+    {
+        Debug_LOG_WARNING("%s: Proxy can't use frames larger than %zu bytes",
+                          __func__, *maxMsgLen);
+    }
+
+    return HANDSHAKE_OK;
+}
+
+// Switches to 64 bit fields, the proxy uses them from the next request on.
+static Handshake widenFields(ProxyNVM* self)
+{
+    constructMsg(self, COMMAND_SET_ADDRESS_SIZE, WIDE_FIELD_SIZE, 0);
+
+    if (!exchange(self, REQ_LEN_INDEX))
+    {
+        return HANDSHAKE_FAILED;
+    }
+
+    if ((self->msgBuf[RESP_RETVAL_INDEX] == RET_OK)
+        && (BitConverter_getUint32BE(&self->msgBuf[RESP_BYTES_INDEX])
+            == WIDE_FIELD_SIZE))
+    {
+        self->fieldSize = WIDE_FIELD_SIZE;
+        self->writeHeader = writeHeader64;
+    }
+    else
+    {
+        Debug_LOG_WARNING("%s: Proxy failed address size negotiation, using "
+                          "%d byte addresses", __func__, ADDRESS_SIZE);
+    }
+
+    return HANDSHAKE_OK;
+}
+
+// Fallback for proxies without COMMAND_ERASE, writes 0xFF to the whole range.
+static size_t
+eraseByWrite(
+    ProxyNVM*   self,
+    size_t      addr,
+    size_t      length,
+    const char* func)
+{
+    return transfer(self, COMMAND_WRITE, addr, NULL, length, func);
+}
+
+// Number of chunk results that fit into a copy response, they are received
+// into msgBuf.
+static size_t maxCopyChunks(ProxyNVM* self)
+{
+    size_t const room = (MAX_RESP_PAYLOAD_LEN < self->msgBufSize)
+                        ? MAX_RESP_PAYLOAD_LEN
+                        : self->msgBufSize;
+
+    return room / SEG_RESULT_SIZE;
+}
+
+// Erases, discards or copies a range with a single request and waits for
+// the response.
+static size_t
+rangeRequest(
+    ProxyNVM*   self,
+    uint8_t     command,
+    size_t      addr,
+    size_t      src,
+    size_t      length,
+    const char* func)
+{
+    ProxyNVM_Request req;
+
+    requestInit(&req, command, addr, src, length, func);
+
+    return sendRange(self, &req) ? recvRange(self, &req) : 0;
+}
+
+static void
+requestInit(
+    ProxyNVM_Request* req,
+    uint8_t           command,
+    size_t            addr,
+    size_t            src,
+    size_t            length,
+    const char*       func)
+{
+    req->command = command;
+    req->addr = addr;
+    req->src = src;
+    req->length = length;
+    // the proxy copies overlapping ranges like memmove()
+    req->isBackwards = (COMMAND_COPY == command) && (addr > src)
+                       && ((addr - src) < length);
+    req->isSent = false;
+    req->func = func;
+}
+
+static bool sendRange(ProxyNVM* self, ProxyNVM_Request* req)
+{
+    size_t requestLen = REQ_HDR_LEN;
+
+    constructMsg(self, req->command, req->addr, req->length);
+
+    if (COMMAND_COPY == req->command)
+    {
+        putField(self, &self->msgBuf[REQ_HDR_LEN], req->src);
+        BitConverter_putUint32BE(ProxyNVM_COPY_CHUNK_SIZE,
+                                 &self->msgBuf[REQ_HDR_LEN + self->fieldSize]);
+        requestLen += self->fieldSize + CHUNK_SIZE_LEN;
+    }
+
+    self->stats.framesSent++;
+
+    if (!sendAll(self, self->msgBuf, requestLen))
+    {
+        Debug_LOG_ERROR("%s: Request failed", req->func);
+        return false;
+    }
+
+    req->isSent = true;
+
+    return true;
+}
+
+// Receives the response to a request of sendRange(). Returns the bytes done
+// from the start of the range, or from its end for a backwards copy.
+static size_t recvRange(ProxyNVM* self, ProxyNVM_Request const* req)
+{
+    if (!req->isSent)
+    {
+        return 0;
+    }
+
+    if (!recvAll(self, self->msgBuf, RESP_HDR_LEN))
+    {
+        Debug_LOG_ERROR("%s: Request failed", req->func);
+        return 0;
+    }
+
+    self->stats.framesReceived++;
+
+    uint8_t const command = self->msgBuf[RESP_COMM_INDEX];
+    int8_t const retval = self->msgBuf[RESP_RETVAL_INDEX];
+    size_t const bytes = getField(self, &self->msgBuf[RESP_BYTES_INDEX]);
+
+    if ((command != req->command) || (bytes > req->length))
+    {
+        Debug_LOG_ERROR("%s: Unexpected response: command = %u, bytes = %zu",
+                        req->func, command, bytes);
+        breakStream(self);
+        return 0;
+    }
+
+    if (retval != RET_OK)
+    {
+        handleError(self, retval, req->func);
+        return 0;
+    }
+
+    if (COMMAND_COPY == req->command)
+    {
+        return recvCopyResults(self, req);
+    }
+
+    if (bytes != req->length)
+    {
+        Debug_LOG_ERROR("%s: Tried to handle %zu bytes, but the proxy "
+                        "handled %zu", req->func, req->length, bytes);
+        return 0;
+    }
+
+    return bytes;
+}
+
+// Receives the chunk results that follow the header of a copy response.
+static size_t recvCopyResults(ProxyNVM* self, ProxyNVM_Request const* req)
+{
+    size_t const length = req->length;
+    size_t const count = (length + ProxyNVM_COPY_CHUNK_SIZE - 1)
+                         / ProxyNVM_COPY_CHUNK_SIZE;
+
+    if (!recvAll(self, self->msgBuf, count * SEG_RESULT_SIZE))
+    {
+        Debug_LOG_ERROR("%s: Receiving the chunk results failed", req->func);
+        return 0;
+    }
+
+    size_t copied = 0;
+    bool isComplete = true;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        // results are in the order of the addresses
+        size_t const chunk = req->isBackwards ? (count - 1 - i) : i;
+        char const* const result = &self->msgBuf[chunk * SEG_RESULT_SIZE];
+        size_t const offset = chunk * ProxyNVM_COPY_CHUNK_SIZE;
+        size_t const len = ((length - offset) < ProxyNVM_COPY_CHUNK_SIZE)
+                           ? (length - offset)
+                           : ProxyNVM_COPY_CHUNK_SIZE;
+        int8_t const retval = result[0];
+
+        if (RET_OK != retval)
+        {
+            handleError(self, retval, req->func);
+        }
+
+        isComplete = isComplete && (RET_OK == retval)
+                     && (getField(self, &result[1]) == len);
+        copied += isComplete ? len : 0;
+    }
+
+    return copied;
+}
+
+// Splits a read or write into chunks that fit into a frame. If the proxy
+// supports tagged frames, up to self->window chunk requests are
+// outstanding at a time, otherwise each chunk is a stop-and-wait round-trip.
+// A NULL buffer for COMMAND_WRITE writes 0xFF. Returns the number of bytes
+// transferred successfully from the start of the range.
+static size_t
+transfer(
+    ProxyNVM*   self,
+    uint8_t     command,
+    size_t      addr,
+    char*       buffer,
+    size_t      length,
+    const char* func)
+{
+    ProxyNVM_Transfer xfer;
+
+    // an earlier request of the same operation may have broken the stream
+    if (self->isOutOfSync && !resync(self))
+    {
+        return 0;
+    }
+
+    transferInit(self, &xfer, command, addr, buffer, length, func);
+
+    while (!ProxyNVM_isTransferDone(&xfer))
+    {
+        if (!ProxyNVM_sendChunks(self, &xfer)
+            || !ProxyNVM_recvChunk(self, &xfer))
+        {
+            break;
+        }
+    }
+
+    return ProxyNVM_getTransferred(&xfer);
+}
+
+static void
+transferInit(
+    ProxyNVM*          self,
+    ProxyNVM_Transfer* xfer,
+    uint8_t            command,
+    size_t             addr,
+    char*              buffer,
+    size_t             length,
+    const char*        func)
+{
+    // this negotiates the frame size on first use, so it must come first
+    xfer->isTagged = hasFeature(self, ProxyNVM_FEATURE_TAGGED);
+    xfer->command = command;
+    xfer->addr = addr;
+    xfer->buffer = buffer;
+    xfer->length = length;
+    xfer->chunkLen = ProxyNVM_getChunkSize(self, command);
+    xfer->chunks = (length + xfer->chunkLen - 1) / xfer->chunkLen;
+    xfer->window = xfer->isTagged ? self->window : 1;
+    xfer->firstTag = self->nextTag;
+    xfer->sent = 0;
+    xfer->received = 0;
+    xfer->failed = xfer->chunks;
+    xfer->isBroken = false;
+    xfer->func = func;
+
+    self->nextTag = (uint8_t)(xfer->firstTag + xfer->chunks);
+}
+
+static bool
+sendRequest(
+    ProxyNVM*   self,
+    uint8_t     command,
+    bool        isTagged,
+    uint8_t     tag,
+    size_t      addr,
+    size_t      length,
+    char const* payload)
+{
+    // this may talk to the proxy, so it must come before building the request
+    bool const isCompressing = (NULL != self->codec)
+                               && hasFeature(self, ProxyNVM_FEATURE_COMPRESSION);
+    size_t msgLen = REQ_HDR_LEN;
+
+    self->stats.framesSent++;
+    constructMsg(self, command, addr, length);
+
+    if (isTagged)
+    {
+        self->msgBuf[REQ_COMM_INDEX] |= TAG_FLAG;
+        self->msgBuf[msgLen++] = tag;
+    }
+
+    if ((COMMAND_READ == command) && hasFeature(self, ProxyNVM_FEATURE_FILL))
+    {
+        self->msgBuf[REQ_COMM_INDEX] |= FILL_FLAG;
+    }
+
+    // a compressed response is smaller than the payload and is received into
+    // msgBuf
+    if ((COMMAND_READ == command) && isCompressing
+        && (length <= self->msgBufSize))
+    {
+        self->msgBuf[REQ_COMM_INDEX] |= COMPRESSED_FLAG;
+    }
+
+    if ((COMMAND_WRITE == command) && (payload != NULL) && isCompressing)
+    {
+        size_t const compressedLen = compressPayload(self, msgLen, payload,
+                                                     length);
+        if (compressedLen > 0)
+        {
+            self->msgBuf[REQ_COMM_INDEX] |= COMPRESSED_FLAG;
+            BitConverter_putUint32BE((uint32_t) compressedLen,
+                                     &self->msgBuf[msgLen]);
+
+            return sendAll(self, self->msgBuf,
+                           msgLen + COMPRESSED_LEN_SIZE + compressedLen);
+        }
+    }
+
+    if (COMMAND_WRITE == command)
+    {
+        if (payload == NULL)
+        {
+            //writing 0xFF => erase command
+            if (msgLen + length <= self->msgBufSize)
+            {
+                memset(&self->msgBuf[msgLen], 0xFF, length);
+                msgLen += length;
+            }
+            else
+            {
+                // the frame is larger than msgBuf, send it in pieces
+                if (!sendAll(self, self->msgBuf, msgLen))
+                {
+                    return false;
+                }
+                memset(self->msgBuf, 0xFF, self->msgBufSize);
+                while (length > 0)
+                {
+                    size_t const len = (length < self->msgBufSize)
+                                       ? length : self->msgBufSize;
+                    if (!sendAll(self, self->msgBuf, len))
+                    {
+                        return false;
+                    }
+                    length -= len;
+                }
+                return true;
+            }
+        }
+        else if (length < ZERO_COPY_MIN_LEN)
+        {
+            // not worth an additional ChanMux call
+            memcpy(&self->msgBuf[msgLen], payload, length);
+            msgLen += length;
+        }
+        else
+        {
+            // send the payload straight from the caller's buffer, so it does
+            // not get copied into msgBuf first
+            return sendAll(self, self->msgBuf, msgLen)
+                   && sendAll(self, payload, length);
+        }
+    }
+
+    return sendAll(self, self->msgBuf, msgLen);
+}
+
+static bool
+recvResponse(
+    ProxyNVM* self,
+    bool      isTagged,
+    Response* resp)
+{
+    size_t const msgLen = RESP_HDR_LEN + (isTagged ? TAG_LEN : 0);
+
+    if (!recvAll(self, self->msgBuf, msgLen))
+    {
+        return false;
+    }
+
+    self->stats.framesReceived++;
+    resp->command = self->msgBuf[RESP_COMM_INDEX] & COMMAND_MASK;
+    resp->isCompressed = (0 != (self->msgBuf[RESP_COMM_INDEX]
+                                & COMPRESSED_FLAG));
+    resp->isFilled = (0 != (self->msgBuf[RESP_COMM_INDEX] & FILL_FLAG));
+    resp->retval  = self->msgBuf[RESP_RETVAL_INDEX];
+    resp->bytes   = getField(self, &self->msgBuf[RESP_BYTES_INDEX]);
+    resp->tag     = isTagged ? self->msgBuf[RESP_HDR_LEN] : 0;
+
+    return true;
+}
+
+// Reads the payload of a response straight into 'buffer', or drops it if
+// 'buffer' is NULL.
+static bool recvPayload(ProxyNVM* self, char* buffer, size_t length)
+{
+    if (buffer != NULL)
+    {
+        return recvAll(self, buffer, length);
+    }
+
+    while (length > 0)
+    {
+        size_t const len = (length < self->msgBufSize) ? length : self->msgBufSize;
+
+        if (!recvAll(self, self->msgBuf, len))
+        {
+            return false;
+        }
+        length -= len;
+    }
+
+    return true;
+}
+
+// Receives the payload of a read response like recvPayload(), a compressed
+// payload is decompressed into 'buffer' and a fill response is expanded.
+static bool recvReadPayload(ProxyNVM* self, Response const* resp, char* buffer)
+{
+    if (resp->isFilled)
+    {
+        if (!recvAll(self, self->msgBuf, FILL_LEN))
+        {
+            return false;
+        }
+        if (buffer != NULL)
+        {
+            memset(buffer, self->msgBuf[0], resp->bytes);
+        }
+        return true;
+    }
+
+    if (!resp->isCompressed)
+    {
+        return recvPayload(self, buffer, resp->bytes);
+    }
+
+    if (!recvAll(self, self->msgBuf, COMPRESSED_LEN_SIZE))
+    {
+        return false;
+    }
+
+    size_t const compressedLen = BitConverter_getUint32BE(self->msgBuf);
+
+    // the proxy only compresses payloads that fit into msgBuf afterwards
+    if ((compressedLen >= resp->bytes) || (compressedLen > self->msgBufSize))
+    {
+        Debug_LOG_ERROR("%s: Unexpected compressed length %zu for %zu bytes",
+                        __func__, compressedLen, resp->bytes);
+        breakStream(self);
+        return false;
+    }
+
+    if (!recvAll(self, self->msgBuf, compressedLen))
+    {
+        return false;
+    }
+
+    if ((buffer != NULL)
+        && !ProxyNVM_decompress(self->msgBuf, compressedLen, buffer,
+                                resp->bytes))
+    {
+        Debug_LOG_ERROR("%s: Compressed payload is corrupted", __func__);
+        breakStream(self);
+        return false;
+    }
+
+    return true;
+}
+
+// Compresses a write payload into msgBuf, behind the request header of length
+// hdrLen and the compressed length. Returns the compressed length, or 0 if
+// this doesn't make the frame smaller or doesn't fit.
+static size_t
+compressPayload(
+    ProxyNVM*   self,
+    size_t      hdrLen,
+    char const* payload,
+    size_t      length)
+{
+    size_t const room = self->msgBufSize - hdrLen - COMPRESSED_LEN_SIZE;
+
+    if (length <= COMPRESSED_LEN_SIZE + 1)
+    {
+        return 0;
+    }
+
+    size_t const limit = length - COMPRESSED_LEN_SIZE - 1;
+
+    return ProxyNVM_compress(self->codec, payload, length,
+                             &self->msgBuf[hdrLen + COMPRESSED_LEN_SIZE],
+                             (limit < room) ? limit : room);
+}
+
+// Sends the request in msgBuf and receives the response header into msgBuf,
+// for requests and responses without payload.
+static bool exchange(ProxyNVM* self, size_t requestLen)
+{
+    self->stats.framesSent++;
+
+    if (!sendAll(self, self->msgBuf, requestLen)
+        || !recvAll(self, self->msgBuf, RESP_HDR_LEN))
+    {
+        return false;
+    }
+
+    self->stats.framesReceived++;
+
+    return true;
+}
+
+static bool sendAll(ProxyNVM* self, void const* buffer, size_t length)
+{
+    size_t bytes = 0;
+    bool const isOk = (OS_SUCCESS == ChanMuxClient_write(self->chanmux, buffer,
+                                                         length, &bytes))
+                      && (bytes == length);
+
+    self->stats.bytesSent += bytes;
+    self->streamSent += bytes;
+    if (!isOk)
+    {
+        // the proxy waits for the rest of the request and would take whatever
+        // follows as part of it
+        if (self->streamSent != self->requestStart)
+        {
+            loseStream(self);
+        }
+        breakStream(self);
+    }
+
+    return isOk;
+}
+
+static bool recvAll(ProxyNVM* self, void* buffer, size_t length)
+{
+    size_t bytes = 0;
+    bool const isOk = (OS_SUCCESS == ChanMuxClient_read(self->chanmux, buffer,
+                                                        length, &bytes))
+                      && (bytes == length);
+
+    self->stats.bytesReceived += bytes;
+    self->streamReceived += bytes;
+    if (!isOk)
+    {
+        breakStream(self);
+    }
+
+    return isOk;
+}
+
+// Counts a failed ChanMux transfer or an unexpected response. Either leaves
+// the stream at an unknown position, responses of earlier requests may still
+// be on their way or one was received only partly. So the stream is
+// resynchronized before the next request, see resync().
+static void breakStream(ProxyNVM* self)
+{
+    self->stats.channelErrors++;
+    self->isOutOfSync = true;
+}
+
+// Gives up on the stream, after this every request fails.
+static void loseStream(ProxyNVM* self)
+{
+    if (!self->isLost)
+    {
+        Debug_LOG_ERROR("%s: Stream can't be resynchronized, all further "
+                        "requests fail", __func__);
+    }
+    self->isLost = true;
+    self->isOutOfSync = true;
+}
+
+// Sends a COMMAND_SYNC and drops everything received before its response. The
+// response is recognized by the byte counts in it, which must match those of
+// the driver at its position in the stream. A response with the right count of
+// received bytes in a wrong position means bytes got lost on the channel. This,
+// a proxy without COMMAND_SYNC and no response within the data that can be
+// outstanding lose the stream for good. If the channel fails, the stream stays
+// out of sync and the next request tries again.
+static bool resync(ProxyNVM* self)
+{
+    ProxyNVM_ReadAhead* ra = &self->readAhead;
+    size_t const limit = ((self->window + 1) * self->maxMsgLen)
+                         + SYNC_RESP_LEN;
+    char resp[SYNC_RESP_LEN];
+
+    // the read-ahead responses are among the dropped data
+    ra->chunks = 0;
+    ra->length = 0;
+
+    if (self->isLost)
+    {
+        return false;
+    }
+
+    // no hasFeature(), the handshake is a request like any other
+    if (!self->isFeaturesQueried || !(self->features & ProxyNVM_FEATURE_SYNC))
+    {
+        Debug_LOG_ERROR("%s: Proxy does not support COMMAND_SYNC", __func__);
+        loseStream(self);
+        return false;
+    }
+
+    self->isOutOfSync = false;
+    constructMsg(self, COMMAND_SYNC, 0, 0);
+    self->stats.framesSent++;
+
+    if (!sendAll(self, self->msgBuf, 1))
+    {
+        return false;
+    }
+
+    uint64_t const sent = self->streamSent;
+    uint64_t const first = self->streamReceived;
+    uint64_t pos = first;   // position of resp[0] in the stream
+
+    if (!recvAll(self, resp, sizeof(resp)))
+    {
+        return false;
+    }
+
+    for (;;)
+    {
+        if ((COMMAND_SYNC == (uint8_t) resp[RESP_COMM_INDEX])
+            && (RET_OK == resp[RESP_RETVAL_INDEX])
+            && (getBE(&resp[SYNC_RECEIVED_INDEX], SYNC_COUNT_LEN) == sent))
+        {
+            if (getBE(&resp[SYNC_SENT_INDEX], SYNC_COUNT_LEN) != pos)
+            {
+                Debug_LOG_ERROR("%s: Response out of place, bytes were lost",
+                                __func__);
+                loseStream(self);
+                return false;
+            }
+
+            self->stats.framesReceived++;
+            Debug_LOG_WARNING("%s: Dropped %zu bytes to get back in sync",
+                              __func__, (size_t) (pos - first));
+            return true;
+        }
+
+        if (pos - first >= limit)
+        {
+            Debug_LOG_ERROR("%s: No response within %zu bytes", __func__,
+                            limit);
+            loseStream(self);
+            return false;
+        }
+
+        memmove(resp, &resp[1], sizeof(resp) - 1);
+        if (!recvAll(self, &resp[sizeof(resp) - 1], 1))
+        {
+            return false;
+        }
+        pos++;
+    }
+}
+
+static size_t
+vectored(
+    ProxyNVM*         self,
+    uint8_t           command,
+    ProxyNVM_Segment* segs,
+    size_t            count,
+    const char*       func)
+{
+    if (!vectoredPrepare(self, command, segs, count, func))
+    {
+        return 0;
+    }
+
+    if (hasFeature(self, ProxyNVM_FEATURE_VECTORED))
+    {
+        // failed segments don't stop the transfer, only a broken channel does
+        ProxyNVM_Vectored vx;
+
+        vectoredInit(self, &vx, command, segs, count, func);
+
+        while (!ProxyNVM_isVectoredDone(&vx))
+        {
+            if (!ProxyNVM_sendFrames(self, &vx)
+                || !ProxyNVM_recvFrame(self, &vx))
+            {
+                break;
+            }
+        }
+    }
+    else
+    {
+        // a frame per run of adjacent segments
+        uint8_t const single = (COMMAND_READV == command)
+                               ? COMMAND_READ
+                               : COMMAND_WRITE;
+        ProxyNVM_SegCursor cur = { 0, 0 };
+        ProxyNVM_SegCursor start = cur;
+        size_t addr;
+        char* buf;
+        size_t len;
+
+        while (nextRun(segs, count, &cur, (size_t) -1, &addr, &buf, &len))
+        {
+            credit(segs, count, start, len,
+                   transfer(self, single, addr, buf, len, func));
+            start = cur;
+        }
+    }
+
+    size_t complete = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        complete += (segs[i].done == segs[i].length) ? 1 : 0;
+    }
+
+    return complete;
+}
+
+// Checks the segments and readies the ProxyNVM for a vectored transfer.
+static bool
+vectoredPrepare(
+    ProxyNVM*         self,
+    uint8_t           command,
+    ProxyNVM_Segment* segs,
+    size_t            count,
+    const char*       func)
+{
+    Debug_ASSERT((segs != NULL) || (0 == count));
+
+    for (size_t i = 0; i < count; i++)
+    {
+        Debug_ASSERT(segs[i].buffer != NULL);
+        segs[i].done = 0;
+
+        if (!isValidStorageArea(ProxyNVM_TO_NVM(self), segs[i].addr,
+                                segs[i].length)
+            || !fitsFields(self, segs[i].addr, segs[i].length))
+        {
+            Debug_LOG_ERROR(
+                "%s: Segment %zu out of bounds: addr = %zu, length = %zu",
+                func, i, segs[i].addr, segs[i].length);
+
+            return false;
+        }
+    }
+
+    if (!readAheadDrop(self))
+    {
+        return false;
+    }
+
+    for (size_t i = 0; (COMMAND_WRITEV == command) && (i < count); i++)
+    {
+        hashesForget(self, segs[i].addr, segs[i].length);
+        erasedForget(self, segs[i].addr, segs[i].length);
+    }
+
+    return true;
+}
+
+// Takes the longest run of segments from 'cur' on that are adjacent on the
+// proxy NVM and in memory, but not more than maxLen bytes.
+static bool
+nextRun(
+    ProxyNVM_Segment const* segs,
+    size_t                  count,
+    ProxyNVM_SegCursor*     cur,
+    size_t                  maxLen,
+    size_t*                 addr,
+    char**                  buf,
+    size_t*                 len)
+{
+    while ((cur->seg < count) && (cur->offset == segs[cur->seg].length))
+    {
+        cur->seg++;
+        cur->offset = 0;
+    }
+
+    if ((cur->seg == count) || (0 == maxLen))
+    {
+        return false;
+    }
+
+    *addr = segs[cur->seg].addr + cur->offset;
+    *buf = (char*) segs[cur->seg].buffer + cur->offset;
+    *len = 0;
+
+    for (;;)
+    {
+        ProxyNVM_Segment const* const seg = &segs[cur->seg];
+        size_t const rest = seg->length - cur->offset;
+        size_t const take = (rest < maxLen - *len) ? rest : (maxLen - *len);
+
+        *len += take;
+        cur->offset += take;
+
+        if ((cur->offset < seg->length) || (*len == maxLen))
+        {
+            return true;
+        }
+
+        size_t next = cur->seg + 1;
+        while ((next < count) && (0 == segs[next].length))
+        {
+            next++;
+        }
+
+        if ((next == count)
+            || (segs[next].addr != *addr + *len)
+            || ((char*) segs[next].buffer != *buf + *len))
+        {
+            return true;
+        }
+
+        cur->seg = next;
+        cur->offset = 0;
+    }
+}
+
+// Adds the bytes transferred of a run that starts at 'cur' and is 'len' bytes
+// long to its segments. A segment only counts what follows on its completed
+// start.
+static void
+credit(
+    ProxyNVM_Segment*  segs,
+    size_t             count,
+    ProxyNVM_SegCursor cur,
+    size_t             len,
+    size_t             done)
+{
+    while ((len > 0) && (cur.seg < count))
+    {
+        ProxyNVM_Segment* const seg = &segs[cur.seg];
+        size_t const piece = ((seg->length - cur.offset) < len)
+                             ? (seg->length - cur.offset)
+                             : len;
+        size_t const take = (done < piece) ? done : piece;
+
+        if (seg->done == cur.offset)
+        {
+            seg->done += take;
+        }
+
+        done -= take;
+        len -= piece;
+        cur.seg++;
+        cur.offset = 0;
+    }
+}
+
+// Takes the next run that fits into the frame of 'batch'. The request holds a
+// descriptor and the data of each run, the response a result and the data,
+// so each run leaves less room for the next.
+static bool
+nextBatchRun(
+    ProxyNVM*               self,
+    ProxyNVM_Segment const* segs,
+    size_t                  count,
+    ProxyNVM_SegCursor*     cur,
+    ProxyNVM_Batch*         batch,
+    size_t*                 addr,
+    char**                  buf,
+    size_t*                 len)
+{
+    // the descriptors and results are handled in msgBuf
+    size_t const maxRuns = (self->msgBufSize - REQ_HDR_LEN - TAG_LEN)
+                           / SEG_DESC_SIZE;
+    size_t const used = batch->bytes + ((batch->runs + 1) * SEG_DESC_SIZE);
+
+    if ((batch->runs == maxRuns) || (used >= MAX_REQ_PAYLOAD_LEN)
+        || !nextRun(segs, count, cur, MAX_REQ_PAYLOAD_LEN - used, addr, buf,
+                    len))
+    {
+        return false;
+    }
+
+    batch->runs++;
+    batch->bytes += *len;
+
+    return true;
+}
+
+// Like transferInit(), but each frame carries as many runs of segments as fit.
+static void
+vectoredInit(
+    ProxyNVM*          self,
+    ProxyNVM_Vectored* vx,
+    uint8_t            command,
+    ProxyNVM_Segment*  segs,
+    size_t             count,
+    const char*        func)
+{
+    vx->command = command;
+    vx->segs = segs;
+    vx->count = count;
+    vx->isTagged = hasFeature(self, ProxyNVM_FEATURE_TAGGED);
+    vx->window = vx->isTagged ? self->window : 1;
+    vx->next.seg = 0;
+    vx->next.offset = 0;
+    vx->sent = 0;
+    vx->received = 0;
+    vx->isAllSent = false;
+    vx->isBroken = false;
+    vx->func = func;
+}
+
+// Sends a frame with the runs from 'cur' on. Sends nothing if there are no
+// runs left.
+static bool
+sendBatch(
+    ProxyNVM*               self,
+    uint8_t                 command,
+    bool                    isTagged,
+    ProxyNVM_Segment const* segs,
+    size_t                  count,
+    ProxyNVM_SegCursor*     cur,
+    ProxyNVM_Batch*         batch)
+{
+    size_t used = REQ_HDR_LEN + (isTagged ? TAG_LEN : 0);
+    size_t addr;
+    char* buf;
+    size_t len;
+
+    batch->start = *cur;
+    batch->runs = 0;
+    batch->bytes = 0;
+    batch->tag = self->nextTag;
+
+    while (nextBatchRun(self, segs, count, cur, batch, &addr, &buf, &len))
+    {
+        putField(self, &self->msgBuf[used], addr);
+        putField(self, &self->msgBuf[used + self->fieldSize], len);
+        used += SEG_DESC_SIZE;
+    }
+
+    if (0 == batch->runs)
+    {
+        return true;
+    }
+
+    constructMsg(self, command, batch->runs, batch->bytes);
+    if (isTagged)
+    {
+        self->msgBuf[REQ_COMM_INDEX] |= TAG_FLAG;
+        self->msgBuf[REQ_HDR_LEN] = batch->tag;
+    }
+    self->nextTag++;
+    self->stats.framesSent++;
+
+    if (COMMAND_WRITEV != command)
+    {
+        return sendAll(self, self->msgBuf, used);
+    }
+
+    // Rebuild the runs to send their data behind the descriptors, small ones
+    // are collected in msgBuf like in sendRequest().
+    ProxyNVM_SegCursor runCur = batch->start;
+    ProxyNVM_Batch rebuilt = { .runs = 0, .bytes = 0 };
+
+    while (nextBatchRun(self, segs, count, &runCur, &rebuilt, &addr, &buf, &len))
+    {
+        if ((len < ZERO_COPY_MIN_LEN) && (used + len <= self->msgBufSize))
+        {
+            memcpy(&self->msgBuf[used], buf, len);
+            used += len;
+            continue;
+        }
+
+        if (!sendAll(self, self->msgBuf, used))
+        {
+            return false;
+        }
+        used = 0;
+
+        if (len < ZERO_COPY_MIN_LEN)
+        {
+            memcpy(self->msgBuf, buf, len);
+            used = len;
+        }
+        else if (!sendAll(self, buf, len))
+        {
+            return false;
+        }
+    }
+
+    return (0 == used) || sendAll(self, self->msgBuf, used);
+}
+
+static bool
+recvBatch(
+    ProxyNVM*             self,
+    uint8_t               command,
+    bool                  isTagged,
+    ProxyNVM_Segment*     segs,
+    size_t                count,
+    ProxyNVM_Batch const* batch,
+    const char*           func)
+{
+    Response resp;
+
+    if (!recvResponse(self, isTagged, &resp))
+    {
+        return false;
+    }
+
+    if ((resp.command != command)
+        || (isTagged && (resp.tag != batch->tag))
+        || (resp.bytes > batch->bytes))
+    {
+        Debug_LOG_ERROR("%s: Unexpected response: command = %u, tag = %u, "
+                        "bytes = %zu", func, resp.command, resp.tag,
+                        resp.bytes);
+        breakStream(self);
+        return false;
+    }
+
+    if (resp.retval != RET_OK)
+    {
+        // nothing follows, all segments of the frame failed
+        handleError(self, resp.retval, func);
+        return true;
+    }
+
+    // the results stay in msgBuf, the data goes straight to the segments
+    if (!recvAll(self, self->msgBuf, batch->runs * SEG_RESULT_SIZE))
+    {
+        return false;
+    }
+
+    ProxyNVM_SegCursor cur = batch->start;
+    ProxyNVM_Batch rebuilt = { .runs = 0, .bytes = 0 };
+    size_t total = 0;
+    size_t addr;
+    char* buf;
+    size_t len;
+
+    for (size_t i = 0; i < batch->runs; i++)
+    {
+        total += getField(self, &self->msgBuf[(i * SEG_RESULT_SIZE) + 1]);
+    }
+
+    if (total != resp.bytes)
+    {
+        Debug_LOG_ERROR("%s: Results don't add up to %zu bytes", func,
+                        resp.bytes);
+        breakStream(self);
+        return false;
+    }
+
+    for (size_t i = 0; i < batch->runs; i++)
+    {
+        ProxyNVM_SegCursor const start = cur;
+        int8_t const retval = self->msgBuf[i * SEG_RESULT_SIZE];
+        size_t const bytes = getField(self,
+                                      &self->msgBuf[(i * SEG_RESULT_SIZE) + 1]);
+
+        nextBatchRun(self, segs, count, &cur, &rebuilt, &addr, &buf, &len);
+
+        if (bytes > len)
+        {
+            Debug_LOG_ERROR("%s: Segment at addr = %zu reports %zu bytes, but "
+                            "has only %zu", func, addr, bytes, len);
+            breakStream(self);
+            return false;
+        }
+
+        if ((COMMAND_READV == command) && !recvPayload(self, buf, bytes))
+        {
+            return false;
+        }
+
+        if (retval != RET_OK)
+        {
+            Debug_LOG_ERROR("%s: Segment at addr = %zu failed", func, addr);
+            handleError(self, retval, func);
+        }
+
+        credit(segs, count, start, len, bytes);
+    }
+
+    return true;
+}
+
+// Sends read requests for the data following a sequential read, without
+// waiting for the responses. They are collected by the next access. Nothing is
+// read ahead while the size is not known, asking for it would stall the caller
+// for a round trip.
+static void readAheadIssue(ProxyNVM* self, size_t addr)
+{
+    ProxyNVM_ReadAhead* ra = &self->readAhead;
+
+    if (!self->isSizeCached || !hasFeature(self, ProxyNVM_FEATURE_TAGGED)
+        || (addr >= self->size))
+    {
+        return;
+    }
+
+    size_t const chunkLen = MAX_RESP_PAYLOAD_LEN;
+    size_t length = self->window * chunkLen;
+
+    if (length > ra->bufSize)
+    {
+        length = ra->bufSize;
+    }
+    if (length > self->size - addr)
+    {
+        length = self->size - addr;
+    }
+
+    ra->addr = addr;
+    ra->length = 0;
+    ra->offset = 0;
+    ra->chunks = 0;
+    ra->chunkLen = chunkLen;
+    ra->firstTag = self->nextTag;
+
+    for (size_t offset = 0; offset < length; offset += chunkLen)
+    {
+        size_t const len = ((length - offset) < chunkLen)
+                           ? (length - offset)
+                           : chunkLen;
+
+        if (!sendRequest(self, COMMAND_READ, true, self->nextTag, addr + offset,
+                         len, NULL))
+        {
+            // The stream is out of sync now, the responses to the requests
+            // sent are dropped when the next access resynchronizes it.
+            Debug_LOG_ERROR("%s: Sending read-ahead request failed", __func__);
+            ra->chunks = 0;
+            ra->length = 0;
+            return;
+        }
+
+        self->nextTag++;
+        ra->chunks++;
+        ra->length += len;
+    }
+}
+
+// Receives the responses to the outstanding read-ahead requests. A failed
+// chunk truncates the read-ahead data to the chunks before it.
+static bool readAheadCollect(ProxyNVM* self)
+{
+    ProxyNVM_ReadAhead* ra = &self->readAhead;
+    size_t valid = ra->length;
+
+    for (size_t i = 0; i < ra->chunks; i++)
+    {
+        size_t const offset = i * ra->chunkLen;
+        size_t const len = ((ra->length - offset) < ra->chunkLen)
+                           ? (ra->length - offset)
+                           : ra->chunkLen;
+        Response resp;
+
+        if (!recvResponse(self, true, &resp)
+            || (resp.command != COMMAND_READ)
+            || (resp.tag != (uint8_t)(ra->firstTag + i))
+            || (resp.bytes > len))
+        {
+            Debug_LOG_ERROR("%s: Read-ahead response %zu broken", __func__, i);
+            breakStream(self);
+            ra->chunks = 0;
+            ra->length = 0;
+            return false;
+        }
+
+        if (resp.retval != RET_OK)
+        {
+            handleError(self, resp.retval, __func__);
+        }
+
+        bool const isOk = (resp.retval == RET_OK) && (resp.bytes == len)
+                          && (offset < valid);
+
+        if (!recvReadPayload(self, &resp, isOk ? &ra->buf[offset] : NULL))
+        {
+            ra->chunks = 0;
+            ra->length = 0;
+            return false;
+        }
+
+        if (!isOk && (offset < valid))
+        {
+            valid = offset;
+        }
+    }
+
+    ra->chunks = 0;
+    ra->length = valid;
+
+    return true;
+}
+
+// Abandons the read-ahead, the outstanding responses must still be received
+// to keep the stream in sync. This makes the stream ready for the next
+// request, so a stream that broke is resynchronized here.
+static bool readAheadDrop(ProxyNVM* self)
+{
+    bool const ret = self->isOutOfSync ? resync(self)
+                                       : readAheadCollect(self);
+
+    self->readAhead.length = 0;
+    self->readAhead.nextAddr = (size_t) -1;
+
+    return ret;
+}
+
+// Serves the beginning of a read from the read-ahead data, if the read
+// continues where the read-ahead starts. Otherwise the read-ahead is dropped.
+static bool
+readAheadServe(
+    ProxyNVM* self,
+    size_t    addr,
+    char*     buffer,
+    size_t    length,
+    size_t*   served)
+{
+    ProxyNVM_ReadAhead* ra = &self->readAhead;
+
+    *served = 0;
+
+    if (0 == ra->length)
+    {
+        return true;
+    }
+
+    if (addr != ra->addr)
+    {
+        return readAheadDrop(self);
+    }
+
+    if (!readAheadCollect(self))
+    {
+        return false;
+    }
+
+    size_t const len = (length < ra->length) ? length : ra->length;
+
+    memcpy(buffer, &ra->buf[ra->offset], len);
+    ra->addr += len;
+    ra->offset += len;
+    ra->length -= len;
+    *served = len;
+
+    return true;
+}
+
+// Maps a hash to the one kept in the table, where 0 means not known.
+static uint64_t knownHash(uint64_t hash)
+{
+    return (0 == hash) ? 1 : hash;
+}
+
+// Hash of an erased block as kept in the table.
+static uint64_t erasedHashOf(size_t blockSize)
+{
+    uint8_t const erased = 0xFF;
+    uint64_t hash = ProxyNVM_HASH_INIT;
+
+    for (size_t i = 0; i < blockSize; i++)
+    {
+        hash = ProxyNVM_hash(hash, &erased, 1);
+    }
+
+    return knownHash(hash);
+}
+
+// Writes the blocks of a range whose hash differs from the one of the block on
+// the proxy, the others are skipped. Returns the number of bytes written from
+// the start of the range like transfer().
+static size_t
+writeChanged(
+    ProxyNVM*   self,
+    size_t      addr,
+    char const* buffer,
+    size_t      length,
+    const char* func)
+{
+    ProxyNVM_Hashes* const h = &self->hashes;
+    size_t const bs = h->blockSize;
+    // the blocks covered by the write and the table
+    size_t const first = (addr + bs - 1) / bs;
+    size_t end = (addr + length) / bs;
+
+    if (end > h->blocks)
+    {
+        end = h->blocks;
+    }
+
+    if (first >= end)
+    {
+        hashesForget(self, addr, length);
+        return transfer(self, COMMAND_WRITE, addr, (char*) buffer, length,
+                        func);
+    }
+
+    // blocks written partially change in a way we don't know
+    hashesForget(self, addr, (first * bs) - addr);
+    hashesForget(self, end * bs, addr + length - (end * bs));
+    hashesFetch(self, first, end);
+
+    size_t pending = 0;     // start of the data not written or skipped yet
+    size_t written = 0;
+
+    for (size_t b = first; b < end; b++)
+    {
+        size_t const offset = (b * bs) - addr;
+        uint64_t const hash = knownHash(ProxyNVM_hash(ProxyNVM_HASH_INIT,
+                                                      &buffer[offset], bs));
+
+        if (hash != h->table[b])
+        {
+            // written with the next run, which forgets it again if it fails
+            h->table[b] = hash;
+            continue;
+        }
+
+        if (!writeRun(self, addr, buffer, pending, offset, length, &written,
+                      func))
+        {
+            return written;
+        }
+
+        self->stats.bytesUnchanged += bs;
+        pending = offset + bs;
+    }
+
+    if (!writeRun(self, addr, buffer, pending, length, length, &written, func))
+    {
+        return written;
+    }
+
+    return length;
+}
+
+// Writes buffer[from, to) of a write of 'length' bytes to 'addr'. If this
+// fails, 'written' is set to the bytes written from the start of the write and
+// the hashes of the blocks from there on are forgotten.
+static bool
+writeRun(
+    ProxyNVM*   self,
+    size_t      addr,
+    char const* buffer,
+    size_t      from,
+    size_t      to,
+    size_t      length,
+    size_t*     written,
+    const char* func)
+{
+    if (from == to)
+    {
+        return true;
+    }
+
+    size_t const done = transfer(self, COMMAND_WRITE, addr + from,
+                                 (char*) &buffer[from], to - from, func);
+
+    if (done == to - from)
+    {
+        return true;
+    }
+
+    *written = from + done;
+    hashesForget(self, addr + *written, length - *written);
+
+    return false;
+}
+
+// Requests the hashes of the blocks in [first, end) that are not known yet.
+// The blocks whose hash can't be fetched stay unknown and are just written.
+static void hashesFetch(ProxyNVM* self, size_t first, size_t end)
+{
+    ProxyNVM_Hashes* const h = &self->hashes;
+
+    if (!hasFeature(self, ProxyNVM_FEATURE_HASHES))
+    {
+        return;
+    }
+
+    size_t const maxBlocks = maxHashes(self);
+
+    while (first < end)
+    {
+        while ((first < end) && (0 != h->table[first]))
+        {
+            first++;
+        }
+
+        if (first == end)
+        {
+            return;
+        }
+
+        size_t count = ((end - first) < maxBlocks) ? (end - first) : maxBlocks;
+
+        // no need to ask for the known ones at the end
+        while (0 != h->table[first + count - 1])
+        {
+            count--;
+        }
+
+        if (!hashesRequest(self, first, count))
+        {
+            return;
+        }
+
+        first += count;
+    }
+}
+
+static bool hashesRequest(ProxyNVM* self, size_t first, size_t count)
+{
+    ProxyNVM_Hashes* const h = &self->hashes;
+
+    if (!requestHashes(self, first * h->blockSize, count, h->blockSize))
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        h->table[first + i] = knownHash(receivedHash(self, i));
+    }
+
+    return true;
+}
+
+// Number of hashes that fit into a response, they are received into msgBuf.
+static size_t maxHashes(ProxyNVM* self)
+{
+    size_t const room = (MAX_RESP_PAYLOAD_LEN < self->msgBufSize)
+                        ? MAX_RESP_PAYLOAD_LEN
+                        : self->msgBufSize;
+
+    return room / HASH_LEN;
+}
+
+// Gets the hashes of 'count' blocks from 'addr' on into msgBuf, where
+// receivedHash() takes them from.
+static bool
+requestHashes(
+    ProxyNVM* self,
+    size_t    addr,
+    size_t    count,
+    size_t    blockSize)
+{
+    size_t const length = count * blockSize;
+
+    constructMsg(self, COMMAND_GET_HASHES, addr, length);
+    BitConverter_putUint32BE((uint32_t) blockSize,
+                             &self->msgBuf[REQ_HDR_LEN]);
+
+    if (!exchange(self, REQ_HDR_LEN + BLOCK_SIZE_LEN))
+    {
+        Debug_LOG_ERROR("%s: Request failed", __func__);
+        return false;
+    }
+
+    if (self->msgBuf[RESP_RETVAL_INDEX] != RET_OK)
+    {
+        handleError(self, self->msgBuf[RESP_RETVAL_INDEX], __func__);
+        return false;
+    }
+
+    size_t const bytes = getField(self, &self->msgBuf[RESP_BYTES_INDEX]);
+
+    // the hashes that follow can't be told apart from the next response
+    if ((bytes != length) || !recvAll(self, self->msgBuf, count * HASH_LEN))
+    {
+        Debug_LOG_ERROR("%s: Unexpected response for %zu bytes", __func__,
+                        bytes);
+        breakStream(self);
+        return false;
+    }
+
+    return true;
+}
+
+static uint64_t receivedHash(ProxyNVM* self, size_t i)
+{
+    char const* const p = &self->msgBuf[i * HASH_LEN];
+
+    return ((uint64_t) BitConverter_getUint32BE(p) << 32)
+           | BitConverter_getUint32BE(&p[HASH_LEN / 2]);
+}
+
+// Forgets the hashes of all blocks that overlap the range.
+static void hashesForget(ProxyNVM* self, size_t addr, size_t length)
+{
+    ProxyNVM_Hashes* const h = &self->hashes;
+
+    if ((NULL == h->table) || (0 == length))
+    {
+        return;
+    }
+
+    size_t b = addr / h->blockSize;
+    size_t const end = ((addr + length - 1) / h->blockSize) + 1;
+
+    for (; (b < end) && (b < h->blocks); b++)
+    {
+        h->table[b] = 0;
+    }
+}
+
+// Updates the hashes after an erase of a range, of which the first 'erased'
+// bytes succeeded.
+static void
+hashesErased(
+    ProxyNVM* self,
+    size_t    addr,
+    size_t    length,
+    size_t    erased)
+{
+    ProxyNVM_Hashes* const h = &self->hashes;
+
+    if (NULL == h->table)
+    {
+        return;
+    }
+
+    hashesForget(self, addr, length);
+
+    size_t b = (addr + h->blockSize - 1) / h->blockSize;
+    size_t const end = (addr + erased) / h->blockSize;
+
+    for (; (b < end) && (b < h->blocks); b++)
+    {
+        h->table[b] = h->erasedHash;
+    }
+}
+
+// Derives the block size of the map from the capacity on first use.
+static bool erasedSetUp(ProxyNVM* self)
+{
+    ProxyNVM_ErasedMap* const map = &self->erased;
+
+    if ((NULL == map->bits) || !self->isSizeCached)
+    {
+        return false;
+    }
+
+    if (0 == map->blockSize)
+    {
+        size_t bs = ERASED_MIN_BLOCK_SIZE;
+
+        while ((self->size + bs - 1) / bs > map->blocks)
+        {
+            bs *= 2;
+        }
+        map->blockSize = bs;
+    }
+
+    return true;
+}
+
+// True if all blocks that overlap the range are known to be erased.
+static bool erasedIsBlank(ProxyNVM* self, size_t addr, size_t length)
+{
+    ProxyNVM_ErasedMap* const map = &self->erased;
+
+    if ((0 == length) || !erasedSetUp(self))
+    {
+        return false;
+    }
+
+    size_t const end = ((addr + length - 1) / map->blockSize) + 1;
+
+    for (size_t b = addr / map->blockSize; b < end; b++)
+    {
+        if (0 == (map->bits[b / 32] & (1u << (b % 32))))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Clears the blocks that overlap the range.
+static void erasedForget(ProxyNVM* self, size_t addr, size_t length)
+{
+    ProxyNVM_ErasedMap* const map = &self->erased;
+
+    if ((0 == length) || !erasedSetUp(self))
+    {
+        return;
+    }
+
+    size_t const end = ((addr + length - 1) / map->blockSize) + 1;
+
+    for (size_t b = addr / map->blockSize; b < end; b++)
+    {
+        map->bits[b / 32] &= ~(1u << (b % 32));
+    }
+}
+
+// Marks the blocks that are fully inside the range.
+static void erasedMark(ProxyNVM* self, size_t addr, size_t length)
+{
+    ProxyNVM_ErasedMap* const map = &self->erased;
+
+    if (!erasedSetUp(self))
+    {
+        return;
+    }
+
+    size_t const end = (addr + length) / map->blockSize;
+
+    for (size_t b = (addr + map->blockSize - 1) / map->blockSize; b < end; b++)
+    {
+        map->bits[b / 32] |= 1u << (b % 32);
+    }
+}
+
+// Writes the request header into msgBuf. The public functions check with
+// fitsFields() that the addresses of a request fit into the fields. Each
+// request starts with this, sendAll() tells a partly sent one by it.
+static void constructMsg(ProxyNVM* self, uint8_t command, size_t addr,
+                         size_t length)
+{
+    self->requestStart = self->streamSent;
+    self->writeHeader(self->msgBuf, command, addr, length);
+}
+
+// Stores the 'size' low bytes of 'value' big endian. 'size' is a constant
+// wherever this is used, so it becomes a fixed sequence of stores.
+static inline void putBE(char* p, uint64_t value, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        p[i] = (char) (value >> (8 * (size - 1 - i)));
+    }
+}
+
+// Reads 'size' bytes big endian, the counterpart of putBE().
+static inline uint64_t getBE(char const* p, size_t size)
+{
+    uint64_t value = 0;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        value = (value << 8) | (uint8_t) p[i];
+    }
+
+    return value;
+}
+
+static void writeHeader32(char* message, uint8_t command, size_t addr,
+                          size_t length)
+{
+    message[REQ_COMM_INDEX] = command;
+    putBE(&message[REQ_ADDR_INDEX], addr, ADDRESS_SIZE);
+    putBE(&message[REQ_LEN_INDEX_OF(ADDRESS_SIZE)], length, ADDRESS_SIZE);
+}
+
+static void writeHeader64(char* message, uint8_t command, size_t addr,
+                          size_t length)
+{
+    message[REQ_COMM_INDEX] = command;
+    putBE(&message[REQ_ADDR_INDEX], addr, WIDE_FIELD_SIZE);
+    putBE(&message[REQ_LEN_INDEX_OF(WIDE_FIELD_SIZE)], length,
+          WIDE_FIELD_SIZE);
+}
+
+// True if no address of the range and its length need more than the fields of
+// the protocol, so nothing gets truncated in the frames of a request.
+static bool fitsFields(ProxyNVM* self, size_t addr, size_t length)
+{
+    return (WIDE_FIELD_SIZE == self->fieldSize)
+           || (((uint64_t) length <= UINT32_MAX)
+               && ((uint64_t) addr + length <= (uint64_t) UINT32_MAX + 1));
+}
+
+// Writes an ADDR, LENGTH or BYTES field of the negotiated size, big endian.
+static void putField(ProxyNVM* self, char* field, size_t value)
+{
+    if (WIDE_FIELD_SIZE == self->fieldSize)
+    {
+        BitConverter_putUint32BE((uint32_t) ((uint64_t) value >> 32), field);
+        field += ADDRESS_SIZE;
+    }
+
+    BitConverter_putUint32BE((uint32_t) value, field);
+}
+
+static size_t getField(ProxyNVM* self, char const* field)
+{
+    if (WIDE_FIELD_SIZE == self->fieldSize)
+    {
+        return (size_t) (((uint64_t) BitConverter_getUint32BE(field) << 32)
+                         | BitConverter_getUint32BE(&field[ADDRESS_SIZE]));
+    }
+
+    return BitConverter_getUint32BE(field);
+}
+
+static void handleError(ProxyNVM* self, int8_t err, const char* func)
+{
+    logError(err, func);
+
+    self->stats.errors[((err < 0) && (err > -ProxyNVM_STATS_ERROR_CODES))
+                       ? -err : 0]++;
+
+    // The proxy checks the bounds against the actual size of its storage, so
+    // if it disagrees with our check the cached size is stale.
+    if ((RET_LEN_OUT_OF_BOUNDS == err) || (RET_ADDR_OUT_OF_BOUNDS == err))
+    {
+        self->isSizeCached = false;
     }
 }
 
@@ -0,0 +1,302 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "ProxyNVM_Codec.h"
+#include <string.h>
+
+/*---------------FORMAT----------------------*/
+/*
+The compressed data is a series of sequences as in the LZ4 block format:
+
+    [TOKEN][LITERAL_LEN_EXT...][LITERALS...][OFFSET_0|OFFSET_1][MATCH_LEN_EXT...]
+
+The high nibble of TOKEN is the number of literals, the low nibble the length
+of the match minus 4. A nibble of 15 is continued by extension bytes, which are
+added up until one is less than 255. The literals are copied to the output,
+then the match copies 'length' bytes starting 'offset' bytes back in the
+output. The match may overlap the bytes it produces, this is how runs of equal
+bytes are encoded. The last sequence consists of literals only.
+
+Like LZ4, the encoder leaves the last 5 bytes as literals and starts no match
+within the last 12 bytes, so any LZ4 block decoder can read the output.
+*/
+/*---------------FORMAT----------------------*/
+
+/* Defines -------------------------------------------------------------------*/
+#define MIN_MATCH       4
+#define LAST_LITERALS   5
+#define MF_LIMIT        12
+#define MAX_OFFSET      65535
+#define RUN_MASK        15
+
+/* Private functions prototypes ----------------------------------------------*/
+static uint32_t read32(uint8_t const* p);
+static uint32_t hashOf(uint32_t sequence);
+static bool putSequence(uint8_t* dst, size_t dstSize, size_t* op,
+                        uint8_t const* literals, size_t literalLen,
+                        size_t offset, size_t matchLen);
+static bool putLength(uint8_t* dst, size_t dstSize, size_t* op, size_t length);
+static bool getLength(uint8_t const* src, size_t srcLen, size_t* ip,
+                      size_t* length);
+
+/* Public functions ----------------------------------------------------------*/
+
+size_t
+ProxyNVM_compress(
+    ProxyNVM_CodecWorkspace* workspace,
+    void const*              source,
+    size_t                   srcLen,
+    void*                    destination,
+    size_t                   dstSize)
+{
+    uint8_t const* const src = source;
+    uint8_t* const dst = destination;
+    size_t ip = 0;          // position in src
+    size_t anchor = 0;      // first literal not written yet
+    size_t op = 0;          // position in dst
+
+    if (srcLen > MF_LIMIT)
+    {
+        size_t const matchStartLimit = srcLen - MF_LIMIT;
+        size_t const matchEndLimit = srcLen - LAST_LITERALS;
+
+        while (ip < matchStartLimit)
+        {
+            uint32_t const sequence = read32(&src[ip]);
+            uint32_t* const entry = &workspace->table[hashOf(sequence)];
+            size_t const candidate = *entry;
+
+            *entry = (uint32_t) ip;
+
+            if ((candidate >= ip) || (ip - candidate > MAX_OFFSET)
+                || (read32(&src[candidate]) != sequence))
+            {
+                ip++;
+                continue;
+            }
+
+            size_t matchLen = MIN_MATCH;
+
+            while ((ip + matchLen < matchEndLimit)
+                   && (src[candidate + matchLen] == src[ip + matchLen]))
+            {
+                matchLen++;
+            }
+
+            if (!putSequence(dst, dstSize, &op, &src[anchor], ip - anchor,
+                             ip - candidate, matchLen))
+            {
+                return 0;
+            }
+
+            ip += matchLen;
+            anchor = ip;
+        }
+    }
+
+    if (!putSequence(dst, dstSize, &op, &src[anchor], srcLen - anchor, 0, 0))
+    {
+        return 0;
+    }
+
+    return op;
+}
+
+bool
+ProxyNVM_decompress(
+    void const* source,
+    size_t      srcLen,
+    void*       destination,
+    size_t      dstLen)
+{
+    uint8_t const* const src = source;
+    uint8_t* const dst = destination;
+    size_t ip = 0;
+    size_t op = 0;
+
+    while (ip < srcLen)
+    {
+        uint8_t const token = src[ip++];
+        size_t literalLen = token >> 4;
+
+        if ((RUN_MASK == literalLen)
+            && !getLength(src, srcLen, &ip, &literalLen))
+        {
+            return false;
+        }
+
+        if ((literalLen > srcLen - ip) || (literalLen > dstLen - op))
+        {
+            return false;
+        }
+
+        memcpy(&dst[op], &src[ip], literalLen);
+        ip += literalLen;
+        op += literalLen;
+
+        // the last sequence has no match
+        if (ip == srcLen)
+        {
+            break;
+        }
+
+        if (srcLen - ip < 2)
+        {
+            return false;
+        }
+
+        size_t const offset = src[ip] | ((size_t) src[ip + 1] << 8);
+        size_t matchLen = token & RUN_MASK;
+
+        ip += 2;
+
+        if ((RUN_MASK == matchLen) && !getLength(src, srcLen, &ip, &matchLen))
+        {
+            return false;
+        }
+
+        matchLen += MIN_MATCH;
+
+        if ((0 == offset) || (offset > op) || (matchLen > dstLen - op))
+        {
+            return false;
+        }
+
+        if (offset >= matchLen)
+        {
+            memcpy(&dst[op], &dst[op - offset], matchLen);
+            op += matchLen;
+        }
+        else
+        {
+            // the match repeats the bytes it produces
+            for (size_t i = 0; i < matchLen; i++, op++)
+            {
+                dst[op] = dst[op - offset];
+            }
+        }
+    }
+
+    return (op == dstLen);
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+static uint32_t read32(uint8_t const* p)
+{
+    uint32_t value;
+
+    memcpy(&value, p, sizeof(value));
+
+    return value;
+}
+
+// multiplicative hash, the top bits are the best mixed ones
+static uint32_t hashOf(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - ProxyNVM_CODEC_HASH_LOG);
+}
+
+// Writes a sequence, a matchLen of 0 writes the final literals-only one.
+static bool
+putSequence(
+    uint8_t*       dst,
+    size_t         dstSize,
+    size_t*        op,
+    uint8_t const* literals,
+    size_t         literalLen,
+    size_t         offset,
+    size_t         matchLen)
+{
+    size_t const matchCode = (matchLen > 0) ? (matchLen - MIN_MATCH) : 0;
+
+    if (*op >= dstSize)
+    {
+        return false;
+    }
+
+    dst[(*op)++] = (uint8_t)
+                   ((((literalLen < RUN_MASK) ? literalLen : RUN_MASK) << 4)
+                    | ((matchCode < RUN_MASK) ? matchCode : RUN_MASK));
+
+    if ((literalLen >= RUN_MASK)
+        && !putLength(dst, dstSize, op, literalLen - RUN_MASK))
+    {
+        return false;
+    }
+
+    if (literalLen > dstSize - *op)
+    {
+        return false;
+    }
+
+    memcpy(&dst[*op], literals, literalLen);
+    *op += literalLen;
+
+    if (0 == matchLen)
+    {
+        return true;
+    }
+
+    if (dstSize - *op < 2)
+    {
+        return false;
+    }
+
+    dst[(*op)++] = (uint8_t) offset;
+    dst[(*op)++] = (uint8_t) (offset >> 8);
+
+    return (matchCode < RUN_MASK)
+           || putLength(dst, dstSize, op, matchCode - RUN_MASK);
+}
+
+// Writes the extension bytes of a length nibble of 15.
+static bool putLength(uint8_t* dst, size_t dstSize, size_t* op, size_t length)
+{
+    for (; length >= 255; length -= 255)
+    {
+        if (*op >= dstSize)
+        {
+            return false;
+        }
+        dst[(*op)++] = 255;
+    }
+
+    if (*op >= dstSize)
+    {
+        return false;
+    }
+    dst[(*op)++] = (uint8_t) length;
+
+    return true;
+}
+
+// Adds the extension bytes of a length nibble of 15 to 'length'.
+static bool
+getLength(
+    uint8_t const* src,
+    size_t         srcLen,
+    size_t*        ip,
+    size_t*        length)
+{
+    uint8_t byte;
+
+    do
+    {
+        if (*ip >= srcLen)
+        {
+            return false;
+        }
+        byte = src[(*ip)++];
+        *length += byte;
+    }
+    while (255 == byte);
+
+    return true;
+}
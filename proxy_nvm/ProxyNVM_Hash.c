@@ -0,0 +1,31 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "ProxyNVM_Hash.h"
+
+/* Defines -------------------------------------------------------------------*/
+#define FNV_PRIME       0x100000001b3ull
+
+/* Public functions ----------------------------------------------------------*/
+
+uint64_t
+ProxyNVM_hash(
+    uint64_t    hash,
+    void const* data,
+    size_t      length)
+{
+    uint8_t const* const p = data;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        hash = (hash ^ p[i]) * FNV_PRIME;
+    }
+
+    return hash;
+}
@@ -0,0 +1,474 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "ProxyNVM_Striped.h"
+
+/* Private functions prototypes ----------------------------------------------*/
+static size_t stripe(ProxyNVM_Striped* self, uint8_t command, size_t addr,
+                     char* buffer, size_t length);
+static size_t spread(ProxyNVM_Striped* self, uint8_t command, size_t addr,
+                     size_t src, size_t length);
+static size_t stripeVectored(ProxyNVM_Striped* self, uint8_t command,
+                             ProxyNVM_Segment* segs, size_t count);
+static bool isOverlapping(ProxyNVM_Segment const* segs, size_t count);
+static bool isInside(ProxyNVM_Striped* self, size_t addr, size_t length);
+
+/* Private variables ---------------------------------------------------------*/
+
+static const Nvm_Vtable ProxyNvmStriped_vtable =
+{
+    .read       = ProxyNVM_Striped_read,
+    .erase      = ProxyNVM_Striped_erase,
+    .getSize    = ProxyNVM_Striped_getSize,
+    .write      = ProxyNVM_Striped_write,
+    .dtor       = ProxyNVM_Striped_dtor
+};
+
+/* Public functions ----------------------------------------------------------*/
+
+bool ProxyNVM_Striped_ctor(ProxyNVM_Striped* self, ProxyNVM** members,
+                           ProxyNVM_Striped_Part* parts, size_t count)
+{
+    Debug_ASSERT_SELF(self);
+    Debug_ASSERT(members != NULL);
+    Debug_ASSERT(parts != NULL);
+
+    if (0 == count)
+    {
+        Debug_LOG_ERROR("%s: No channels to stripe across", __func__);
+        return false;
+    }
+
+    // the parts are split by the geometry of the first member
+    size_t const size = ProxyNVM_getSize(ProxyNVM_TO_NVM(members[0]));
+    size_t const readLen = ProxyNVM_getChunkSize(members[0], COMMAND_READ);
+    size_t const writeLen = ProxyNVM_getChunkSize(members[0], COMMAND_WRITE);
+    uint32_t const features = ProxyNVM_getFeatures(members[0]);
+
+    if (0 == size)
+    {
+        Debug_LOG_ERROR("%s: Capacity of channel 0 unknown", __func__);
+        return false;
+    }
+
+    for (size_t i = 1; i < count; i++)
+    {
+        if ((ProxyNVM_getSize(ProxyNVM_TO_NVM(members[i])) != size)
+            || (ProxyNVM_getChunkSize(members[i], COMMAND_READ) != readLen)
+            || (ProxyNVM_getChunkSize(members[i], COMMAND_WRITE) != writeLen)
+            || (ProxyNVM_getFeatures(members[i]) != features))
+        {
+            Debug_LOG_ERROR("%s: Channel %zu differs from channel 0 in "
+                            "capacity, chunk size or features", __func__, i);
+            return false;
+        }
+    }
+
+    Nvm* nvm = ProxyNVM_Striped_TO_NVM(self);
+
+    nvm->vtable = &ProxyNvmStriped_vtable;
+    self->members = members;
+    self->parts = parts;
+    self->count = count;
+
+    return true;
+}
+
+size_t ProxyNVM_Striped_write(Nvm* nvm, size_t addr, void const* buffer,
+                              size_t length)
+{
+    ProxyNVM_Striped* self = (ProxyNVM_Striped*) nvm;
+    Debug_ASSERT_SELF(self);
+    Debug_ASSERT(buffer != NULL);
+
+    // the transfer only reads from the buffer of a write
+    return stripe(self, COMMAND_WRITE, addr, (char*) buffer, length);
+}
+
+size_t ProxyNVM_Striped_read(Nvm* nvm, size_t addr, void* buffer,
+                             size_t length)
+{
+    ProxyNVM_Striped* self = (ProxyNVM_Striped*) nvm;
+    Debug_ASSERT_SELF(self);
+    Debug_ASSERT(buffer != NULL);
+
+    return stripe(self, COMMAND_READ, addr, buffer, length);
+}
+
+size_t ProxyNVM_Striped_erase(Nvm* nvm, size_t addr, size_t length)
+{
+    ProxyNVM_Striped* self = (ProxyNVM_Striped*) nvm;
+    Debug_ASSERT_SELF(self);
+
+    if (0 == (ProxyNVM_getFeatures(self->members[0]) & ProxyNVM_FEATURE_ERASE))
+    {
+        return stripe(self, COMMAND_WRITE, addr, NULL, length);
+    }
+
+    return spread(self, COMMAND_ERASE, addr, 0, length);
+}
+
+size_t ProxyNVM_Striped_getSize(Nvm* nvm)
+{
+    ProxyNVM_Striped* self = (ProxyNVM_Striped*) nvm;
+    Debug_ASSERT_SELF(self);
+
+    return ProxyNVM_getSize(ProxyNVM_TO_NVM(self->members[0]));
+}
+
+size_t ProxyNVM_Striped_readv(ProxyNVM_Striped* self,
+                              ProxyNVM_Segment* segments, size_t count)
+{
+    Debug_ASSERT_SELF(self);
+
+    return stripeVectored(self, COMMAND_READV, segments, count);
+}
+
+size_t ProxyNVM_Striped_writev(ProxyNVM_Striped* self,
+                               ProxyNVM_Segment* segments, size_t count)
+{
+    Debug_ASSERT_SELF(self);
+
+    if (isOverlapping(segments, count))
+    {
+        return ProxyNVM_writev(self->members[0], segments, count);
+    }
+
+    return stripeVectored(self, COMMAND_WRITEV, segments, count);
+}
+
+size_t ProxyNVM_Striped_copy(ProxyNVM_Striped* self, size_t dst, size_t src,
+                             size_t length)
+{
+    Debug_ASSERT_SELF(self);
+
+    size_t const distance = (dst > src) ? (dst - src) : (src - dst);
+
+    // ProxyNVM_copy() also reports what a proxy without COMMAND_COPY does
+    if ((distance < length)
+        || (0 == (ProxyNVM_getFeatures(self->members[0])
+                  & ProxyNVM_FEATURE_COPY)))
+    {
+        return ProxyNVM_copy(self->members[0], dst, src, length);
+    }
+
+    return spread(self, COMMAND_COPY, dst, src, length);
+}
+
+size_t ProxyNVM_Striped_discard(ProxyNVM_Striped* self, size_t addr,
+                                size_t length)
+{
+    Debug_ASSERT_SELF(self);
+
+    // ProxyNVM_discard() also handles a proxy without COMMAND_DISCARD
+    if (0 == (ProxyNVM_getFeatures(self->members[0])
+              & ProxyNVM_FEATURE_DISCARD))
+    {
+        return ProxyNVM_discard(self->members[0], addr, length);
+    }
+
+    return spread(self, COMMAND_DISCARD, addr, 0, length);
+}
+
+void ProxyNVM_Striped_dtor(Nvm* nvm)
+{
+    DECL_UNUSED_VAR(ProxyNVM_Striped * self) = (ProxyNVM_Striped*) nvm;
+    Debug_ASSERT_SELF(self);
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+// Splits the range into one part of whole chunks per channel and runs the
+// transfers of all parts side by side. Each round fills the pipeline window
+// of every channel and then takes one response from each, so the proxy works
+// on all channels while the driver waits for one. A NULL buffer writes 0xFF.
+// Returns the number of bytes transferred successfully from the start of the
+// range.
+static size_t
+stripe(
+    ProxyNVM_Striped* self,
+    uint8_t           command,
+    size_t            addr,
+    char*             buffer,
+    size_t            length)
+{
+    size_t const chunkLen = ProxyNVM_getChunkSize(self->members[0], command);
+    size_t const chunks = (length + chunkLen - 1) / chunkLen;
+    size_t const parts = (chunks < self->count) ? chunks : self->count;
+
+    if (parts <= 1)
+    {
+        Nvm* const nvm = ProxyNVM_TO_NVM(self->members[0]);
+
+        return (COMMAND_READ == command) ? ProxyNVM_read(nvm, addr, buffer,
+                                                         length)
+               : (NULL != buffer) ? ProxyNVM_write(nvm, addr, buffer, length)
+                                  : ProxyNVM_erase(nvm, addr, length);
+    }
+
+    for (size_t i = 0; i < parts; i++)
+    {
+        size_t const begin = (i * chunks / parts) * chunkLen;
+        size_t const end = ((i + 1) * chunks / parts) * chunkLen;
+        size_t const len = ((end < length) ? end : length) - begin;
+
+        if (!ProxyNVM_startTransfer(self->members[i],
+                                    &self->parts[i].transfer, command,
+                                    addr + begin,
+                                    (NULL != buffer) ? &buffer[begin] : NULL,
+                                    len))
+        {
+            Debug_LOG_ERROR("%s: Starting part %zu failed", __func__, i);
+            return 0;
+        }
+    }
+
+    bool isDone;
+
+    do
+    {
+        isDone = true;
+
+        for (size_t i = 0; i < parts; i++)
+        {
+            if (!ProxyNVM_isTransferDone(&self->parts[i].transfer))
+            {
+                ProxyNVM_sendChunks(self->members[i], &self->parts[i].transfer);
+            }
+        }
+
+        for (size_t i = 0; i < parts; i++)
+        {
+            ProxyNVM_Transfer* const xfer = &self->parts[i].transfer;
+
+            if (!ProxyNVM_isTransferDone(xfer))
+            {
+                ProxyNVM_recvChunk(self->members[i], xfer);
+                isDone = isDone && ProxyNVM_isTransferDone(xfer);
+            }
+        }
+    }
+    while (!isDone);
+
+    // only the bytes up to the first gap count
+    size_t transferred = 0;
+
+    for (size_t i = 0; i < parts; i++)
+    {
+        ProxyNVM_Transfer const* const xfer = &self->parts[i].transfer;
+        size_t const done = ProxyNVM_getTransferred(xfer);
+
+        transferred += done;
+        if (done != xfer->length)
+        {
+            break;
+        }
+    }
+
+    return transferred;
+}
+
+// Erases, discards or copies a range with one request per channel at a time.
+// The range is split into pieces of whole chunks, a round sends the next
+// piece on each channel before it collects the responses. Returns the number
+// of bytes done from the start of the range.
+static size_t
+spread(
+    ProxyNVM_Striped* self,
+    uint8_t           command,
+    size_t            addr,
+    size_t            src,
+    size_t            length)
+{
+    if (!isInside(self, addr, length)
+        || ((COMMAND_COPY == command) && !isInside(self, src, length)))
+    {
+        Debug_LOG_ERROR("%s: Area out of bounds: addr = %zu, src = %zu, "
+                        "length = %zu", __func__, addr, src, length);
+        return 0;
+    }
+
+    size_t const chunkLen = ProxyNVM_getChunkSize(self->members[0],
+                                                  COMMAND_WRITE);
+    size_t const chunks = (length + chunkLen - 1) / chunkLen;
+    size_t const share = ((chunks + self->count - 1) / self->count) * chunkLen;
+    size_t const limit = (COMMAND_COPY == command)
+                         ? ProxyNVM_getMaxCopy(self->members[0])
+                         : share;
+    size_t const pieceLen = (share < limit) ? share : limit;
+    size_t done = 0;
+    size_t offset = 0;
+    bool isComplete = true;
+
+    while (isComplete && (offset < length))
+    {
+        size_t n = 0;
+
+        // a piece that is not sent reports 0 bytes when it is finished
+        for (; (n < self->count) && (offset < length); n++)
+        {
+            size_t const len = ((length - offset) < pieceLen)
+                               ? (length - offset)
+                               : pieceLen;
+
+            ProxyNVM_startRequest(self->members[n], &self->parts[n].request,
+                                  command, addr + offset, src + offset, len);
+            offset += len;
+        }
+
+        // all responses must be received to keep the streams in sync
+        for (size_t i = 0; i < n; i++)
+        {
+            ProxyNVM_Request* const req = &self->parts[i].request;
+            size_t const len = req->length;
+            size_t const piece = ProxyNVM_finishRequest(self->members[i], req);
+
+            if (isComplete)
+            {
+                done += piece;
+                isComplete = (piece == len);
+            }
+        }
+    }
+
+    return done;
+}
+
+// Splits the segments into one group per channel, each with about the same
+// number of bytes, and runs the vectored transfers of all groups side by side
+// like stripe(). Without COMMAND_READV and COMMAND_WRITEV, each segment is
+// striped on its own. Returns the number of segments transferred completely.
+static size_t
+stripeVectored(
+    ProxyNVM_Striped* self,
+    uint8_t           command,
+    ProxyNVM_Segment* segs,
+    size_t            count)
+{
+    Debug_ASSERT((segs != NULL) || (0 == count));
+
+    size_t complete = 0;
+
+    if (0 == (ProxyNVM_getFeatures(self->members[0])
+              & ProxyNVM_FEATURE_VECTORED))
+    {
+        uint8_t const single = (COMMAND_READV == command)
+                               ? COMMAND_READ
+                               : COMMAND_WRITE;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            Debug_ASSERT(segs[i].buffer != NULL);
+
+            segs[i].done = stripe(self, single, segs[i].addr, segs[i].buffer,
+                                  segs[i].length);
+            complete += (segs[i].done == segs[i].length) ? 1 : 0;
+        }
+
+        return complete;
+    }
+
+    size_t const parts = (count < self->count) ? count : self->count;
+    size_t total = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        total += segs[i].length;
+    }
+
+    size_t first = 0;
+    size_t before = 0;
+
+    for (size_t g = 0; g < parts; g++)
+    {
+        size_t end = first;
+
+        // the segments that start in the share of the group, the last one
+        // takes the rest
+        while ((end < count)
+               && ((g + 1 == parts) || (before < (g + 1) * total / parts)))
+        {
+            before += segs[end].length;
+            end++;
+        }
+
+        if (!ProxyNVM_startVectored(self->members[g], &self->parts[g].vectored,
+                                    command, &segs[first], end - first))
+        {
+            Debug_LOG_ERROR("%s: Starting group %zu failed", __func__, g);
+
+            for (size_t i = 0; i < count; i++)
+            {
+                segs[i].done = 0;
+            }
+            return 0;
+        }
+
+        first = end;
+    }
+
+    bool isDone;
+
+    do
+    {
+        isDone = true;
+
+        for (size_t g = 0; g < parts; g++)
+        {
+            if (!ProxyNVM_isVectoredDone(&self->parts[g].vectored))
+            {
+                ProxyNVM_sendFrames(self->members[g], &self->parts[g].vectored);
+            }
+        }
+
+        for (size_t g = 0; g < parts; g++)
+        {
+            ProxyNVM_Vectored* const vx = &self->parts[g].vectored;
+
+            if (!ProxyNVM_isVectoredDone(vx))
+            {
+                ProxyNVM_recvFrame(self->members[g], vx);
+                isDone = isDone && ProxyNVM_isVectoredDone(vx);
+            }
+        }
+    }
+    while (!isDone);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        complete += (segs[i].done == segs[i].length) ? 1 : 0;
+    }
+
+    return complete;
+}
+
+// Any two segments that share an address of the proxy NVM.
+static bool isOverlapping(ProxyNVM_Segment const* segs, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        for (size_t j = i + 1; j < count; j++)
+        {
+            if ((segs[i].addr < segs[j].addr + segs[j].length)
+                && (segs[j].addr < segs[i].addr + segs[i].length))
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+static bool isInside(ProxyNVM_Striped* self, size_t addr, size_t length)
+{
+    size_t const size = ProxyNVM_Striped_getSize(ProxyNVM_Striped_TO_NVM(self));
+
+    return (addr <= size) && (length <= size - addr);
+}
@@ -25,27 +25,204 @@
 
 #include "lib_mem/Nvm.h"
 #include "ChanMux/ChanMuxClient.h"
+#include "ProxyNVM_Codec.h"
+#include "ProxyNVM_Hash.h"
 
 
 /* Exported macro ------------------------------------------------------------*/
 
 #define ProxyNVM_TO_NVM(self) (&(self)->parent)
 
-#define COMMAND_GET_SIZE    0x00
-#define COMMAND_WRITE       0x01
-#define COMMAND_READ        0x02
+#define COMMAND_GET_SIZE             0x00
+#define COMMAND_WRITE                0x01
+#define COMMAND_READ                 0x02
+#define COMMAND_ERASE                0x03
+#define COMMAND_GET_FEATURES         0x04
+#define COMMAND_SET_FRAME_SIZE       0x05
+#define COMMAND_READV                0x06
+#define COMMAND_WRITEV               0x07
+#define COMMAND_GET_HASHES           0x08
+#define COMMAND_HELLO                0x09
+#define COMMAND_SET_ADDRESS_SIZE     0x0A
+#define COMMAND_COPY                 0x0B
+#define COMMAND_DISCARD              0x0C
+#define COMMAND_SYNC                 0x0D
+
+// version of the protocol this driver implements, reported by COMMAND_HELLO
+#define ProxyNVM_PROTOCOL_VERSION    1
+
+// feature bits reported by the proxy in response to COMMAND_GET_FEATURES
+#define ProxyNVM_FEATURE_ERASE       (1u << 0) //!< proxy supports COMMAND_ERASE
+#define ProxyNVM_FEATURE_TAGGED      (1u << 1) //!< proxy supports tagged frames
+#define ProxyNVM_FEATURE_FRAME_SIZE  (1u << 2) //!< proxy supports COMMAND_SET_FRAME_SIZE
+#define ProxyNVM_FEATURE_VECTORED    (1u << 3) //!< proxy supports COMMAND_READV/WRITEV
+#define ProxyNVM_FEATURE_COMPRESSION (1u << 4) //!< proxy supports compressed payloads
+#define ProxyNVM_FEATURE_FILL        (1u << 5) //!< proxy supports fill responses
+#define ProxyNVM_FEATURE_HASHES      (1u << 6) //!< proxy supports COMMAND_GET_HASHES
+#define ProxyNVM_FEATURE_WIDE        (1u << 7) //!< proxy supports 64 bit addresses
+#define ProxyNVM_FEATURE_COPY        (1u << 8) //!< proxy supports COMMAND_COPY
+#define ProxyNVM_FEATURE_DISCARD     (1u << 9) //!< proxy supports COMMAND_DISCARD
+#define ProxyNVM_FEATURE_SYNC        (1u << 10) //!< proxy supports COMMAND_SYNC
+
+// Number of chunk requests of a read or write that are sent to the proxy before
+// waiting for the first response. This requires tagged frames, and the ChanMux
+// channel FIFOs must be able to hold this many frames. A proxy supporting
+// COMMAND_HELLO may limit it further.
+#if !defined(ProxyNVM_PIPELINE_WINDOW)
+#   define ProxyNVM_PIPELINE_WINDOW  4
+#endif
+
+// Granularity of the results of COMMAND_COPY. The proxy reports one result for
+// each chunk of this size, a copy request covers as many chunks as results fit
+// into a frame.
+#if !defined(ProxyNVM_COPY_CHUNK_SIZE)
+#   define ProxyNVM_COPY_CHUNK_SIZE  (64 * 1024)
+#endif
+
+// Number of entries in ProxyNVM_Stats.errors. errors[i] counts the responses
+// with Retval -i, errors[0] counts the codes outside of this range.
+#define ProxyNVM_STATS_ERROR_CODES   8
 
 
 /* Exported types ------------------------------------------------------------*/
 
 typedef struct ProxyNVM ProxyNVM;
 
+typedef struct
+{
+    char* buf;          //!< holds the data read ahead
+    size_t bufSize;
+    size_t addr;        //!< address of the first byte read ahead
+    size_t length;      //!< bytes read ahead, received or outstanding
+    size_t offset;      //!< position of 'addr' in 'buf'
+    size_t chunks;      //!< outstanding chunk requests
+    size_t chunkLen;
+    uint8_t firstTag;   //!< tag of the first outstanding chunk request
+    size_t nextAddr;    //!< where a sequential read would continue
+} ProxyNVM_ReadAhead;
+
+typedef struct
+{
+    size_t addr;        //!< address on the proxy NVM
+    void* buffer;       //!< data to write or buffer to read into
+    size_t length;
+    size_t done;        //!< set to the bytes transferred from the start
+} ProxyNVM_Segment;
+
+typedef struct
+{
+    uint8_t command;    //!< COMMAND_READ or COMMAND_WRITE
+    size_t addr;
+    char* buffer;       //!< NULL writes 0xFF
+    size_t length;
+    size_t chunkLen;    //!< payload of a chunk request
+    size_t chunks;
+    size_t window;      //!< chunk requests outstanding at a time
+    bool isTagged;
+    uint8_t firstTag;   //!< tag of the first chunk request
+    size_t sent;        //!< chunk requests sent to the proxy
+    size_t received;    //!< chunk responses received from the proxy
+    size_t failed;      //!< index of the first failed chunk, 'chunks' if none
+    bool isBroken;      //!< the stream is out of sync, nothing transferred
+    char const* func;   //!< caller, for the log
+} ProxyNVM_Transfer;
+
+typedef struct
+{
+    size_t seg;         //!< index of the segment
+    size_t offset;      //!< bytes of the segment before the position
+} ProxyNVM_SegCursor;
+
+typedef struct
+{
+    ProxyNVM_SegCursor start; //!< the frame can be rebuilt from here
+    size_t runs;        //!< runs of adjacent segments in the frame
+    size_t bytes;       //!< payload of all runs
+    uint8_t tag;
+} ProxyNVM_Batch;
+
+typedef struct
+{
+    uint8_t command;    //!< COMMAND_READV or COMMAND_WRITEV
+    ProxyNVM_Segment* segs;
+    size_t count;
+    size_t window;      //!< frames outstanding at a time
+    bool isTagged;
+    ProxyNVM_SegCursor next; //!< where the next frame starts
+    ProxyNVM_Batch frames[ProxyNVM_PIPELINE_WINDOW]; //!< outstanding frames
+    size_t sent;        //!< frames sent to the proxy
+    size_t received;    //!< responses received from the proxy
+    bool isAllSent;
+    bool isBroken;      //!< the stream is out of sync
+    char const* func;   //!< caller, for the log
+} ProxyNVM_Vectored;
+
+typedef struct
+{
+    uint8_t command;    //!< COMMAND_ERASE, COMMAND_DISCARD or COMMAND_COPY
+    size_t addr;        //!< destination of a copy
+    size_t src;         //!< source of a copy
+    size_t length;
+    bool isBackwards;   //!< the proxy copies from the end, the ranges overlap
+    bool isSent;
+    char const* func;   //!< caller, for the log
+} ProxyNVM_Request;
+
+typedef struct
+{
+    uint64_t* table;    //!< hash of each block on the proxy, 0 if not known
+    size_t blocks;      //!< entries in 'table', they cover the first blocks
+    size_t blockSize;
+    uint64_t erasedHash; //!< hash of an erased block
+} ProxyNVM_Hashes;
+
+typedef struct
+{
+    uint32_t* bits;     //!< a set bit marks a block known to be erased
+    size_t blocks;      //!< number of bits
+    size_t blockSize;   //!< 0 until it is derived from the capacity
+} ProxyNVM_ErasedMap;
+
+typedef struct
+{
+    uint64_t framesSent;        //!< requests sent to the proxy
+    uint64_t framesReceived;    //!< responses received from the proxy
+    uint64_t bytesSent;         //!< bytes written to the ChanMux channel
+    uint64_t bytesReceived;     //!< bytes read from the ChanMux channel
+    uint64_t errors[ProxyNVM_STATS_ERROR_CODES]; //!< failed responses by Retval
+    uint64_t channelErrors;     //!< failed transfers and unexpected responses
+    uint64_t bytesUnchanged;    //!< written bytes not sent, the proxy had them
+    uint64_t bytesBlank;        //!< bytes read or erased without the proxy, as
+                                //!< they were known to be erased
+} ProxyNVM_Stats;
+
 struct ProxyNVM
 {
     Nvm parent;
     ChanMuxClient* chanmux;
     char* msgBuf;
     size_t msgBufSize;
+    size_t size;        //!< cached capacity of the proxy NVM
+    bool isSizeCached;  //!< true if 'size' holds the proxy's capacity
+    uint32_t features;  //!< ProxyNVM_FEATURE_xxx bits supported by the proxy
+    uint32_t version;   //!< protocol version of the proxy, 0 if not reported
+    size_t window;      //!< requests outstanding at a time, negotiated
+    size_t fieldSize;   //!< bytes of ADDR, LENGTH and BYTES, negotiated
+    void (*writeHeader)(char* message, uint8_t command, size_t addr,
+                        size_t length); //!< request header for 'fieldSize'
+    bool isFeaturesQueried;
+    bool isOutOfSync;   //!< resynchronize before the next request
+    bool isLost;        //!< the stream can't be resynchronized, requests fail
+    uint64_t streamSent;     //!< bytes written to the channel, see COMMAND_SYNC
+    uint64_t streamReceived; //!< bytes read from the channel
+    uint64_t requestStart;   //!< 'streamSent' before the current request
+    uint8_t nextTag;    //!< sequence number for the next tagged frame
+    size_t maxMsgLen;   //!< max length of a message, negotiated with the proxy
+    ProxyNVM_ReadAhead readAhead;
+    ProxyNVM_Stats stats;
+    ProxyNVM_CodecWorkspace* codec; //!< NULL if compression is disabled
+    ProxyNVM_Hashes hashes;
+    ProxyNVM_ErasedMap erased;
 };
 
 
@@ -76,15 +253,368 @@ ProxyNVM_read(Nvm* nvm, size_t addr, void* buffer, size_t length);
  * @brief static implementation of the erase method that is required
  * when working with flash
  *
+ * If the proxy supports COMMAND_ERASE the whole range is erased with a single
+ * request, otherwise the range is overwritten with 0xFF.
+ *
  */
 size_t
 ProxyNVM_erase(Nvm* nvm, size_t addr, size_t length);
+/**
+ * @brief copies a range of the proxy NVM to another address on the proxy.
+ *
+ * The data doesn't cross the channel. Overlapping ranges are copied like by
+ * memmove(), if the destination lies above the source this is done from the
+ * end. Requires ProxyNVM_FEATURE_COPY. The hashes and the erased map of the
+ * destination are dropped.
+ *
+ * @param self pointer to the ProxyNVM
+ * @param dst address of the destination
+ * @param src address of the source
+ * @param length bytes to copy
+ *
+ * @return bytes copied from the start of the range, 0 if copying from the end
+ *  failed
+ *
+ */
+size_t
+ProxyNVM_copy(ProxyNVM* self, size_t dst, size_t src, size_t length);
+/**
+ * @brief tells the proxy that the data of a range is no longer needed.
+ *
+ * The content of the range is undefined until it is written again. A proxy
+ * supporting ProxyNVM_FEATURE_DISCARD may release the storage behind it and
+ * reads it as 0x00, otherwise nothing is sent and the data just stays. The
+ * hashes and the erased map of the range are dropped.
+ *
+ * @return bytes discarded, the whole range or 0
+ *
+ */
+size_t
+ProxyNVM_discard(ProxyNVM* self, size_t addr, size_t length);
 /**
  * @brief static implementation of virtual method NVM_getSize()
  *
+ * The capacity is requested from the proxy on first use only, subsequent
+ * calls return the cached value. Capacities of 4 GiB and more require a proxy
+ * supporting ProxyNVM_FEATURE_WIDE and a 64 bit size_t.
+ *
  */
 size_t
 ProxyNVM_getSize(Nvm* nvm);
+/**
+ * @brief requests the capacity from the proxy and updates the cached value.
+ *
+ * This is done implicitly on first use and whenever the proxy rejects a
+ * request as out of bounds, but can be called explicitly if the backing
+ * storage of the proxy is known to have been resized.
+ *
+ * @return true if success
+ *
+ */
+bool
+ProxyNVM_refreshSize(ProxyNVM* self);
+
+/**
+ * @brief returns the ProxyNVM_FEATURE_xxx bits the proxy supports.
+ *
+ * They are queried from the proxy on first use. If the channel fails during
+ * this, 0 is returned and the next call queries them again.
+ *
+ */
+uint32_t
+ProxyNVM_getFeatures(ProxyNVM* self);
+
+/**
+ * @brief sets the size of the frames that shall be exchanged with the proxy.
+ *
+ * The frame size can be larger than the message buffer, as payloads are not
+ * copied into it. It is negotiated with the proxy on first use and may end up
+ * smaller. By default, the size of the message buffer is used. Must be called
+ * before the first access.
+ *
+ * @return true if success
+ *
+ */
+bool
+ProxyNVM_setFrameSize(ProxyNVM* self, size_t frameSize);
+
+/**
+ * @brief enables reading ahead for sequential reads.
+ *
+ * When a read continues where the previous one ended, the data that follows
+ * is requested from the proxy before returning, up to the size of the buffer
+ * or the pipeline window. The next read collects it. Any other access
+ * abandons the read-ahead. Requires tagged frames.
+ *
+ */
+void
+ProxyNVM_enableReadAhead(ProxyNVM* self, char* buffer, size_t bufferSize);
+
+/**
+ * @brief enables compression of the payloads of reads and writes.
+ *
+ * If the proxy supports it, write payloads are sent compressed and the proxy
+ * may compress read payloads, in each case only if this makes the frame
+ * smaller. Payloads are compressed in the message buffer, so only payloads
+ * that fit into it are compressed.
+ *
+ * @param self pointer to the ProxyNVM
+ * @param workspace memory of the encoder, zeroed
+ *
+ */
+void
+ProxyNVM_enableCompression(ProxyNVM* self, ProxyNVM_CodecWorkspace* workspace);
+
+/**
+ * @brief enables skipping the blocks of a write that are unchanged.
+ *
+ * A hash of each block is kept in 'table'. Blocks of a write that are fully
+ * covered and whose hash matches the one of the block on the proxy are not
+ * sent. Hashes that are not known yet are requested from the proxy if it
+ * supports it, otherwise only the blocks written or erased before are known.
+ * Other writers of the proxy NVM must not exist.
+ *
+ * A matching hash is not verified, calling this accepts that a write is lost
+ * if its block collides with the one on the proxy. The hash is the 64 bit
+ * FNV-1a of ProxyNVM_Hash.h. For data written at random, a block is lost with
+ * a probability of about 2^-64 per write, but FNV-1a is no cryptographic
+ * hash: colliding blocks are easy to construct. Don't enable this if a
+ * writer that is not trusted can choose the content of blocks.
+ *
+ * @param self pointer to the ProxyNVM
+ * @param table holds the hashes, it covers the first 'blocks' blocks of the
+ *  proxy NVM
+ * @param blocks number of entries in 'table'
+ * @param blockSize size of a block in bytes
+ *
+ */
+void
+ProxyNVM_enableHashes(ProxyNVM* self, uint64_t* table, size_t blocks,
+                      size_t blockSize);
+
+/**
+ * @brief enables tracking of the erased blocks.
+ *
+ * A bit per block marks the blocks known to be erased. Erases of ranges that
+ * are erased already and reads of them are done without the proxy. The block
+ * size is the smallest power of 2, but at least 512, for which 'blocks' cover
+ * the capacity of the proxy NVM. The map starts empty, erases fill it and
+ * writes clear it. Other writers of the proxy NVM must not exist.
+ *
+ * @param self pointer to the ProxyNVM
+ * @param bitmap holds the bits, (blocks + 31) / 32 words
+ * @param blocks number of bits in 'bitmap'
+ *
+ */
+void
+ProxyNVM_enableErasedMap(ProxyNVM* self, uint32_t* bitmap, size_t blocks);
+
+/**
+ * @brief fills the map of erased blocks with what the proxy NVM holds.
+ *
+ * The proxy is asked for the hashes of all blocks, this requires
+ * ProxyNVM_FEATURE_HASHES. A block is taken as erased if its hash is the one
+ * of an erased block.
+ *
+ * @param self pointer to the ProxyNVM
+ *
+ * @return true if success
+ *
+ */
+bool
+ProxyNVM_scanErased(ProxyNVM* self);
+
+/**
+ * @brief reads several segments.
+ *
+ * Segments that are adjacent on the proxy NVM and in memory are merged. If
+ * the proxy supports COMMAND_READV, many segments are read with a single
+ * frame, otherwise each merged segment is read on its own. The result of each
+ * segment is in its 'done' field.
+ *
+ * @return number of segments read completely, 0 if any segment is out of
+ *  bounds
+ *
+ */
+size_t
+ProxyNVM_readv(ProxyNVM* self, ProxyNVM_Segment* segments, size_t count);
+
+/**
+ * @brief writes several segments, like ProxyNVM_readv().
+ *
+ */
+size_t
+ProxyNVM_writev(ProxyNVM* self, ProxyNVM_Segment* segments, size_t count);
+
+/**
+ * @brief returns the payload of a chunk of a read or write.
+ *
+ * Negotiates the frame size if this was not done yet.
+ *
+ */
+size_t
+ProxyNVM_getChunkSize(ProxyNVM* self, uint8_t command);
+
+/**
+ * @brief starts a read or write that is driven step by step.
+ *
+ * This allows the caller to interleave transfers on several ProxyNVMs. The
+ * transfer is advanced by ProxyNVM_sendChunks() and ProxyNVM_recvChunk() until
+ * ProxyNVM_isTransferDone(), no other access of 'self' may happen meanwhile.
+ * The read-ahead, hashes and erased map are not used, the ones covering the
+ * range are dropped.
+ *
+ * @param self pointer to the ProxyNVM
+ * @param xfer state of the transfer
+ * @param command COMMAND_READ or COMMAND_WRITE
+ * @param addr address on the proxy NVM
+ * @param buffer data to write or buffer to read into, NULL writes 0xFF
+ * @param length bytes to transfer
+ *
+ * @return false if the range is out of bounds
+ *
+ */
+bool
+ProxyNVM_startTransfer(ProxyNVM* self, ProxyNVM_Transfer* xfer,
+                       uint8_t command, size_t addr, void* buffer,
+                       size_t length);
+
+/**
+ * @brief sends chunk requests until the pipeline window is full.
+ *
+ * @return false if the channel failed
+ *
+ */
+bool
+ProxyNVM_sendChunks(ProxyNVM* self, ProxyNVM_Transfer* xfer);
+
+/**
+ * @brief receives the response to the oldest outstanding chunk request.
+ *
+ * Blocks until it arrives, does nothing if no request is outstanding.
+ *
+ * @return false if the channel failed or is out of sync
+ *
+ */
+bool
+ProxyNVM_recvChunk(ProxyNVM* self, ProxyNVM_Transfer* xfer);
+
+bool
+ProxyNVM_isTransferDone(ProxyNVM_Transfer const* xfer);
+
+/**
+ * @brief returns the bytes transferred successfully from the start.
+ *
+ */
+size_t
+ProxyNVM_getTransferred(ProxyNVM_Transfer const* xfer);
+
+/**
+ * @brief starts a vectored read or write that is driven step by step.
+ *
+ * Like ProxyNVM_startTransfer(), but for the segments of ProxyNVM_readv() or
+ * ProxyNVM_writev(). It is advanced by ProxyNVM_sendFrames() and
+ * ProxyNVM_recvFrame() until ProxyNVM_isVectoredDone(), the result of each
+ * segment is in its 'done' field then.
+ *
+ * @param self pointer to the ProxyNVM
+ * @param vx state of the transfer
+ * @param command COMMAND_READV or COMMAND_WRITEV
+ * @param segments segments to transfer, they must stay valid until done
+ * @param count number of segments
+ *
+ * @return false if any segment is out of bounds or the proxy does not
+ *  support COMMAND_READV and COMMAND_WRITEV
+ *
+ */
+bool
+ProxyNVM_startVectored(ProxyNVM* self, ProxyNVM_Vectored* vx,
+                       uint8_t command, ProxyNVM_Segment* segments,
+                       size_t count);
+
+/**
+ * @brief sends frames until the pipeline window is full.
+ *
+ * @return false if the channel failed
+ *
+ */
+bool
+ProxyNVM_sendFrames(ProxyNVM* self, ProxyNVM_Vectored* vx);
+
+/**
+ * @brief receives the response to the oldest outstanding frame.
+ *
+ * Blocks until it arrives, does nothing if no frame is outstanding.
+ *
+ * @return false if the channel failed or is out of sync
+ *
+ */
+bool
+ProxyNVM_recvFrame(ProxyNVM* self, ProxyNVM_Vectored* vx);
+
+bool
+ProxyNVM_isVectoredDone(ProxyNVM_Vectored const* vx);
+
+/**
+ * @brief returns the bytes a single COMMAND_COPY request can copy.
+ *
+ * Negotiates the frame size if this was not done yet.
+ *
+ */
+size_t
+ProxyNVM_getMaxCopy(ProxyNVM* self);
+
+/**
+ * @brief sends an erase, discard or copy request without waiting for the
+ *  response.
+ *
+ * This allows the caller to have requests in flight on several ProxyNVMs,
+ * the response is collected by ProxyNVM_finishRequest(). No other access of
+ * 'self' may happen meanwhile. Unlike ProxyNVM_erase(), the erased map is
+ * not consulted and a proxy without COMMAND_ERASE is not handled.
+ *
+ * @param self pointer to the ProxyNVM
+ * @param req state of the request
+ * @param command COMMAND_ERASE, COMMAND_DISCARD or COMMAND_COPY
+ * @param addr address of the range, the destination of a copy
+ * @param src source of a copy, ignored otherwise
+ * @param length bytes of the range, at most ProxyNVM_getMaxCopy() for a copy
+ *
+ * @return false if a range is out of bounds, the proxy does not support the
+ *  command or the channel failed
+ *
+ */
+bool
+ProxyNVM_startRequest(ProxyNVM* self, ProxyNVM_Request* req, uint8_t command,
+                      size_t addr, size_t src, size_t length);
+
+/**
+ * @brief receives the response to a request of ProxyNVM_startRequest().
+ *
+ * Blocks until it arrives.
+ *
+ * @return bytes erased, discarded or copied from the start of the range, or
+ *  from its end for a copy that is done backwards
+ *
+ */
+size_t
+ProxyNVM_finishRequest(ProxyNVM* self, ProxyNVM_Request* req);
+
+/**
+ * @brief copies the counters of the exchange with the proxy.
+ *
+ * They count since construction or the last ProxyNVM_resetStats().
+ *
+ */
+void
+ProxyNVM_getStats(ProxyNVM* self, ProxyNVM_Stats* stats);
+
+/**
+ * @brief sets all counters to 0.
+ *
+ */
+void
+ProxyNVM_resetStats(ProxyNVM* self);
 
 void
 ProxyNVM_dtor(Nvm* nvm);
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+/**
+ * @addtogroup OS
+ * @{
+ *
+ * @file
+ *
+ * @brief compression of the payloads of the proxy NVM protocol. The data is
+ *  encoded in the LZ4 block format, so runs of equal bytes like zero-filled or
+ *  erased regions shrink to a few bytes and repeated strings in text are
+ *  replaced by references. Nothing is allocated, the encoder uses a workspace
+ *  provided by the caller and the decoder needs none. This header is shared by
+ *  the driver and the host-side reference proxy.
+ *
+ */
+#pragma once
+
+/* Includes ------------------------------------------------------------------*/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/* Exported macro ------------------------------------------------------------*/
+
+// log2 of the number of entries in the hash table of the encoder
+#define ProxyNVM_CODEC_HASH_LOG     12
+
+
+/* Exported types ------------------------------------------------------------*/
+
+typedef struct
+{
+    // position of the last occurrence of each hashed 4 byte sequence. Stale
+    // entries from previous calls are harmless, every match is verified.
+    uint32_t table[1u << ProxyNVM_CODEC_HASH_LOG];
+} ProxyNVM_CodecWorkspace;
+
+
+/* Exported functions ------------------------------------------------------- */
+/**
+ * @brief compresses a buffer.
+ *
+ * @param workspace hash table of the encoder, must be zeroed before the first
+ *  use only
+ * @param src data to compress
+ * @param srcLen length of src in bytes
+ * @param dst receives the compressed data
+ * @param dstSize size of dst in bytes
+ *
+ * @return length of the compressed data, 0 if it does not fit into dst. Pass
+ *  a dstSize smaller than srcLen to get 0 when compression doesn't help.
+ *
+ */
+size_t
+ProxyNVM_compress(ProxyNVM_CodecWorkspace* workspace, void const* src,
+                  size_t srcLen, void* dst, size_t dstSize);
+
+/**
+ * @brief decompresses data from ProxyNVM_compress().
+ *
+ * The input is not trusted, nothing outside of src and dst is accessed.
+ *
+ * @return true if the data is valid and decompresses to exactly dstLen bytes
+ *
+ */
+bool
+ProxyNVM_decompress(void const* src, size_t srcLen, void* dst, size_t dstLen);
+
+///@}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+/**
+ * @addtogroup OS
+ * @{
+ *
+ * @file
+ *
+ * @brief hash of the blocks compared by the driver and the proxy to find out
+ *  if a write would change anything. It is the 64 bit FNV-1a hash, which is
+ *  simple enough to be implemented the same way on any proxy. This header is
+ *  shared by the driver and the host-side reference proxy.
+ *
+ */
+#pragma once
+
+/* Includes ------------------------------------------------------------------*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/* Exported macro ------------------------------------------------------------*/
+
+// initial value of a hash
+#define ProxyNVM_HASH_INIT          0xcbf29ce484222325ull
+
+
+/* Exported functions ------------------------------------------------------- */
+/**
+ * @brief adds data to a hash.
+ *
+ * @param hash ProxyNVM_HASH_INIT or the result of a previous call
+ * @param data data to add
+ * @param length length of data in bytes
+ *
+ * @return the updated hash
+ *
+ */
+uint64_t
+ProxyNVM_hash(uint64_t hash, void const* data, size_t length);
+
+///@}
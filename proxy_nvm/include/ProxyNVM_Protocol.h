@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2018-2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+/**
+ * @addtogroup OS
+ * @{
+ *
+ * @file
+ *
+ * @brief message layout of the proxy NVM protocol. The protocol itself is
+ *  described at the top of ProxyNVM.c. This header is shared by the driver and
+ *  the host-side reference proxy and is not meant for users of the ProxyNVM.
+ *
+ */
+#pragma once
+
+/* Exported macro ------------------------------------------------------------*/
+
+#define REQUEST_HEADER_LEN      9
+#define RESP_HEADER_LEN         6
+#define TAG_LEN                 1
+#define TAG_FLAG                0x80
+#define COMPRESSED_FLAG         0x40
+#define FILL_FLAG               0x20
+#define COMMAND_MASK            0x1F //command without the flags above
+#define COMPRESSED_LEN_SIZE     4 //number of bytes for the compressed length
+#define FILL_LEN                1 //number of bytes for the fill value
+#define ADDRESS_SIZE            4 //number of bytes for the address in the protocol
+#define LENGTH_SIZE             4 //number of bytes for the length in the protocol
+#define WIDE_FIELD_SIZE         8 //ADDR, LENGTH and BYTES after COMMAND_SET_ADDRESS_SIZE
+
+//INDEXES OF DIFFERENT PARTS OF THE REQUEST MESSAGE (IN A BUFFER)
+#define REQ_COMM_INDEX          0
+#define REQ_ADDR_INDEX          1
+#define REQ_LEN_INDEX           5
+#define REQ_PAYLD_INDEX         9
+
+//INDEXES OF DIFFERENT PARTS OF THE RESPONSE MESSAGE (IN A BUFFER)
+#define RESP_COMM_INDEX         0
+#define RESP_RETVAL_INDEX       1
+#define RESP_BYTES_INDEX        2
+#define RESP_PAYLD_INDEX        6
+
+//LAYOUT FOR A SIZE F OF THE ADDR, LENGTH AND BYTES FIELDS, THE CONSTANTS ABOVE
+//AND BELOW ARE THE ONES FOR ADDRESS_SIZE
+#define REQ_HEADER_LEN_OF(f)    (1 + (2 * (f)))
+#define RESP_HEADER_LEN_OF(f)   (2 + (f))
+#define REQ_LEN_INDEX_OF(f)     (1 + (f))
+#define SEG_DESC_LEN_OF(f)      (2 * (f))
+#define SEG_RESULT_LEN_OF(f)    (1 + (f))
+#define MAX_REQUEST_HEADER_LEN  REQ_HEADER_LEN_OF(WIDE_FIELD_SIZE)
+#define MAX_RESP_HEADER_LEN     RESP_HEADER_LEN_OF(WIDE_FIELD_SIZE)
+
+//PER SEGMENT PARTS OF VECTORED MESSAGES
+#define SEG_DESC_LEN            8 //ADDR and LENGTH of a segment in a request
+#define SEG_RESULT_LEN          5 //Retval and BYTES of a segment in a response
+
+//PARTS OF HELLO RESPONSES, BEHIND THE VERSION IN THE HEADER
+#define HELLO_FRAME_SIZE_INDEX  6
+#define HELLO_WINDOW_INDEX      10
+#define HELLO_FEATURES_INDEX    14
+#define HELLO_RESP_LEN          18
+
+//PARTS OF GETHASHES MESSAGES
+#define BLOCK_SIZE_LEN          4 //block size behind the request header
+#define HASH_LEN                8 //hash of a block in a response
+
+//PARTS OF COPY MESSAGES, SRC_ADDR HAS THE SIZE OF ADDR AND FOLLOWS THE HEADER
+#define CHUNK_SIZE_LEN          4 //chunk size behind the source address
+
+//PARTS OF SYNC RESPONSES, THE COUNTS DON'T DEPEND ON THE NEGOTIATED FIELD SIZE
+#define SYNC_COUNT_LEN          8 //byte count of a direction of the channel
+#define SYNC_RECEIVED_INDEX     2 //bytes the proxy received, with the request
+#define SYNC_SENT_INDEX         10 //bytes the proxy sent before the response
+#define SYNC_RESP_LEN           18
+
+//RETURN MESSAGES
+#define RET_OK                  0
+#define RET_GENERIC_ERR         -1
+#define RET_FILE_OPEN_ERR       -2
+#define RET_WRITE_ERR           -3
+#define RET_READ_ERR            -4
+#define RET_LEN_OUT_OF_BOUNDS   -5
+#define RET_ADDR_OUT_OF_BOUNDS  -6
+
+///@}
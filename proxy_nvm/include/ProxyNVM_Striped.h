@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+/**
+ * @addtogroup OS
+ * @{
+ *
+ * @file
+ *
+ * @brief a implementation of the LibMem/Nvm.h interface that stripes the
+ *  accesses across several ProxyNVMs, each on its own ChanMux channel to the
+ *  same proxy NVM. An access is split into one part per channel and the
+ *  requests of all parts are in flight at the same time. Reads, writes,
+ *  erases, discards and copies are split by address, vectored transfers by
+ *  their segments. All memory is provided by the caller.
+ *
+ */
+#pragma once
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "ProxyNVM.h"
+
+
+/* Exported macro ------------------------------------------------------------*/
+
+#define ProxyNVM_Striped_TO_NVM(self) (&(self)->parent)
+
+
+/* Exported types ------------------------------------------------------------*/
+
+// state of the part of an access that is done by one channel
+typedef union
+{
+    ProxyNVM_Transfer transfer;
+    ProxyNVM_Vectored vectored;
+    ProxyNVM_Request request;
+} ProxyNVM_Striped_Part;
+
+typedef struct
+{
+    Nvm parent;
+    ProxyNVM** members;             //!< one per channel
+    ProxyNVM_Striped_Part* parts;   //!< one per channel
+    size_t count;
+} ProxyNVM_Striped;
+
+
+/* Exported constants --------------------------------------------------------*/
+/* Exported functions ------------------------------------------------------- */
+/**
+ * @brief constructor.
+ *
+ * The members must not have the read-ahead, hashes or erased map enabled,
+ * the others would not see their writes. All members must report the same
+ * capacity, chunk sizes and features, they are queried here.
+ *
+ * @param self pointer to the striped NVM
+ * @param members array of count constructed ProxyNVMs
+ * @param parts array of count part states
+ * @param count number of channels
+ *
+ * @return true if success
+ *
+ */
+bool
+ProxyNVM_Striped_ctor(ProxyNVM_Striped* self, ProxyNVM** members,
+                      ProxyNVM_Striped_Part* parts, size_t count);
+
+/**
+ * @brief static implementation of virtual method NVM_write().
+ *
+ */
+size_t
+ProxyNVM_Striped_write(Nvm* nvm, size_t addr, void const* buffer,
+                       size_t length);
+
+/**
+ * @brief static implementation of virtual method NVM_read().
+ *
+ */
+size_t
+ProxyNVM_Striped_read(Nvm* nvm, size_t addr, void* buffer, size_t length);
+
+/**
+ * @brief static implementation of the erase method. If the proxy does not
+ *  support COMMAND_ERASE, 0xFF is written like by ProxyNVM_erase().
+ *
+ */
+size_t
+ProxyNVM_Striped_erase(Nvm* nvm, size_t addr, size_t length);
+
+/**
+ * @brief static implementation of virtual method NVM_getSize().
+ *
+ */
+size_t
+ProxyNVM_Striped_getSize(Nvm* nvm);
+
+/**
+ * @brief reads several segments, like ProxyNVM_readv().
+ *
+ * The segments are split into one group of adjacent list entries per channel,
+ * each carrying about the same number of bytes.
+ *
+ */
+size_t
+ProxyNVM_Striped_readv(ProxyNVM_Striped* self, ProxyNVM_Segment* segments,
+                       size_t count);
+
+/**
+ * @brief writes several segments, like ProxyNVM_writev().
+ *
+ * Segments that overlap on the proxy NVM are written in their order through
+ * the first ProxyNVM, as the channels don't keep an order among each other.
+ *
+ */
+size_t
+ProxyNVM_Striped_writev(ProxyNVM_Striped* self, ProxyNVM_Segment* segments,
+                        size_t count);
+
+/**
+ * @brief copies a range on the proxy NVM, like ProxyNVM_copy().
+ *
+ * Overlapping ranges must be copied in order and go through the first
+ * ProxyNVM.
+ *
+ */
+size_t
+ProxyNVM_Striped_copy(ProxyNVM_Striped* self, size_t dst, size_t src,
+                      size_t length);
+
+/**
+ * @brief discards a range on the proxy NVM, like ProxyNVM_discard().
+ *
+ */
+size_t
+ProxyNVM_Striped_discard(ProxyNVM_Striped* self, size_t addr, size_t length);
+
+/**
+ * @brief destructor, the members are not destructed.
+ *
+ */
+void
+ProxyNVM_Striped_dtor(Nvm* nvm);
+
+///@}
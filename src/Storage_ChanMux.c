@@ -12,31 +12,215 @@
  */
 #include "lib_debug/Debug.h"
 #include "ChanMuxNvmDriver.h"
+#include "CacheNVM.h"
+#include "Storage_ChanMux.h"
+#include "Storage_ChanMux_Core.h"
 
 #include <inttypes.h>
+#include <string.h>
 #include <camkes.h>
 
+// Window of each client on the storage as pairs of offset and size, a size of
+// 0 reaches to the end of the storage. Clients without one see all of it.
+#if !defined(Storage_ChanMux_CLIENT_WINDOWS)
+#   define Storage_ChanMux_CLIENT_WINDOWS   0, 0
+#endif
+
+// Share of each client in the submissions handled, clients without one get 1,
+// see Storage_ChanMux_QUANTUM.
+#if !defined(Storage_ChanMux_CLIENT_WEIGHTS)
+#   define Storage_ChanMux_CLIENT_WEIGHTS   1
+#endif
+
+// The core has the addresses of the dataports, see storage_rpc__init()
+typedef struct
+{
+    OS_Dataport_t   port;
+#if Storage_ChanMux_ASYNC
+    OS_Dataport_t   portRing;
+    void            (*emitDone)(void);
+#endif
+} ClientPorts;
+
+// Dataports and notification of client n, the ones of client 0 have no number,
+// the others are declared by Storage_ChanMux_MULTI_COMPONENT_DEFINE().
+#if Storage_ChanMux_ASYNC
+#define CLIENT_PORTS(_n_) \
+    { \
+        .port     = OS_DATAPORT_ASSIGN(storage_port##_n_), \
+        .portRing = OS_DATAPORT_ASSIGN(storage_ring_port##_n_), \
+        .emitDone = storage_done##_n_##_emit, \
+    }
+#else
+#define CLIENT_PORTS(_n_) \
+    { \
+        .port     = OS_DATAPORT_ASSIGN(storage_port##_n_), \
+    }
+#endif
+
+#if Storage_ChanMux_CLIENTS > 1
+#   define CURRENT_CLIENT(_rpc_)    getClient(_rpc_##_get_sender_id(), __func__)
+#else
+#   define CURRENT_CLIENT(_rpc_)    (&core.clients[0])
+#endif
+
+#if (ChanMuxNvmDriver_CHANNELS < 1) || (ChanMuxNvmDriver_CHANNELS > 4)
+#   error "ChanMuxNvmDriver_CHANNELS must be between 1 and 4"
+#endif
+
+// Configuration of a ChanMux client. The first one is chanMux, the others are
+// chanMux1 to chanMux3 declared by Storage_ChanMux_STRIPED_COMPONENT_DEFINE().
+#define CHANMUX_CLIENT_CONFIG(_chanMux_) \
+    { \
+        .port  = CHANMUX_DATAPORT_ASSIGN(_chanMux_##_chan_portRead, \
+                                         _chanMux_##_chan_portWrite), \
+        .wait  = _chanMux_##_chan_eventHasData_wait, \
+        .write = _chanMux_##_Rpc_write, \
+        .read  = _chanMux_##_Rpc_read \
+    }
+
 static struct
 {
     bool                        init_ok;
-    const ChanMuxClientConfig_t chanMuxClientConfig;
-    OS_Dataport_t               port_storage;
-
+    const ChanMuxClientConfig_t chanMuxClientConfig[ChanMuxNvmDriver_CHANNELS];
+    const ClientPorts           ports[Storage_ChanMux_CLIENTS];
 } ctx =
 {
     .init_ok             = false,
     .chanMuxClientConfig = {
-        .port  = CHANMUX_DATAPORT_ASSIGN(chanMux_chan_portRead,
-                                         chanMux_chan_portWrite),
-        .wait  = chanMux_chan_eventHasData_wait,
-        .write = chanMux_Rpc_write,
-        .read  = chanMux_Rpc_read
+        CHANMUX_CLIENT_CONFIG(chanMux),
+#if ChanMuxNvmDriver_CHANNELS > 1
+        CHANMUX_CLIENT_CONFIG(chanMux1),
+#endif
+#if ChanMuxNvmDriver_CHANNELS > 2
+        CHANMUX_CLIENT_CONFIG(chanMux2),
+#endif
+#if ChanMuxNvmDriver_CHANNELS > 3
+        CHANMUX_CLIENT_CONFIG(chanMux3),
+#endif
+    },
+    .ports = {
+        CLIENT_PORTS(),
+#if Storage_ChanMux_CLIENTS > 1
+        CLIENT_PORTS(1),
+#endif
+#if Storage_ChanMux_CLIENTS > 2
+        CLIENT_PORTS(2),
+#endif
+#if Storage_ChanMux_CLIENTS > 3
+        CLIENT_PORTS(3),
+#endif
     },
-    .port_storage = OS_DATAPORT_ASSIGN(storage_port),
 };
 
+static size_t const clientWindows[Storage_ChanMux_CLIENTS * 2] =
+{
+    Storage_ChanMux_CLIENT_WINDOWS
+};
+static size_t const clientWeights[Storage_ChanMux_CLIENTS] =
+{
+    Storage_ChanMux_CLIENT_WEIGHTS
+};
+
+// Number and size of the blocks of the read cache, no cache is used if the
+// number is 0.
+#if !defined(Storage_ChanMux_CACHE_BLOCKS)
+#   define Storage_ChanMux_CACHE_BLOCKS     0
+#endif
+#if !defined(Storage_ChanMux_CACHE_BLOCK_SIZE)
+#   define Storage_ChanMux_CACHE_BLOCK_SIZE 512
+#endif
+// Number of dirty bytes that triggers a flush of the cache, no write-back is
+// done if the number is 0.
+#if !defined(Storage_ChanMux_CACHE_WRITE_BACK)
+#   define Storage_ChanMux_CACHE_WRITE_BACK 0
+#endif
+
+// Number of bytes to read ahead for sequential reads, no reading ahead is done
+// if the number is 0.
+#if !defined(Storage_ChanMux_READ_AHEAD)
+#   define Storage_ChanMux_READ_AHEAD       0
+#endif
+
+// Compress the payloads of reads and writes if the proxy supports it.
+#if !defined(Storage_ChanMux_COMPRESSION)
+#   define Storage_ChanMux_COMPRESSION      0
+#endif
+
+// Number and size of the blocks whose hashes are kept to skip unchanged blocks
+// of writes, nothing is skipped if the number is 0. A block whose hash matches
+// is skipped without verification, so a write colliding with the block on the
+// proxy is lost. HASH_SKIP_UNVERIFIED has to be set to accept that.
+#if !defined(Storage_ChanMux_HASH_BLOCKS)
+#   define Storage_ChanMux_HASH_BLOCKS      0
+#endif
+#if !defined(Storage_ChanMux_HASH_BLOCK_SIZE)
+#   define Storage_ChanMux_HASH_BLOCK_SIZE  4096
+#endif
+#if !defined(Storage_ChanMux_HASH_SKIP_UNVERIFIED)
+#   define Storage_ChanMux_HASH_SKIP_UNVERIFIED 0
+#endif
+
+// Number of blocks in the map of erased blocks, no map is kept if the number
+// is 0. If ERASED_MAP_SCAN is not 0, the map is filled at startup by asking
+// the proxy for the hashes of all blocks.
+#if !defined(Storage_ChanMux_ERASED_MAP_BLOCKS)
+#   define Storage_ChanMux_ERASED_MAP_BLOCKS    0
+#endif
+#if !defined(Storage_ChanMux_ERASED_MAP_SCAN)
+#   define Storage_ChanMux_ERASED_MAP_SCAN      0
+#endif
+
+#if (Storage_ChanMux_HASH_BLOCKS > 0) && !Storage_ChanMux_HASH_SKIP_UNVERIFIED
+#   error "hashes skip writes unverified, requires Storage_ChanMux_HASH_SKIP_UNVERIFIED"
+#endif
+
+#if (Storage_ChanMux_CACHE_WRITE_BACK > 0) && (Storage_ChanMux_CACHE_BLOCKS == 0)
+#   error "write-back requires Storage_ChanMux_CACHE_BLOCKS"
+#endif
+
+// these need to see every access, a channel doesn't see those of the others
+#if (ChanMuxNvmDriver_CHANNELS > 1) \
+    && ((Storage_ChanMux_READ_AHEAD > 0) || (Storage_ChanMux_HASH_BLOCKS > 0) \
+        || (Storage_ChanMux_ERASED_MAP_BLOCKS > 0))
+#   error "read-ahead, hashes and erased map require a single channel"
+#endif
+
+// the error counters are copied as they are
+_Static_assert(Storage_ChanMux_STATS_ERROR_CODES == ProxyNVM_STATS_ERROR_CODES,
+               "error counters of ProxyNVM and the client header differ");
+
 static ChanMuxNvmDriver chanMuxNvmDriver;
-static Nvm* storage;
+static Storage_ChanMux_Core core;
+
+#if Storage_ChanMux_CACHE_BLOCKS > 0
+static CacheNVM         cacheNvm;
+static CacheNVM_Block   cacheBlocks[Storage_ChanMux_CACHE_BLOCKS];
+static char             cacheData[Storage_ChanMux_CACHE_BLOCKS
+                                  * Storage_ChanMux_CACHE_BLOCK_SIZE];
+#endif
+
+#if Storage_ChanMux_CACHE_WRITE_BACK > 0
+// a flush fills the whole pipeline to the proxy with one write
+static char             cacheFlushBuf[ChanMuxNvmDriver_FRAME_SIZE
+                                      * ProxyNVM_PIPELINE_WINDOW];
+#endif
+
+#if Storage_ChanMux_READ_AHEAD > 0
+static char             readAheadBuf[Storage_ChanMux_READ_AHEAD];
+#endif
+
+#if Storage_ChanMux_COMPRESSION
+static ProxyNVM_CodecWorkspace codecWorkspace[ChanMuxNvmDriver_CHANNELS];
+#endif
+
+#if Storage_ChanMux_HASH_BLOCKS > 0
+static uint64_t         hashTable[Storage_ChanMux_HASH_BLOCKS];
+#endif
+
+#if Storage_ChanMux_ERASED_MAP_BLOCKS > 0
+static uint32_t         erasedMap[(Storage_ChanMux_ERASED_MAP_BLOCKS + 31) / 32];
+#endif
 
 // Since signed offset (off_t) gets down casted to size_t, we need to verify
 // the correctness of this cast i.e. 0 <= offset <= max_size_t.
@@ -45,17 +229,109 @@ static bool valueFitsIntoSize_t(off_t const offset)
     return (0 <= offset) && (offset <= SIZE_MAX);
 }
 
+#if Storage_ChanMux_CLIENTS > 1
+static Storage_ChanMux_Core_Client* getClient(
+    seL4_Word   const badge,
+    const char* const func)
+{
+    seL4_Word const idx = badge - Storage_ChanMux_CLIENT_BADGE_BASE;
+
+    if (idx >= Storage_ChanMux_CLIENTS)
+    {
+        Debug_LOG_ERROR("%s: Unknown client badge %u", func, (unsigned) badge);
+        return NULL;
+    }
+
+    return &core.clients[idx];
+}
+#endif
+
+static OS_Error_t
+transferVectored(
+    Storage_ChanMux_Core_Client* const client,
+    bool                         const isWrite,
+    size_t                       const listOffset,
+    size_t                       const count,
+    const char*                  const func)
+{
+    if (!ctx.init_ok)
+    {
+        Debug_LOG_ERROR("initialization failed, fail call %s()", func);
+        return OS_ERROR_INVALID_STATE;
+    }
+
+    if (NULL == client)
+    {
+        return OS_ERROR_ACCESS_DENIED;
+    }
+
+    storage_mutex_lock();
+    OS_Error_t const err = Storage_ChanMux_Core_transferVectored(
+                               &core, client, isWrite, listOffset, count,
+                               func);
+    storage_mutex_unlock();
+
+    return err;
+}
+
 void storage_rpc__init(void)
 {
     if (!ChanMuxNvmDriver_ctor(
             &chanMuxNvmDriver,
-            &ctx.chanMuxClientConfig))
+            ctx.chanMuxClientConfig))
     {
         Debug_LOG_ERROR("Failed to construct ChanMuxNvmDriver");
         return;
     }
 
-    storage = ChanMuxNvmDriver_get_nvm(&chanMuxNvmDriver);
+#if Storage_ChanMux_READ_AHEAD > 0
+    if (!ChanMuxNvmDriver_enableReadAhead(
+            &chanMuxNvmDriver,
+            readAheadBuf,
+            sizeof(readAheadBuf)))
+    {
+        Debug_LOG_ERROR("Failed to enable the read-ahead");
+        return;
+    }
+#endif
+
+#if Storage_ChanMux_COMPRESSION
+    ChanMuxNvmDriver_enableCompression(&chanMuxNvmDriver, codecWorkspace);
+#endif
+
+#if Storage_ChanMux_HASH_BLOCKS > 0
+    if (!ChanMuxNvmDriver_enableHashes(
+            &chanMuxNvmDriver,
+            hashTable,
+            Storage_ChanMux_HASH_BLOCKS,
+            Storage_ChanMux_HASH_BLOCK_SIZE))
+    {
+        Debug_LOG_ERROR("Failed to enable the hashes");
+        return;
+    }
+#endif
+
+#if Storage_ChanMux_ERASED_MAP_BLOCKS > 0
+    if (!ChanMuxNvmDriver_enableErasedMap(
+            &chanMuxNvmDriver,
+            erasedMap,
+            Storage_ChanMux_ERASED_MAP_BLOCKS))
+    {
+        Debug_LOG_ERROR("Failed to enable the erased map");
+        return;
+    }
+
+#if Storage_ChanMux_ERASED_MAP_SCAN
+    // without it the map just starts empty
+    if (!ChanMuxNvmDriver_scanErased(&chanMuxNvmDriver))
+    {
+        Debug_LOG_WARNING("Failed to scan for erased blocks");
+    }
+#endif
+#endif
+
+    Nvm* const storage = ChanMuxNvmDriver_get_nvm(&chanMuxNvmDriver);
+    CacheNVM* cache = NULL;
 
     if (NULL == storage)
     {
@@ -63,6 +339,54 @@ void storage_rpc__init(void)
         return;
     }
 
+#if Storage_ChanMux_CACHE_BLOCKS > 0
+    if (!CacheNVM_ctor(
+            &cacheNvm,
+            storage,
+            cacheBlocks,
+            cacheData,
+            Storage_ChanMux_CACHE_BLOCKS,
+            Storage_ChanMux_CACHE_BLOCK_SIZE))
+    {
+        Debug_LOG_ERROR("Failed to construct CacheNVM");
+        return;
+    }
+
+#if Storage_ChanMux_CACHE_WRITE_BACK > 0
+    if (!CacheNVM_enableWriteBack(
+            &cacheNvm,
+            cacheFlushBuf,
+            sizeof(cacheFlushBuf),
+            Storage_ChanMux_CACHE_WRITE_BACK))
+    {
+        Debug_LOG_ERROR("Failed to enable write-back cache");
+        return;
+    }
+#endif
+
+    cache = &cacheNvm;
+#endif
+
+    if (!Storage_ChanMux_Core_ctor(&core, &chanMuxNvmDriver, cache))
+    {
+        Debug_LOG_ERROR("Failed to construct the storage core");
+        return;
+    }
+
+    for (size_t i = 0; i < Storage_ChanMux_CLIENTS; i++)
+    {
+        Storage_ChanMux_Core_Client* const client = &core.clients[i];
+
+        client->port     = OS_Dataport_getBuf(ctx.ports[i].port);
+        client->portSize = OS_Dataport_getSize(ctx.ports[i].port);
+#if Storage_ChanMux_ASYNC
+        client->rings    = OS_Dataport_getBuf(ctx.ports[i].portRing);
+#endif
+        client->offset   = clientWindows[i * 2];
+        client->size     = clientWindows[i * 2 + 1];
+        client->weight   = (clientWeights[i] > 0) ? clientWeights[i] : 1;
+    }
+
     ctx.init_ok = true;
 }
 
@@ -80,6 +404,12 @@ storage_rpc_write(
         return OS_ERROR_INVALID_STATE;
     }
 
+    Storage_ChanMux_Core_Client* const client = CURRENT_CLIENT(storage_rpc);
+    if (NULL == client)
+    {
+        return OS_ERROR_ACCESS_DENIED;
+    }
+
     if (!valueFitsIntoSize_t(offset))
     {
         Debug_LOG_ERROR(
@@ -88,7 +418,7 @@ storage_rpc_write(
         return OS_ERROR_INVALID_PARAMETER;
     }
 
-    size_t dataport_size = OS_Dataport_getSize(ctx.port_storage);
+    size_t dataport_size = client->portSize;
     if (size > dataport_size)
     {
         // the client did a bogus request, it knows the data port size and
@@ -101,11 +431,29 @@ storage_rpc_write(
         return OS_ERROR_INVALID_PARAMETER;
     }
 
-    *written = storage->vtable->write(
-                   storage,
-                   offset,
-                   OS_Dataport_getBuf(ctx.port_storage),
+    storage_mutex_lock();
+    if (!Storage_ChanMux_Core_isInWindow(&core, client, offset, size))
+    {
+        storage_mutex_unlock();
+        Debug_LOG_ERROR(
+            "%s: Out of the client's window: offset = 0x%" PRIxMAX ", "
+            "size = %zu",
+            __func__,
+            offset,
+            size);
+
+        return OS_ERROR_OUT_OF_BOUNDS;
+    }
+
+    uint64_t const start = Storage_ChanMux_TIMESTAMP();
+    *written = core.storage->vtable->write(
+                   core.storage,
+                   client->offset + offset,
+                   client->port,
                    size);
+    Storage_ChanMux_Core_countOp(&core, Storage_ChanMux_OP_WRITE, start,
+                                 *written, (size == *written));
+    storage_mutex_unlock();
     return (size == *written) ? OS_SUCCESS : OS_ERROR_GENERIC;
 }
 
@@ -123,6 +471,12 @@ storage_rpc_read(
         return OS_ERROR_INVALID_STATE;
     }
 
+    Storage_ChanMux_Core_Client* const client = CURRENT_CLIENT(storage_rpc);
+    if (NULL == client)
+    {
+        return OS_ERROR_ACCESS_DENIED;
+    }
+
     if (!valueFitsIntoSize_t(offset))
     {
         Debug_LOG_ERROR(
@@ -132,7 +486,7 @@ storage_rpc_read(
     }
 
 
-    size_t dataport_size = OS_Dataport_getSize(ctx.port_storage);
+    size_t dataport_size = client->portSize;
     if (size > dataport_size)
     {
         // the client did a bogus request, it knows the data port size and
@@ -145,11 +499,29 @@ storage_rpc_read(
         return OS_ERROR_INVALID_PARAMETER;
     }
 
-    *read = storage->vtable->read(
-                storage,
-                offset,
-                OS_Dataport_getBuf(ctx.port_storage),
+    storage_mutex_lock();
+    if (!Storage_ChanMux_Core_isInWindow(&core, client, offset, size))
+    {
+        storage_mutex_unlock();
+        Debug_LOG_ERROR(
+            "%s: Out of the client's window: offset = 0x%" PRIxMAX ", "
+            "size = %zu",
+            __func__,
+            offset,
+            size);
+
+        return OS_ERROR_OUT_OF_BOUNDS;
+    }
+
+    uint64_t const start = Storage_ChanMux_TIMESTAMP();
+    *read = core.storage->vtable->read(
+                core.storage,
+                client->offset + offset,
+                client->port,
                 size);
+    Storage_ChanMux_Core_countOp(&core, Storage_ChanMux_OP_READ, start, *read,
+                                 (size == *read));
+    storage_mutex_unlock();
     return (size == *read) ? OS_SUCCESS : OS_ERROR_GENERIC;
 }
 
@@ -167,6 +539,12 @@ storage_rpc_erase(
         return OS_ERROR_INVALID_STATE;
     }
 
+    Storage_ChanMux_Core_Client* const client = CURRENT_CLIENT(storage_rpc);
+    if (NULL == client)
+    {
+        return OS_ERROR_ACCESS_DENIED;
+    }
+
     if (!valueFitsIntoSize_t(offset) || !valueFitsIntoSize_t(size))
     {
         Debug_LOG_ERROR(
@@ -180,7 +558,52 @@ storage_rpc_erase(
         return OS_ERROR_INVALID_PARAMETER;
     }
 
-    *erased = storage->vtable->erase(storage, offset, size);
+    storage_mutex_lock();
+    if (!Storage_ChanMux_Core_isInWindow(&core, client, offset, size))
+    {
+        storage_mutex_unlock();
+        Debug_LOG_ERROR(
+            "%s: Out of the client's window: offset = 0x%" PRIxMAX ", "
+            "size = 0x%" PRIxMAX,
+            __func__,
+            offset,
+            size);
+
+        return OS_ERROR_OUT_OF_BOUNDS;
+    }
+
+    uint64_t const start = Storage_ChanMux_TIMESTAMP();
+    size_t erasedTotal = 0;
+
+    // A large erase keeps the proxy busy for long. The clients of storage_rpc
+    // share its one thread, so they wait for the whole erase anyway. Only the
+    // requests of storage_ext_rpc and the submissions handled by run() run in
+    // other threads, the storage is released between the pieces for them.
+    size_t const unit = Storage_ChanMux_Core_eraseUnit(&core);
+
+    for (;;)
+    {
+        size_t const left = (size_t) size - erasedTotal;
+        size_t const len = (left < unit) ? left : unit;
+        size_t const done = core.storage->vtable->erase(
+                                core.storage,
+                                client->offset + offset + erasedTotal,
+                                len);
+
+        erasedTotal += done;
+        if ((done != len) || (erasedTotal == (size_t) size))
+        {
+            break;
+        }
+
+        storage_mutex_unlock();
+        storage_mutex_lock();
+    }
+
+    *erased = (off_t) erasedTotal;
+    Storage_ChanMux_Core_countOp(&core, Storage_ChanMux_OP_ERASE, start,
+                                 *erased, (size == *erased));
+    storage_mutex_unlock();
     return (size == *erased) ? OS_SUCCESS : OS_ERROR_GENERIC;
 }
 
@@ -192,7 +615,17 @@ storage_rpc_getSize(off_t* const size)
         Debug_LOG_ERROR("initialization failed, fail call %s()", __func__);
         return OS_ERROR_INVALID_STATE;
     }
-    const size_t sizePriorToCast = storage->vtable->getSize(storage);
+
+    Storage_ChanMux_Core_Client* const client = CURRENT_CLIENT(storage_rpc);
+    if (NULL == client)
+    {
+        return OS_ERROR_ACCESS_DENIED;
+    }
+
+    storage_mutex_lock();
+    const size_t sizePriorToCast = core.storage->vtable->getSize(core.storage);
+    const size_t clientSize = Storage_ChanMux_Core_windowSize(&core, client);
+    storage_mutex_unlock();
 
     // -1 is reserved for a generic error on the ChanMux side.
     if (((size_t) -1) == sizePriorToCast)
@@ -201,7 +634,7 @@ storage_rpc_getSize(off_t* const size)
         return OS_ERROR_GENERIC;
     }
 
-    *size = (off_t)sizePriorToCast;
+    *size = (off_t)clientSize;
     return OS_SUCCESS;
 }
 
@@ -230,5 +663,293 @@ storage_rpc_getState(
     }
 
     *flags = 0U;
-    return OS_ERROR_NOT_SUPPORTED;
+
+#if Storage_ChanMux_CACHE_WRITE_BACK > 0
+    storage_mutex_lock();
+    if (CacheNVM_getDirtyBytes(&cacheNvm) > 0)
+    {
+        *flags |= Storage_ChanMux_STATE_FLAG_DIRTY;
+    }
+    storage_mutex_unlock();
+#endif
+
+    return OS_SUCCESS;
 }
+
+OS_Error_t
+storage_ext_rpc_flush(void)
+{
+    if (!ctx.init_ok)
+    {
+        Debug_LOG_ERROR("initialization failed, fail call %s()", __func__);
+        return OS_ERROR_INVALID_STATE;
+    }
+
+#if Storage_ChanMux_CACHE_WRITE_BACK > 0
+    storage_mutex_lock();
+    bool const isFlushed = CacheNVM_flush(&cacheNvm);
+    storage_mutex_unlock();
+
+    if (!isFlushed)
+    {
+        Debug_LOG_ERROR("%s: Flushing the cache failed", __func__);
+        return OS_ERROR_GENERIC;
+    }
+#endif
+
+    return OS_SUCCESS;
+}
+
+OS_Error_t
+storage_ext_rpc_readv(
+    size_t const listOffset,
+    size_t const count)
+{
+    return transferVectored(CURRENT_CLIENT(storage_ext_rpc), false, listOffset,
+                            count, __func__);
+}
+
+OS_Error_t
+storage_ext_rpc_writev(
+    size_t const listOffset,
+    size_t const count)
+{
+    return transferVectored(CURRENT_CLIENT(storage_ext_rpc), true, listOffset,
+                            count, __func__);
+}
+
+OS_Error_t
+storage_ext_rpc_copy(
+    off_t  const dst,
+    off_t  const src,
+    off_t  const size,
+    off_t* const copied)
+{
+    *copied = 0;
+
+    if (!ctx.init_ok)
+    {
+        Debug_LOG_ERROR("initialization failed, fail call %s()", __func__);
+        return OS_ERROR_INVALID_STATE;
+    }
+
+    Storage_ChanMux_Core_Client* const client = CURRENT_CLIENT(storage_ext_rpc);
+    if (NULL == client)
+    {
+        return OS_ERROR_ACCESS_DENIED;
+    }
+
+    if (!valueFitsIntoSize_t(dst) || !valueFitsIntoSize_t(src)
+        || !valueFitsIntoSize_t(size))
+    {
+        Debug_LOG_ERROR(
+            "%s: `dst`, `src` or `size` out of range: "
+            "dst = 0x%" PRIxMAX ", "
+            "src = 0x%" PRIxMAX ", "
+            "size = 0x%" PRIxMAX,
+            __func__,
+            dst,
+            src,
+            size);
+
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    storage_mutex_lock();
+    if (!Storage_ChanMux_Core_isInWindow(&core, client, dst, size)
+        || !Storage_ChanMux_Core_isInWindow(&core, client, src, size))
+    {
+        storage_mutex_unlock();
+        Debug_LOG_ERROR(
+            "%s: Out of the client's window: dst = 0x%" PRIxMAX ", "
+            "src = 0x%" PRIxMAX ", size = 0x%" PRIxMAX,
+            __func__,
+            dst,
+            src,
+            size);
+
+        return OS_ERROR_OUT_OF_BOUNDS;
+    }
+
+    uint64_t const start = Storage_ChanMux_TIMESTAMP();
+    *copied = (off_t) Storage_ChanMux_Core_copy(&core, client->offset + dst,
+                                                client->offset + src, size);
+    Storage_ChanMux_Core_countOp(&core, Storage_ChanMux_OP_COPY, start,
+                                 *copied, (size == *copied));
+    storage_mutex_unlock();
+    return (size == *copied) ? OS_SUCCESS : OS_ERROR_GENERIC;
+}
+
+OS_Error_t
+storage_ext_rpc_discard(
+    off_t  const offset,
+    off_t  const size,
+    off_t* const discarded)
+{
+    *discarded = 0;
+
+    if (!ctx.init_ok)
+    {
+        Debug_LOG_ERROR("initialization failed, fail call %s()", __func__);
+        return OS_ERROR_INVALID_STATE;
+    }
+
+    Storage_ChanMux_Core_Client* const client = CURRENT_CLIENT(storage_ext_rpc);
+    if (NULL == client)
+    {
+        return OS_ERROR_ACCESS_DENIED;
+    }
+
+    if (!valueFitsIntoSize_t(offset) || !valueFitsIntoSize_t(size))
+    {
+        Debug_LOG_ERROR(
+            "%s: `offset` or `size` out of range: "
+            "offset = 0x%" PRIxMAX ", "
+            "size = 0x%" PRIxMAX,
+            __func__,
+            offset,
+            size);
+
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    storage_mutex_lock();
+    if (!Storage_ChanMux_Core_isInWindow(&core, client, offset, size))
+    {
+        storage_mutex_unlock();
+        Debug_LOG_ERROR(
+            "%s: Out of the client's window: offset = 0x%" PRIxMAX ", "
+            "size = 0x%" PRIxMAX,
+            __func__,
+            offset,
+            size);
+
+        return OS_ERROR_OUT_OF_BOUNDS;
+    }
+
+    uint64_t const start = Storage_ChanMux_TIMESTAMP();
+    *discarded = (off_t) Storage_ChanMux_Core_discard(
+                     &core, client->offset + offset, size);
+    Storage_ChanMux_Core_countOp(&core, Storage_ChanMux_OP_DISCARD, start,
+                                 *discarded, (size == *discarded));
+    storage_mutex_unlock();
+    return (size == *discarded) ? OS_SUCCESS : OS_ERROR_GENERIC;
+}
+
+OS_Error_t
+storage_ext_rpc_getStats(
+    size_t* const size)
+{
+    *size = 0;
+
+    if (!ctx.init_ok)
+    {
+        Debug_LOG_ERROR("initialization failed, fail call %s()", __func__);
+        return OS_ERROR_INVALID_STATE;
+    }
+
+    Storage_ChanMux_Core_Client* const client = CURRENT_CLIENT(storage_ext_rpc);
+    if (NULL == client)
+    {
+        return OS_ERROR_ACCESS_DENIED;
+    }
+
+    Storage_ChanMux_Stats* const stats = (void*) client->port;
+    ProxyNVM_Stats proxyStats;
+
+    if (sizeof(*stats) > client->portSize)
+    {
+        Debug_LOG_ERROR("%s: Statistics don't fit into the dataport", __func__);
+        return OS_ERROR_BUFFER_TOO_SMALL;
+    }
+
+    storage_mutex_lock();
+    ChanMuxNvmDriver_getStats(&chanMuxNvmDriver, &proxyStats);
+    memcpy(stats->ops, core.opStats, sizeof(stats->ops));
+    storage_mutex_unlock();
+
+    stats->framesSent     = proxyStats.framesSent;
+    stats->framesReceived = proxyStats.framesReceived;
+    stats->bytesSent      = proxyStats.bytesSent;
+    stats->bytesReceived  = proxyStats.bytesReceived;
+    stats->channelErrors  = proxyStats.channelErrors;
+    stats->bytesUnchanged = proxyStats.bytesUnchanged;
+    stats->bytesBlank     = proxyStats.bytesBlank;
+    memcpy(stats->proxyErrors, proxyStats.errors, sizeof(stats->proxyErrors));
+
+    *size = sizeof(*stats);
+    return OS_SUCCESS;
+}
+
+OS_Error_t
+storage_ext_rpc_resetStats(void)
+{
+    if (!ctx.init_ok)
+    {
+        Debug_LOG_ERROR("initialization failed, fail call %s()", __func__);
+        return OS_ERROR_INVALID_STATE;
+    }
+
+    storage_mutex_lock();
+    memset(core.opStats, 0, sizeof(core.opStats));
+    ChanMuxNvmDriver_resetStats(&chanMuxNvmDriver);
+    storage_mutex_unlock();
+
+    return OS_SUCCESS;
+}
+
+#if Storage_ChanMux_ASYNC
+
+int run(void)
+{
+    if (!ctx.init_ok)
+    {
+        Debug_LOG_ERROR("initialization failed, no submissions are handled");
+        return -1;
+    }
+
+    for (size_t i = 0; i < Storage_ChanMux_CLIENTS; i++)
+    {
+        if (sizeof(Storage_ChanMux_Rings)
+            > OS_Dataport_getSize(ctx.ports[i].portRing))
+        {
+            Debug_LOG_ERROR("Rings don't fit into the ring dataport of client "
+                            "%zu", i);
+            return -1;
+        }
+    }
+
+    for (;;)
+    {
+        storage_kick_wait();
+
+        // One unit at a time, so submissions arriving meanwhile are taken
+        // into account right away. Each is completed as soon as it is done,
+        // so the client can reuse the buffers while the others are handled.
+        for (;;)
+        {
+            if (0 == Storage_ChanMux_Core_fetchSubmissions(&core))
+            {
+                break;
+            }
+
+            size_t prio;
+            Storage_ChanMux_Core_Client* const client =
+                Storage_ChanMux_Core_pickClient(&core, &prio);
+
+            storage_mutex_lock();
+            size_t const cost = Storage_ChanMux_Core_runUnit(&core, client,
+                                                             prio);
+            storage_mutex_unlock();
+
+            if (Storage_ChanMux_Core_retireUnit(&core, client, cost))
+            {
+                ctx.ports[client - core.clients].emitDone();
+            }
+        }
+    }
+
+    return 0;
+}
+
+#endif /* Storage_ChanMux_ASYNC */
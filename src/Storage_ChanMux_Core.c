@@ -0,0 +1,829 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ *
+ * Storage path of the ChanMux storage component, without CAmkES
+ */
+#include "lib_debug/Debug.h"
+#include "lib_compiler/compiler.h"
+#include "Storage_ChanMux_Core.h"
+
+#include <inttypes.h>
+#include <string.h>
+
+
+// True if [offset, offset + length) lies within a dataport of portSize bytes.
+// The lengths come from the client, so the sum must not be formed, it may
+// overflow a 32 bit size_t.
+static bool isInPort(
+    size_t const offset,
+    size_t const length,
+    size_t const portSize)
+{
+    return (offset <= portSize) && (length <= portSize - offset);
+}
+
+// True if two ranges of a dataport overlap, both must be within it
+static bool isOverlapping(
+    size_t const offsetA,
+    size_t const lengthA,
+    size_t const offsetB,
+    size_t const lengthB)
+{
+    return (offsetA < offsetB)
+           ? ((offsetB - offsetA) < lengthA)
+           : ((offsetA - offsetB) < lengthB);
+}
+
+// Reads or writes the first count entries of vecSegments.
+static void runSegments(
+    Storage_ChanMux_Core* const self,
+    bool                  const isWrite,
+    size_t                const count)
+{
+    if ((NULL != self->cache) && self->cache->isWriteBack)
+    {
+        // Dirty blocks may be newer than the lower Nvm, so the cache has to
+        // see every access. It merges the writes anyway.
+        for (size_t i = 0; i < count; i++)
+        {
+            ProxyNVM_Segment* const seg = &self->vecSegments[i];
+
+            seg->done = isWrite
+                        ? self->storage->vtable->write(self->storage,
+                                                       seg->addr, seg->buffer,
+                                                       seg->length)
+                        : self->storage->vtable->read(self->storage,
+                                                      seg->addr, seg->buffer,
+                                                      seg->length);
+        }
+        return;
+    }
+
+    if (isWrite)
+    {
+        ChanMuxNvmDriver_writev(self->driver, self->vecSegments, count);
+
+        // A write-through cache holds nothing the proxy doesn't, dropping
+        // what was overwritten keeps it coherent, even after a failure.
+        for (size_t i = 0; (NULL != self->cache) && (i < count); i++)
+        {
+            CacheNVM_invalidateRange(self->cache, self->vecSegments[i].addr,
+                                     self->vecSegments[i].length);
+        }
+        return;
+    }
+
+    if (NULL == self->cache)
+    {
+        ChanMuxNvmDriver_readv(self->driver, self->vecSegments, count);
+        return;
+    }
+
+    // Segments the cache holds completely are served from it, the others are
+    // read from the proxy in one go.
+    size_t misses = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        ProxyNVM_Segment* const seg = &self->vecSegments[i];
+
+        if (CacheNVM_readCached(self->cache, seg->addr, seg->buffer,
+                                seg->length))
+        {
+            seg->done = seg->length;
+        }
+        else
+        {
+            self->missSegments[misses] = *seg;
+            self->missIndex[misses] = i;
+            misses++;
+        }
+    }
+
+    if (0 == misses)
+    {
+        return;
+    }
+
+    ChanMuxNvmDriver_readv(self->driver, self->missSegments, misses);
+
+    for (size_t i = 0; i < misses; i++)
+    {
+        self->vecSegments[self->missIndex[i]].done = self->missSegments[i].done;
+    }
+}
+
+// A proxy without COMMAND_ERASE gets 0xFF written instead, then an erase
+// takes the link like a write of the same size.
+static bool isEraseNative(Storage_ChanMux_Core* const self)
+{
+    return (0 != (ChanMuxNvmDriver_getFeatures(self->driver)
+                  & ProxyNVM_FEATURE_ERASE));
+}
+
+
+//------------------------------------------------------------------------------
+bool
+Storage_ChanMux_Core_ctor(
+    Storage_ChanMux_Core*  self,
+    ChanMuxNvmDriver*      driver,
+    CacheNVM*              cache)
+{
+    memset(self, 0, sizeof(*self));
+
+    self->driver  = driver;
+    self->cache   = cache;
+    self->storage = (NULL != cache) ? CacheNVM_TO_NVM(cache)
+                    : ChanMuxNvmDriver_get_nvm(driver);
+
+    if (NULL == self->storage)
+    {
+        Debug_LOG_ERROR("%s: No storage", __func__);
+        return false;
+    }
+
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+size_t
+Storage_ChanMux_Core_windowSize(
+    Storage_ChanMux_Core*               self,
+    Storage_ChanMux_Core_Client const*  client)
+{
+    size_t const storageSize = self->storage->vtable->getSize(self->storage);
+
+    if (client->offset > storageSize)
+    {
+        return 0;
+    }
+
+    size_t const avail = storageSize - client->offset;
+
+    return ((0 == client->size) || (client->size > avail))
+           ? avail : client->size;
+}
+
+
+//------------------------------------------------------------------------------
+bool
+Storage_ChanMux_Core_isInWindow(
+    Storage_ChanMux_Core*               self,
+    Storage_ChanMux_Core_Client const*  client,
+    size_t                              offset,
+    size_t                              length)
+{
+    size_t const size = Storage_ChanMux_Core_windowSize(self, client);
+
+    return (offset <= size) && (length <= size - offset);
+}
+
+
+//------------------------------------------------------------------------------
+void
+Storage_ChanMux_Core_countOp(
+    Storage_ChanMux_Core*  self,
+    Storage_ChanMux_Op     op,
+    uint64_t               start,
+    size_t                 bytes,
+    bool                   isOk)
+{
+    Storage_ChanMux_OpStats* const stats = &self->opStats[op];
+    uint64_t const ticks = Storage_ChanMux_TIMESTAMP() - start;
+
+    stats->calls++;
+    stats->failed += isOk ? 0 : 1;
+    stats->bytes += bytes;
+    stats->ticksTotal += ticks;
+    if (ticks > stats->ticksMax)
+    {
+        stats->ticksMax = ticks;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+size_t
+Storage_ChanMux_Core_eraseUnit(
+    Storage_ChanMux_Core*  self)
+{
+    return isEraseNative(self) ? Storage_ChanMux_ERASE_UNIT
+           : Storage_ChanMux_UNIT;
+}
+
+
+//------------------------------------------------------------------------------
+size_t
+Storage_ChanMux_Core_copy(
+    Storage_ChanMux_Core*  self,
+    size_t                 dst,
+    size_t                 src,
+    size_t                 length)
+{
+    Nvm* const storage = self->storage;
+
+    if (ChanMuxNvmDriver_getFeatures(self->driver) & ProxyNVM_FEATURE_COPY)
+    {
+        // the proxy copies what it holds, so dirty data has to be there and
+        // the cached blocks of the destination are stale afterwards
+        if ((NULL != self->cache) && !CacheNVM_flush(self->cache))
+        {
+            return 0;
+        }
+
+        size_t const copied = ChanMuxNvmDriver_copy(self->driver, dst, src,
+                                                    length);
+        if (NULL != self->cache)
+        {
+            CacheNVM_invalidateRange(self->cache, dst, length);
+        }
+        return copied;
+    }
+
+    // like the proxy does, from the end if the destination overlaps the end
+    // of the source
+    bool const isBackwards = (dst > src) && ((dst - src) < length);
+    size_t copied = 0;
+
+    while (copied < length)
+    {
+        size_t const left = length - copied;
+        size_t const len = (left < sizeof(self->copyBuf))
+                           ? left : sizeof(self->copyBuf);
+        size_t const offset = isBackwards ? (left - len) : copied;
+
+        if ((storage->vtable->read(storage, src + offset, self->copyBuf, len)
+             != len)
+            || (storage->vtable->write(storage, dst + offset, self->copyBuf,
+                                       len) != len))
+        {
+            break;
+        }
+        copied += len;
+    }
+
+    return (isBackwards && (copied != length)) ? 0 : copied;
+}
+
+
+//------------------------------------------------------------------------------
+size_t
+Storage_ChanMux_Core_discard(
+    Storage_ChanMux_Core*  self,
+    size_t                 addr,
+    size_t                 length)
+{
+    if ((NULL != self->cache) && !CacheNVM_discard(self->cache, addr, length))
+    {
+        return 0;
+    }
+
+    return ChanMuxNvmDriver_discard(self->driver, addr, length);
+}
+
+
+//------------------------------------------------------------------------------
+OS_Error_t
+Storage_ChanMux_Core_transferVectored(
+    Storage_ChanMux_Core*         self,
+    Storage_ChanMux_Core_Client*  client,
+    bool                          isWrite,
+    size_t                        listOffset,
+    size_t                        count,
+    const char*                   func)
+{
+    char* const port = client->port;
+    size_t const portSize = client->portSize;
+    size_t const listSize = count * sizeof(Storage_ChanMux_Segment);
+
+    if ((count > Storage_ChanMux_MAX_SEGMENTS)
+        || (0 != (listOffset % _Alignof(Storage_ChanMux_Segment)))
+        || (listOffset > portSize)
+        || (listSize > portSize - listOffset))
+    {
+        Debug_LOG_ERROR(
+            "%s: Invalid segment list: offset = %zu, count = %zu",
+            func,
+            listOffset,
+            count);
+
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    Storage_ChanMux_Segment* const list = (void*) &port[listOffset];
+    size_t const storageSize = Storage_ChanMux_Core_windowSize(self, client);
+    size_t valid = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        // The client can change the list at any time, so each segment is
+        // read once and only the copy is checked and used.
+        Storage_ChanMux_Segment const seg = list[i];
+
+        list[i].done  = 0;
+        list[i].error = OS_ERROR_INVALID_PARAMETER;
+
+        // the data must not overlap the list, a read would overwrite it
+        if (!isInPort(seg.portOffset, seg.length, portSize)
+            || isOverlapping(seg.portOffset, seg.length, listOffset, listSize)
+            || (seg.offset > storageSize)
+            || (seg.length > storageSize - seg.offset))
+        {
+            Debug_LOG_ERROR(
+                "%s: Invalid segment %zu: offset = 0x%" PRIx64 ", "
+                "portOffset = %" PRIu32 ", length = %" PRIu32,
+                func,
+                i,
+                seg.offset,
+                seg.portOffset,
+                seg.length);
+            continue;
+        }
+
+        self->vecSegments[valid].addr   = client->offset + seg.offset;
+        self->vecSegments[valid].buffer = &port[seg.portOffset];
+        self->vecSegments[valid].length = seg.length;
+        self->vecIndex[valid++] = i;
+    }
+
+    uint64_t const start = Storage_ChanMux_TIMESTAMP();
+    runSegments(self, isWrite, valid);
+
+    size_t bytes = 0;
+    bool isOk = (valid == count);
+
+    for (size_t i = 0; i < valid; i++)
+    {
+        size_t const done = self->vecSegments[i].done;
+        OS_Error_t const error = (done == self->vecSegments[i].length)
+                                 ? OS_SUCCESS : OS_ERROR_GENERIC;
+
+        list[self->vecIndex[i]].done  = (uint32_t) done;
+        list[self->vecIndex[i]].error = error;
+        bytes += done;
+        isOk = isOk && (OS_SUCCESS == error);
+    }
+
+    Storage_ChanMux_Core_countOp(self, isWrite ? Storage_ChanMux_OP_WRITE
+                                 : Storage_ChanMux_OP_READ,
+                                 start, bytes, isOk);
+
+    return isOk ? OS_SUCCESS : OS_ERROR_GENERIC;
+}
+
+
+#if Storage_ChanMux_ASYNC
+
+// Service order of the priority classes, highest first
+static Storage_ChanMux_Prio const prioOrder[Storage_ChanMux_PRIO_COUNT] =
+{
+    Storage_ChanMux_PRIO_HIGH,
+    Storage_ChanMux_PRIO_NORMAL,
+    Storage_ChanMux_PRIO_BULK,
+};
+
+// Invalid priorities are rejected when the submission is handled
+static size_t classOf(Storage_ChanMux_Core_Queued const* const q)
+{
+    return (q->sub.priority < Storage_ChanMux_PRIO_COUNT)
+           ? q->sub.priority : Storage_ChanMux_PRIO_NORMAL;
+}
+
+static bool isValidSubmission(
+    Storage_ChanMux_Core*              const self,
+    Storage_ChanMux_Core_Client const* const client,
+    Storage_ChanMux_Submission  const* const sub)
+{
+    size_t const storageSize = Storage_ChanMux_Core_windowSize(self, client);
+    bool const hasData = (Storage_ChanMux_OP_READ == sub->op)
+                         || (Storage_ChanMux_OP_WRITE == sub->op);
+
+    return (hasData || (Storage_ChanMux_OP_ERASE == sub->op)
+            || (Storage_ChanMux_OP_DISCARD == sub->op))
+           && (sub->priority < Storage_ChanMux_PRIO_COUNT)
+           && (!hasData
+               || isInPort(sub->portOffset, sub->length, client->portSize))
+           && (sub->offset <= storageSize)
+           && (sub->length <= storageSize - sub->offset);
+}
+
+// Moves the submissions from the client's ring into its queue, as far as there
+// is room for their completions. Returns the number of queued submissions.
+static size_t fetchSubmissions(Storage_ChanMux_Core_Client* const client)
+{
+    Storage_ChanMux_Rings* const rings = client->rings;
+    uint32_t const subHead  = __atomic_load_n(&rings->subHead, __ATOMIC_ACQUIRE);
+    uint32_t const compTail = __atomic_load_n(&rings->compTail, __ATOMIC_ACQUIRE);
+    uint32_t const subTail  = rings->subTail;
+    uint32_t const pending  = subHead - subTail;
+    uint32_t const used     = rings->compHead - compTail;
+
+    if ((pending > Storage_ChanMux_RING_SIZE)
+        || (used > Storage_ChanMux_RING_SIZE - client->queued))
+    {
+        Debug_LOG_ERROR(
+            "Invalid ring indices: subHead = %" PRIu32 ", compTail = %" PRIu32,
+            subHead,
+            compTail);
+
+        return client->queued;
+    }
+
+    // every queued submission takes up a completion later
+    size_t const room = Storage_ChanMux_RING_SIZE - used - client->queued;
+    size_t const count = (pending < room) ? pending : room;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        Storage_ChanMux_Core_Queued* const q =
+            &client->queue[client->queued++];
+
+        q->sub    = rings->sub[(subTail + i) % Storage_ChanMux_RING_SIZE];
+        q->done   = 0;
+        q->isDone = false;
+    }
+
+    __atomic_store_n(&rings->subTail, subTail + count, __ATOMIC_RELEASE);
+
+    return client->queued;
+}
+
+// Puts the completion of a queued submission into the client's ring
+static void complete(
+    Storage_ChanMux_Core_Client* const client,
+    Storage_ChanMux_Core_Queued* const q,
+    OS_Error_t                   const error)
+{
+    Storage_ChanMux_Rings* const rings = client->rings;
+    uint32_t const compHead = rings->compHead;
+    Storage_ChanMux_Completion* const comp =
+        &rings->comp[compHead % Storage_ChanMux_RING_SIZE];
+
+    comp->userData = q->sub.userData;
+    comp->done     = (uint32_t) q->done;
+    comp->error    = error;
+    q->isDone      = true;
+
+    __atomic_store_n(&rings->compHead, compHead + 1, __ATOMIC_RELEASE);
+}
+
+// True if two submissions must be handled in the order they were submitted,
+// because their ranges of the storage overlap and not both of them are reads.
+static bool isConflicting(
+    Storage_ChanMux_Core_Queued const* const a,
+    Storage_ChanMux_Core_Queued const* const b)
+{
+    uint64_t const offsetA = a->sub.offset;
+    uint64_t const offsetB = b->sub.offset;
+
+    return !a->isDone && !b->isDone
+           && ((Storage_ChanMux_OP_READ != a->sub.op)
+               || (Storage_ChanMux_OP_READ != b->sub.op))
+           && ((offsetA < offsetB)
+               ? ((offsetB - offsetA) < a->sub.length)
+               : ((offsetA - offsetB) < b->sub.length));
+}
+
+// True if the i-th queued submission conflicts with an earlier one that is
+// not part of the unit, which starts at the 'first' one and takes the
+// submissions of class 'prio' after it.
+static bool isBlocked(
+    Storage_ChanMux_Core_Client const* const client,
+    size_t                             const first,
+    size_t                             const i,
+    size_t                             const prio)
+{
+    for (size_t j = 0; j < i; j++)
+    {
+        Storage_ChanMux_Core_Queued const* const q = &client->queue[j];
+
+        if (((j < first) || (classOf(q) != prio))
+            && isConflicting(q, &client->queue[i]))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Returns the queued submission to handle next for the class, NULL if there is
+// none. That is the first one of the class, unless it conflicts with an
+// earlier submission of another class. Then the earliest one it depends on is
+// handled first, whatever its class, so a read of a higher class never
+// overtakes a write to the same range before it.
+static Storage_ChanMux_Core_Queued* firstOfClass(
+    Storage_ChanMux_Core_Client* const client,
+    size_t                       const prio)
+{
+    size_t next = 0;
+
+    while ((next < client->queued) && (classOf(&client->queue[next]) != prio))
+    {
+        next++;
+    }
+
+    if (next == client->queued)
+    {
+        return NULL;
+    }
+
+    // the earlier one may depend on others in turn
+    size_t i = 0;
+
+    while (i < next)
+    {
+        if (isConflicting(&client->queue[i], &client->queue[next]))
+        {
+            next = i;
+            i = 0;
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    return &client->queue[next];
+}
+
+// Bytes of the next unit of the submission. Discards and native erases count
+// as a full unit as they keep the proxy busy rather than the link, an erase
+// done by writing 0xFF counts the bytes it writes.
+static size_t unitCost(
+    Storage_ChanMux_Core*              const self,
+    Storage_ChanMux_Core_Queued const* const q)
+{
+    size_t const left = q->sub.length - q->done;
+
+    return ((Storage_ChanMux_OP_DISCARD == q->sub.op)
+            || ((Storage_ChanMux_OP_ERASE == q->sub.op)
+                && isEraseNative(self))
+            || (left > Storage_ChanMux_UNIT))
+           ? Storage_ChanMux_UNIT : left;
+}
+
+// Picks the priority class of the next unit, the highest one with queued
+// submissions unless a lower one waited for Storage_ChanMux_STARVE_LIMIT
+// units. Returns Storage_ChanMux_PRIO_COUNT if nothing is queued.
+static size_t pickClass(Storage_ChanMux_Core* const self)
+{
+    bool has[Storage_ChanMux_PRIO_COUNT] = { false };
+    size_t chosen = Storage_ChanMux_PRIO_COUNT;
+
+    for (size_t c = 0; c < Storage_ChanMux_CLIENTS; c++)
+    {
+        for (size_t i = 0; i < self->clients[c].queued; i++)
+        {
+            has[classOf(&self->clients[c].queue[i])] = true;
+        }
+    }
+
+    for (size_t i = 0; i < Storage_ChanMux_PRIO_COUNT; i++)
+    {
+        size_t const prio = prioOrder[i];
+
+        if (!has[prio])
+        {
+            self->waited[prio] = 0;
+        }
+        else if ((Storage_ChanMux_PRIO_COUNT == chosen)
+                 || ((self->waited[prio] >= Storage_ChanMux_STARVE_LIMIT)
+                     && (self->waited[prio] > self->waited[chosen])))
+        {
+            chosen = prio;
+        }
+    }
+
+    for (size_t prio = 0; prio < Storage_ChanMux_PRIO_COUNT; prio++)
+    {
+        self->waited[prio] = (prio == chosen) ? 0
+                             : has[prio] ? (self->waited[prio] + 1) : 0;
+    }
+
+    return chosen;
+}
+
+
+//------------------------------------------------------------------------------
+size_t
+Storage_ChanMux_Core_fetchSubmissions(
+    Storage_ChanMux_Core*  self)
+{
+    size_t queued = 0;
+
+    for (size_t i = 0; i < Storage_ChanMux_CLIENTS; i++)
+    {
+        queued += fetchSubmissions(&self->clients[i]);
+    }
+
+    return queued;
+}
+
+
+//------------------------------------------------------------------------------
+// Deficit round robin among the clients with submissions of the class. A
+// client keeps its turn as long as its deficit covers the next unit, a client
+// without submissions doesn't save up shares for later.
+Storage_ChanMux_Core_Client*
+Storage_ChanMux_Core_pickClient(
+    Storage_ChanMux_Core*  self,
+    size_t*                prio)
+{
+    *prio = pickClass(self);
+
+    for (;;)
+    {
+        Storage_ChanMux_Core_Client* const client =
+            &self->clients[self->nextClient];
+        Storage_ChanMux_Core_Queued const* const q =
+            firstOfClass(client, *prio);
+
+        if (NULL != q)
+        {
+            if (client->deficit >= unitCost(self, q))
+            {
+                return client;
+            }
+            client->deficit += client->weight * Storage_ChanMux_QUANTUM;
+        }
+        else if (0 == client->queued)
+        {
+            client->deficit = 0;
+        }
+
+        self->nextClient = (self->nextClient + 1) % Storage_ChanMux_CLIENTS;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// A unit is a piece of an erase, a discard, or reads or writes of up to
+// Storage_ChanMux_UNIT bytes batched like a readv() or writev(). Only the
+// first one may be done in pieces. If the first submission of the class has to
+// wait for an earlier one of another class, the unit is one of that class, see
+// firstOfClass().
+size_t
+Storage_ChanMux_Core_runUnit(
+    Storage_ChanMux_Core*         self,
+    Storage_ChanMux_Core_Client*  client,
+    size_t                        chosen)
+{
+    Nvm* const storage = self->storage;
+    char* const port = client->port;
+    Storage_ChanMux_Core_Queued* const head = firstOfClass(client, chosen);
+    size_t const prio = classOf(head);
+    size_t const first = (size_t) (head - client->queue);
+    uint32_t const op = head->sub.op;
+    uint64_t const start = Storage_ChanMux_TIMESTAMP();
+
+    if (!isValidSubmission(self, client, &head->sub))
+    {
+        Debug_LOG_ERROR(
+            "Invalid submission: op = %" PRIu32 ", offset = 0x%" PRIx64 ", "
+            "portOffset = %" PRIu32 ", length = %" PRIu32 ", "
+            "priority = %" PRIu32,
+            op,
+            head->sub.offset,
+            head->sub.portOffset,
+            head->sub.length,
+            head->sub.priority);
+
+        complete(client, head, OS_ERROR_INVALID_PARAMETER);
+        return 0;
+    }
+
+    if (Storage_ChanMux_OP_ERASE == op)
+    {
+        size_t const unit = Storage_ChanMux_Core_eraseUnit(self);
+        size_t const left = head->sub.length - head->done;
+        size_t const len = (left < unit) ? left : unit;
+        size_t const done = storage->vtable->erase(
+                                storage,
+                                client->offset + head->sub.offset + head->done,
+                                len);
+
+        head->done += done;
+        Storage_ChanMux_Core_countOp(self, op, start, done, (done == len));
+
+        if (done != len)
+        {
+            complete(client, head, OS_ERROR_GENERIC);
+        }
+        else if (head->done == head->sub.length)
+        {
+            complete(client, head, OS_SUCCESS);
+        }
+        return isEraseNative(self) ? Storage_ChanMux_UNIT : len;
+    }
+
+    if (Storage_ChanMux_OP_DISCARD == op)
+    {
+        size_t const len = head->sub.length;
+
+        head->done = Storage_ChanMux_Core_discard(
+                         self, client->offset + head->sub.offset, len);
+        Storage_ChanMux_Core_countOp(self, op, start, head->done,
+                                     (head->done == len));
+        complete(client, head,
+                 (head->done == len) ? OS_SUCCESS : OS_ERROR_GENERIC);
+        return Storage_ChanMux_UNIT;
+    }
+
+    size_t budget = Storage_ChanMux_UNIT;
+    size_t valid = 0;
+
+    // Submissions of other classes are passed over, but the ones of the class
+    // stay in order, and the batch ends at one that conflicts with a
+    // submission passed over.
+    for (size_t i = first;
+         (i < client->queued) && (valid < Storage_ChanMux_MAX_SEGMENTS)
+         && (budget > 0);
+         i++)
+    {
+        Storage_ChanMux_Core_Queued const* const q = &client->queue[i];
+        size_t const left = q->sub.length - q->done;
+
+        if (classOf(q) != prio)
+        {
+            continue;
+        }
+        if ((q->sub.op != op)
+            || ((valid > 0)
+                && ((left > budget)
+                    || !isValidSubmission(self, client, &q->sub)
+                    || isBlocked(client, first, i, prio))))
+        {
+            break;
+        }
+
+        self->vecSegments[valid].addr   = client->offset + q->sub.offset
+                                          + q->done;
+        self->vecSegments[valid].buffer = &port[q->sub.portOffset + q->done];
+        self->vecSegments[valid].length = (left < budget) ? left : budget;
+        self->vecIndex[valid++] = i;
+        budget -= (left < budget) ? left : budget;
+    }
+
+    size_t bytes = 0;
+    bool isOk = true;
+
+    runSegments(self, (Storage_ChanMux_OP_WRITE == op), valid);
+
+    for (size_t i = 0; i < valid; i++)
+    {
+        Storage_ChanMux_Core_Queued* const q =
+            &client->queue[self->vecIndex[i]];
+        ProxyNVM_Segment const* const seg = &self->vecSegments[i];
+
+        q->done += seg->done;
+        bytes += seg->done;
+
+        if (seg->done != seg->length)
+        {
+            isOk = false;
+            complete(client, q, OS_ERROR_GENERIC);
+        }
+        else if (q->done == q->sub.length)
+        {
+            complete(client, q, OS_SUCCESS);
+        }
+    }
+
+    Storage_ChanMux_Core_countOp(self, op, start, bytes, isOk);
+
+    return Storage_ChanMux_UNIT - budget;
+}
+
+
+//------------------------------------------------------------------------------
+bool
+Storage_ChanMux_Core_retireUnit(
+    DECL_UNUSED_VAR(Storage_ChanMux_Core* self),
+    Storage_ChanMux_Core_Client*  client,
+    size_t                        cost)
+{
+    client->deficit -= (cost < client->deficit) ? cost : client->deficit;
+
+    size_t kept = 0;
+
+    for (size_t i = 0; i < client->queued; i++)
+    {
+        if (!client->queue[i].isDone)
+        {
+            client->queue[kept++] = client->queue[i];
+        }
+    }
+
+    bool const isDropped = (kept < client->queued);
+    client->queued = kept;
+
+    return isDropped;
+}
+
+#endif /* Storage_ChanMux_ASYNC */
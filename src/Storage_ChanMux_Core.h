@@ -0,0 +1,253 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+/**
+ * @file
+ *
+ * @brief the part of the ChanMux storage component that does not depend on
+ *  CAmkES: the windows of the clients, copies, discards, vectored transfers
+ *  and the scheduler of the submissions. The component passes it the
+ *  dataports of the clients and serializes the calls with its mutex. It is
+ *  built on the host as well, see tools/proxy_nvm_host.
+ *
+ */
+#pragma once
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "ChanMuxNvmDriver.h"
+#include "CacheNVM.h"
+#include "Storage_ChanMux.h"
+#include "OS_Error.h"
+
+
+/* Exported macro ------------------------------------------------------------*/
+
+// Take requests from the submission ring as well, requires a component defined
+// with Storage_ChanMux_ASYNC_COMPONENT_DEFINE().
+#if !defined(Storage_ChanMux_ASYNC)
+#   define Storage_ChanMux_ASYNC            0
+#endif
+
+// Number of clients, each with its own dataport and rings. With more than one,
+// the RPC connections of client n carry the badge
+// Storage_ChanMux_CLIENT_BADGE_BASE + n.
+#if !defined(Storage_ChanMux_CLIENTS)
+#   define Storage_ChanMux_CLIENTS          1
+#endif
+#if (Storage_ChanMux_CLIENTS < 1) || (Storage_ChanMux_CLIENTS > 4)
+#   error "Storage_ChanMux_CLIENTS must be between 1 and 4"
+#endif
+
+// Bulk requests are broken into units, so that more urgent ones can be handled
+// in between. A unit reads or writes at most Storage_ChanMux_UNIT bytes, by
+// default as much as the pipeline to the proxy holds, or erases at most
+// Storage_ChanMux_ERASE_UNIT bytes. A proxy without a native erase gets 0xFF
+// written, then an erase unit is as long as one of writes.
+#if !defined(Storage_ChanMux_UNIT)
+#   define Storage_ChanMux_UNIT             (ChanMuxNvmDriver_FRAME_SIZE \
+                                             * ProxyNVM_PIPELINE_WINDOW)
+#endif
+#if !defined(Storage_ChanMux_ERASE_UNIT)
+#   define Storage_ChanMux_ERASE_UNIT       (1024 * 1024)
+#endif
+
+// Per round, a client may have Storage_ChanMux_QUANTUM bytes per weight read,
+// written or erased, unused shares carry over while it has submissions.
+#if !defined(Storage_ChanMux_QUANTUM)
+#   define Storage_ChanMux_QUANTUM          Storage_ChanMux_UNIT
+#endif
+
+// Submissions of a higher priority class are handled first, but a class that
+// waited for this many units gets the next one. This guarantees each class a
+// minimum share.
+#if !defined(Storage_ChanMux_STARVE_LIMIT)
+#   define Storage_ChanMux_STARVE_LIMIT     4
+#endif
+
+// Time source for the latency counters. The time stamp counter can be read
+// from user mode on x86, other platforms can define one returning uint64_t
+// ticks. Without one the latencies are reported as 0.
+#if !defined(Storage_ChanMux_TIMESTAMP)
+#   if defined(__x86_64__) || defined(__i386__)
+#       define Storage_ChanMux_TIMESTAMP()  __builtin_ia32_rdtsc()
+#   else
+#       define Storage_ChanMux_TIMESTAMP()  0
+#   endif
+#endif
+
+
+/* Exported types ------------------------------------------------------------*/
+
+#if Storage_ChanMux_ASYNC
+// Submission taken from a client's ring that is not completed yet
+typedef struct
+{
+    Storage_ChanMux_Submission  sub;
+    size_t                      done;   //!< bytes handled so far
+    bool                        isDone; //!< the completion is posted
+} Storage_ChanMux_Core_Queued;
+#endif
+
+typedef struct
+{
+    char*           port;       //!< the client's storage dataport
+    size_t          portSize;
+#if Storage_ChanMux_ASYNC
+    Storage_ChanMux_Rings* rings; //!< in the client's ring dataport
+    size_t          deficit;    //!< bytes it may still have handled
+    Storage_ChanMux_Core_Queued queue[Storage_ChanMux_RING_SIZE]; //!< in ring
+                                                                  //!< order
+    size_t          queued;
+#endif
+    size_t          offset;     //!< start of the window on the storage
+    size_t          size;       //!< size of the window, 0 up to the end
+    size_t          weight;
+} Storage_ChanMux_Core_Client;
+
+typedef struct
+{
+    ChanMuxNvmDriver*   driver;
+    CacheNVM*           cache;      //!< NULL without a cache
+    Nvm*                storage;    //!< the cache if there is one
+    Storage_ChanMux_Core_Client clients[Storage_ChanMux_CLIENTS];
+    Storage_ChanMux_OpStats     opStats[Storage_ChanMux_OP_COUNT];
+#if Storage_ChanMux_ASYNC
+    size_t              nextClient; //!< client whose turn it is
+    size_t              waited[Storage_ChanMux_PRIO_COUNT]; //!< units
+#endif
+    // segments of a readv() or writev() that passed the checks, and their
+    // index in the client's list or queue
+    ProxyNVM_Segment    vecSegments[Storage_ChanMux_MAX_SEGMENTS];
+    size_t              vecIndex[Storage_ChanMux_MAX_SEGMENTS];
+    // segments of a readv() the write-through cache can't serve, and their
+    // index in vecSegments
+    ProxyNVM_Segment    missSegments[Storage_ChanMux_MAX_SEGMENTS];
+    size_t              missIndex[Storage_ChanMux_MAX_SEGMENTS];
+    // data of a copy passes through it if the proxy can't copy itself
+    char                copyBuf[ChanMuxNvmDriver_FRAME_SIZE];
+} Storage_ChanMux_Core;
+
+
+/* Exported functions ------------------------------------------------------- */
+/**
+ * @brief constructor.
+ *
+ * The clients are set up by the caller afterwards, a weight of 0 counts as 1.
+ *
+ * @param self pointer to the core
+ * @param driver the constructed driver
+ * @param cache a CacheNVM on top of the driver's Nvm, or NULL
+ *
+ * @return true if success
+ *
+ */
+bool
+Storage_ChanMux_Core_ctor(Storage_ChanMux_Core* self, ChanMuxNvmDriver* driver,
+                          CacheNVM* cache);
+/**
+ * @brief size of the client's window, it ends at the end of the storage at the
+ *  latest.
+ *
+ */
+size_t
+Storage_ChanMux_Core_windowSize(Storage_ChanMux_Core* self,
+                                Storage_ChanMux_Core_Client const* client);
+/**
+ * @brief true if [offset, offset + length) lies within the client's window.
+ *
+ */
+bool
+Storage_ChanMux_Core_isInWindow(Storage_ChanMux_Core* self,
+                                Storage_ChanMux_Core_Client const* client,
+                                size_t offset, size_t length);
+/**
+ * @brief adds an operation to the counters, start is the time stamp taken
+ *  before it.
+ *
+ */
+void
+Storage_ChanMux_Core_countOp(Storage_ChanMux_Core* self, Storage_ChanMux_Op op,
+                             uint64_t start, size_t bytes, bool isOk);
+/**
+ * @brief bytes of the storage erased in one piece.
+ *
+ */
+size_t
+Storage_ChanMux_Core_eraseUnit(Storage_ChanMux_Core* self);
+/**
+ * @brief copies within the storage, by the proxy if it supports it.
+ *
+ * @return the bytes copied from the start, 0 if copying from the end failed
+ *
+ */
+size_t
+Storage_ChanMux_Core_copy(Storage_ChanMux_Core* self, size_t dst, size_t src,
+                          size_t length);
+/**
+ * @brief discards a range of the storage. Dirty data of it in the write-back
+ *  cache is dropped rather than written.
+ *
+ * @return the bytes discarded
+ *
+ */
+size_t
+Storage_ChanMux_Core_discard(Storage_ChanMux_Core* self, size_t addr,
+                             size_t length);
+/**
+ * @brief does the readv() or writev() of the client with the segment list at
+ *  listOffset in its dataport, and fills in the results of the segments.
+ *
+ * @return OS_SUCCESS if all segments were valid and fully transferred
+ *
+ */
+OS_Error_t
+Storage_ChanMux_Core_transferVectored(Storage_ChanMux_Core* self,
+                                      Storage_ChanMux_Core_Client* client,
+                                      bool isWrite, size_t listOffset,
+                                      size_t count, const char* func);
+
+#if Storage_ChanMux_ASYNC
+/**
+ * @brief moves the submissions from the rings of the clients into their
+ *  queues, as far as there is room for their completions.
+ *
+ * @return the number of queued submissions of all clients
+ *
+ */
+size_t
+Storage_ChanMux_Core_fetchSubmissions(Storage_ChanMux_Core* self);
+/**
+ * @brief picks the priority class and the client of the next unit, there
+ *  must be queued submissions.
+ *
+ */
+Storage_ChanMux_Core_Client*
+Storage_ChanMux_Core_pickClient(Storage_ChanMux_Core* self, size_t* prio);
+/**
+ * @brief handles the next unit of the client's submissions of the class, and
+ *  posts the completions of those that are done.
+ *
+ * @return the number of bytes of the unit
+ *
+ */
+size_t
+Storage_ChanMux_Core_runUnit(Storage_ChanMux_Core* self,
+                             Storage_ChanMux_Core_Client* client, size_t prio);
+/**
+ * @brief charges the client for a unit of cost bytes and removes its
+ *  completed submissions from its queue.
+ *
+ * @return true if completions were posted, the client is to be notified then
+ *
+ */
+bool
+Storage_ChanMux_Core_retireUnit(Storage_ChanMux_Core* self,
+                                Storage_ChanMux_Core_Client* client,
+                                size_t cost);
+#endif
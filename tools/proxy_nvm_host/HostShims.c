@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+// Host build stand-ins for the SDK library functions the drivers use.
+
+/* Includes ------------------------------------------------------------------*/
+#include "lib_utils/BitConverter.h"
+
+/* Public functions ----------------------------------------------------------*/
+
+void
+BitConverter_putUint32BE(uint32_t value, void* buffer)
+{
+    uint8_t* const p = buffer;
+
+    p[0] = (uint8_t)(value >> 24);
+    p[1] = (uint8_t)(value >> 16);
+    p[2] = (uint8_t)(value >> 8);
+    p[3] = (uint8_t)(value);
+}
+
+uint32_t
+BitConverter_getUint32BE(void const* buffer)
+{
+    uint8_t const* const p = buffer;
+
+    return ((uint32_t)p[0] << 24)
+           | ((uint32_t)p[1] << 16)
+           | ((uint32_t)p[2] << 8)
+           | ((uint32_t)p[3]);
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+// ChanMuxClient on top of a file descriptor, see include/ChanMux/ChanMuxClient.h
+
+/* Includes ------------------------------------------------------------------*/
+#include "ChanMux/ChanMuxClient.h"
+#include "lib_debug/Debug.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Public functions ----------------------------------------------------------*/
+
+bool
+ChanMuxClient_ctor(
+    ChanMuxClient*                self,
+    const ChanMuxClientConfig_t*  config)
+{
+    Debug_ASSERT_SELF(self);
+    Debug_ASSERT(config != NULL);
+
+    memset(self, 0, sizeof(*self));
+    self->fd = config->fd;
+
+    return (self->fd >= 0);
+}
+
+void
+ChanMuxClient_dtor(
+    ChanMuxClient*  self)
+{
+    Debug_ASSERT_SELF(self);
+
+    // the descriptor belongs to whoever set up the channel
+    self->fd = -1;
+}
+
+OS_Error_t
+ChanMuxClient_write(
+    ChanMuxClient*  self,
+    const void*     buf,
+    size_t          len,
+    size_t*         written)
+{
+    char const* p = buf;
+    size_t done = 0;
+
+    Debug_ASSERT_SELF(self);
+
+    self->writes++;
+
+    while (done < len)
+    {
+        ssize_t const ret = write(self->fd, &p[done], len - done);
+        if (ret < 0)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+            Debug_LOG_ERROR("write() failed: %s", strerror(errno));
+            break;
+        }
+        done += (size_t) ret;
+    }
+
+    self->bytesWritten += done;
+    *written = done;
+
+    return (done == len) ? OS_SUCCESS : OS_ERROR_GENERIC;
+}
+
+OS_Error_t
+ChanMuxClient_read(
+    ChanMuxClient*  self,
+    void*           buf,
+    size_t          len,
+    size_t*         readBytes)
+{
+    char* p = buf;
+    size_t done = 0;
+
+    Debug_ASSERT_SELF(self);
+
+    self->reads++;
+
+    while (done < len)
+    {
+        ssize_t const ret = read(self->fd, &p[done], len - done);
+        if (ret < 0)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+            Debug_LOG_ERROR("read() failed: %s", strerror(errno));
+            break;
+        }
+        if (0 == ret)
+        {
+            Debug_LOG_ERROR("channel closed");
+            break;
+        }
+        done += (size_t) ret;
+    }
+
+    self->bytesRead += done;
+    *readBytes = done;
+
+    return (done == len) ? OS_SUCCESS : OS_ERROR_GENERIC;
+}
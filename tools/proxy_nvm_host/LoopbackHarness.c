@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "LoopbackHarness.h"
+#include "lib_debug/Debug.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/* Private functions prototypes ----------------------------------------------*/
+static void* serverThread(void* arg);
+
+/* Public functions ----------------------------------------------------------*/
+
+bool
+LoopbackHarness_ctor(
+    LoopbackHarness*             self,
+    ProxyNvmServer_Config const* serverConfig,
+    SimLink_Config const*        linkConfig)
+{
+    Debug_ASSERT_SELF(self);
+    Debug_ASSERT(serverConfig != NULL);
+
+    int client[2];
+    int server[2] = { -1, -1 };
+
+    memset(self, 0, sizeof(*self));
+
+    // a peer that goes away must show up as a failed write, not kill us
+    signal(SIGPIPE, SIG_IGN);
+
+    if (!ProxyNvmServer_ctor(&self->server, serverConfig))
+    {
+        return false;
+    }
+
+    if (0 != socketpair(AF_UNIX, SOCK_STREAM, 0, client))
+    {
+        Debug_LOG_ERROR("socketpair() failed: %s", strerror(errno));
+        goto err_server;
+    }
+
+    self->chanMuxConfig.fd = client[0];
+    self->serverFd = client[1];
+
+    if (NULL != linkConfig)
+    {
+        if (0 != socketpair(AF_UNIX, SOCK_STREAM, 0, server))
+        {
+            Debug_LOG_ERROR("socketpair() failed: %s", strerror(errno));
+            goto err_client;
+        }
+
+        self->linkFds[0] = client[1];
+        self->linkFds[1] = server[0];
+        self->serverFd = server[1];
+        self->isLinkSimulated = true;
+
+        if (!SimLink_ctor(&self->link, linkConfig, self->linkFds[0],
+                          self->linkFds[1]))
+        {
+            goto err_link;
+        }
+    }
+
+    if (0 != pthread_create(&self->serverThread, NULL, serverThread, self))
+    {
+        Debug_LOG_ERROR("pthread_create() failed");
+        // a started link ends when the descriptors are closed
+        shutdown(client[0], SHUT_RDWR);
+        shutdown(self->serverFd, SHUT_RDWR);
+        if (self->isLinkSimulated)
+        {
+            SimLink_dtor(&self->link);
+        }
+        goto err_link;
+    }
+
+    return true;
+
+err_link:
+    if (server[0] >= 0)
+    {
+        close(server[0]);
+        close(server[1]);
+    }
+err_client:
+    close(client[0]);
+    close(client[1]);
+err_server:
+    ProxyNvmServer_dtor(&self->server);
+    return false;
+}
+
+void
+LoopbackHarness_dtor(LoopbackHarness* self)
+{
+    Debug_ASSERT_SELF(self);
+
+    // The server sees the end of the stream and returns, the link shuts down
+    // each direction once it has delivered everything.
+    shutdown(self->chanMuxConfig.fd, SHUT_WR);
+    pthread_join(self->serverThread, NULL);
+    shutdown(self->serverFd, SHUT_WR);
+
+    if (self->isLinkSimulated)
+    {
+        SimLink_dtor(&self->link);
+        close(self->linkFds[0]);
+        close(self->linkFds[1]);
+    }
+
+    close(self->serverFd);
+    close(self->chanMuxConfig.fd);
+    ProxyNvmServer_dtor(&self->server);
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+static void* serverThread(void* arg)
+{
+    LoopbackHarness* const self = arg;
+
+    if (!ProxyNvmServer_serve(&self->server, self->serverFd))
+    {
+        Debug_LOG_ERROR("server stopped in the middle of a request");
+    }
+
+    return NULL;
+}
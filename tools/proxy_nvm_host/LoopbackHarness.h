@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+/**
+ * @file
+ *
+ * @brief wires a ProxyNvmServer to a channel descriptor for the loopback
+ *  ChanMuxClient, optionally through a SimLink:
+ *
+ *  ChanMuxClient <-> socketpair [<-> SimLink <-> socketpair] <-> server thread
+ *
+ */
+#pragma once
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "ProxyNvmServer.h"
+#include "SimLink.h"
+#include "ChanMux/ChanMuxClient.h"
+
+#include <pthread.h>
+
+
+/* Exported types ------------------------------------------------------------*/
+
+typedef struct
+{
+    ProxyNvmServer  server;
+    SimLink         link;
+    bool            isLinkSimulated;
+    int             serverFd;
+    int             linkFds[2];
+    pthread_t       serverThread;
+
+    ChanMuxClientConfig_t chanMuxConfig;    //!< for ChanMuxNvmDriver_ctor()
+} LoopbackHarness;
+
+
+/* Exported functions ------------------------------------------------------- */
+/**
+ * @brief constructor, starts the server.
+ *
+ * @param self pointer to the harness
+ * @param serverConfig configuration of the reference proxy
+ * @param linkConfig link to simulate, NULL connects the client directly
+ *
+ * @return true if success
+ *
+ */
+bool
+LoopbackHarness_ctor(
+    LoopbackHarness*             self,
+    ProxyNvmServer_Config const* serverConfig,
+    SimLink_Config const*        linkConfig);
+
+/**
+ * @brief closes the channel and waits for the server to finish. The client
+ *  must not use the channel any more.
+ *
+ */
+void
+LoopbackHarness_dtor(LoopbackHarness* self);
@@ -0,0 +1,919 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#define _GNU_SOURCE // fallocate()
+
+#include "ProxyNvmServer.h"
+#include "ProxyNVM.h"
+#include "ProxyNVM_Protocol.h"
+
+#include "lib_debug/Debug.h"
+#include "lib_utils/BitConverter.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Defines -------------------------------------------------------------------*/
+#define DROP_BUF_SIZE           (64 * 1024)
+
+/* Private types -------------------------------------------------------------*/
+
+typedef enum
+{
+    RECV_OK,
+    RECV_CLOSED,    // channel closed before the first byte
+    RECV_FAILED
+} RecvResult;
+
+/* Private functions prototypes ----------------------------------------------*/
+static bool handleRequest(ProxyNvmServer* self, int fd, bool* isClosed);
+static bool handleTransfer(ProxyNvmServer* self, int fd, uint8_t command,
+                           bool isTagged, bool isCompressed, bool isFill);
+static bool recvCompressed(ProxyNvmServer* self, int fd, int8_t* retval,
+                           size_t addr, size_t length);
+static bool sendCompressed(ProxyNvmServer* self, int fd, uint8_t first,
+                           bool isTagged, uint8_t tag, size_t addr,
+                           size_t length);
+static bool isFilled(ProxyNvmServer* self, size_t addr, size_t length);
+static bool handleVectored(ProxyNvmServer* self, int fd, uint8_t command,
+                           bool isTagged);
+static bool handleErase(ProxyNvmServer* self, int fd);
+static bool handleGetHashes(ProxyNvmServer* self, int fd);
+static bool handleCopy(ProxyNvmServer* self, int fd);
+static bool handleDiscard(ProxyNvmServer* self, int fd);
+static bool handleSetFrameSize(ProxyNvmServer* self, int fd);
+static bool handleSync(ProxyNvmServer* self, int fd);
+static bool handleHello(ProxyNvmServer* self, int fd);
+static bool handleSetAddressSize(ProxyNvmServer* self, int fd);
+static int8_t checkRange(ProxyNvmServer* self, size_t addr, size_t length);
+static bool sendResponse(ProxyNvmServer* self, int fd, uint8_t command,
+                         int8_t retval, size_t bytes, bool isTagged,
+                         uint8_t tag, void const* payload);
+static void putField(ProxyNvmServer* self, uint8_t* field, size_t value);
+static size_t getField(ProxyNvmServer* self, uint8_t const* field);
+static bool dropPayload(ProxyNvmServer* self, int fd, size_t length);
+static RecvResult recvAll(ProxyNvmServer* self, int fd, void* buf,
+                          size_t len);
+static bool sendAll(ProxyNvmServer* self, int fd, void const* buf,
+                    size_t len);
+
+/* Public functions ----------------------------------------------------------*/
+
+bool
+ProxyNvmServer_ctor(ProxyNvmServer* self, ProxyNvmServer_Config const* config)
+{
+    Debug_ASSERT_SELF(self);
+    Debug_ASSERT(config != NULL);
+
+    memset(self, 0, sizeof(*self));
+    self->config    = *config;
+    self->frameSize = config->maxFrameSize;
+    self->fieldSize = ADDRESS_SIZE;
+    self->imageFd   = open(config->imagePath, O_RDWR | O_CREAT, 0644);
+
+    if (self->imageFd < 0)
+    {
+        Debug_LOG_ERROR("open(%s) failed: %s", config->imagePath,
+                        strerror(errno));
+        return false;
+    }
+
+    if ((config->imageSize > 0)
+        && (0 != ftruncate(self->imageFd, (off_t) config->imageSize)))
+    {
+        Debug_LOG_ERROR("ftruncate() failed: %s", strerror(errno));
+        goto err_close;
+    }
+
+    struct stat st;
+    if (0 != fstat(self->imageFd, &st))
+    {
+        Debug_LOG_ERROR("fstat() failed: %s", strerror(errno));
+        goto err_close;
+    }
+    self->size = (size_t) st.st_size;
+
+    if (0 == self->size)
+    {
+        Debug_LOG_ERROR("image size %zu not supported", self->size);
+        goto err_close;
+    }
+
+    self->image = mmap(NULL, self->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                       self->imageFd, 0);
+    if (MAP_FAILED == self->image)
+    {
+        Debug_LOG_ERROR("mmap() failed: %s", strerror(errno));
+        goto err_close;
+    }
+
+    self->buf = malloc(DROP_BUF_SIZE);
+    if (NULL == self->buf)
+    {
+        Debug_LOG_ERROR("malloc() failed");
+        goto err_unmap;
+    }
+
+    return true;
+
+err_unmap:
+    munmap(self->image, self->size);
+err_close:
+    close(self->imageFd);
+    return false;
+}
+
+bool
+ProxyNvmServer_serve(ProxyNvmServer* self, int fd)
+{
+    Debug_ASSERT_SELF(self);
+
+    bool isClosed = false;
+
+    while (handleRequest(self, fd, &isClosed))
+    {
+        self->requests++;
+    }
+
+    return isClosed;
+}
+
+void
+ProxyNvmServer_dtor(ProxyNvmServer* self)
+{
+    Debug_ASSERT_SELF(self);
+
+    free(self->buf);
+    msync(self->image, self->size, MS_SYNC);
+    munmap(self->image, self->size);
+    close(self->imageFd);
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+static bool handleRequest(ProxyNvmServer* self, int fd, bool* isClosed)
+{
+    uint32_t const features = self->config.features;
+    uint8_t first;
+
+    switch (recvAll(self, fd, &first, 1))
+    {
+    case RECV_OK:
+        break;
+    case RECV_CLOSED:
+        *isClosed = true;
+        return false;
+    default:
+        return false;
+    }
+
+    uint8_t const command = first & COMMAND_MASK;
+    bool const isTagged = (0 != (first & TAG_FLAG));
+    bool const isCompressed = (0 != (first & COMPRESSED_FLAG));
+    bool const isFill = (0 != (first & FILL_FLAG));
+
+    if ((isTagged && !(features & ProxyNVM_FEATURE_TAGGED))
+        || (isCompressed && (!(features & ProxyNVM_FEATURE_COMPRESSION)
+                             || ((COMMAND_READ != command)
+                                 && (COMMAND_WRITE != command))))
+        || (isFill && (!(features & ProxyNVM_FEATURE_FILL)
+                       || (COMMAND_READ != command))))
+    {
+        // like an old proxy, which doesn't know the command
+        return sendResponse(self, fd, first, RET_GENERIC_ERR, 0, false, 0,
+                            NULL);
+    }
+
+    switch (command)
+    {
+    case COMMAND_GET_SIZE:
+        // without 64 bit fields, only the first 4 GiB are accessible
+        return sendResponse(self, fd, command, RET_OK,
+                            ((ADDRESS_SIZE == self->fieldSize)
+                             && (self->size > UINT32_MAX))
+                            ? UINT32_MAX : self->size, false, 0, NULL);
+
+    case COMMAND_WRITE:
+    case COMMAND_READ:
+        return handleTransfer(self, fd, command, isTagged, isCompressed,
+                              isFill);
+
+    case COMMAND_READV:
+    case COMMAND_WRITEV:
+        if (features & ProxyNVM_FEATURE_VECTORED)
+        {
+            return handleVectored(self, fd, command, isTagged);
+        }
+        break;
+
+    case COMMAND_ERASE:
+        if (features & ProxyNVM_FEATURE_ERASE)
+        {
+            return handleErase(self, fd);
+        }
+        break;
+
+    case COMMAND_GET_HASHES:
+        if (features & ProxyNVM_FEATURE_HASHES)
+        {
+            return handleGetHashes(self, fd);
+        }
+        break;
+
+    case COMMAND_COPY:
+        if (features & ProxyNVM_FEATURE_COPY)
+        {
+            return handleCopy(self, fd);
+        }
+        break;
+
+    case COMMAND_DISCARD:
+        if (features & ProxyNVM_FEATURE_DISCARD)
+        {
+            return handleDiscard(self, fd);
+        }
+        break;
+
+    case COMMAND_HELLO:
+        if (self->config.maxOutstanding > 0)
+        {
+            return handleHello(self, fd);
+        }
+        break;
+
+    case COMMAND_SET_ADDRESS_SIZE:
+        if (features & ProxyNVM_FEATURE_WIDE)
+        {
+            return handleSetAddressSize(self, fd);
+        }
+        break;
+
+    case COMMAND_GET_FEATURES:
+        if (0 != features)
+        {
+            return sendResponse(self, fd, command, RET_OK, features, false,
+                                0, NULL);
+        }
+        break;
+
+    case COMMAND_SET_FRAME_SIZE:
+        if (features & ProxyNVM_FEATURE_FRAME_SIZE)
+        {
+            return handleSetFrameSize(self, fd);
+        }
+        break;
+
+    case COMMAND_SYNC:
+        if (features & ProxyNVM_FEATURE_SYNC)
+        {
+            return handleSync(self, fd);
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    // Unknown commands fail without reading further, the client can't send
+    // anything after them that the server would understand anyway.
+    Debug_LOG_WARNING("unsupported command 0x%02x", first);
+    return sendResponse(self, fd, first, RET_GENERIC_ERR, 0, false, 0, NULL);
+}
+
+// A compressed write carries compressed data, a compressed read allows to
+// send compressed data and a fill read allows to send a fill response.
+static bool handleTransfer(ProxyNvmServer* self, int fd, uint8_t command,
+                           bool isTagged, bool isCompressed, bool isFill)
+{
+    size_t const f = self->fieldSize;
+    uint8_t hdr[MAX_REQUEST_HEADER_LEN + TAG_LEN];
+    size_t const hdrLen = REQ_HEADER_LEN_OF(f) - 1 + (isTagged ? TAG_LEN : 0);
+
+    if (RECV_OK != recvAll(self, fd, &hdr[REQ_ADDR_INDEX], hdrLen))
+    {
+        return false;
+    }
+
+    size_t const addr = getField(self, &hdr[REQ_ADDR_INDEX]);
+    size_t const length = getField(self, &hdr[REQ_LEN_INDEX_OF(f)]);
+    uint8_t const tag = isTagged ? hdr[REQ_HEADER_LEN_OF(f)] : 0;
+    size_t const hdrRoom = (COMMAND_READ == command)
+                           ? (RESP_HEADER_LEN_OF(f) + TAG_LEN)
+                           : (REQ_HEADER_LEN_OF(f) + TAG_LEN);
+    int8_t retval = checkRange(self, addr, length);
+
+    if ((RET_OK == retval) && (length > self->frameSize - hdrRoom))
+    {
+        retval = RET_LEN_OUT_OF_BOUNDS;
+    }
+
+    if (COMMAND_WRITE == command)
+    {
+        bool const isOk = isCompressed
+                          ? recvCompressed(self, fd, &retval, addr, length)
+                          : (RET_OK == retval)
+                          ? (RECV_OK == recvAll(self, fd, &self->image[addr], length))
+                          : dropPayload(self, fd, length);
+
+        return isOk && sendResponse(self, fd,
+                                    command | (isTagged ? TAG_FLAG : 0),
+                                    retval, (RET_OK == retval) ? length : 0,
+                                    isTagged, tag, NULL);
+    }
+
+    if (isFill && (RET_OK == retval) && isFilled(self, addr, length))
+    {
+        return sendResponse(self, fd, command | FILL_FLAG
+                            | (isTagged ? TAG_FLAG : 0), retval, length,
+                            isTagged, tag, NULL)
+               && sendAll(self, fd, &self->image[addr], FILL_LEN);
+    }
+
+    if (isCompressed && (RET_OK == retval))
+    {
+        return sendCompressed(self, fd, command | (isTagged ? TAG_FLAG : 0),
+                              isTagged, tag, addr, length);
+    }
+
+    return sendResponse(self, fd, command | (isTagged ? TAG_FLAG : 0), retval,
+                        (RET_OK == retval) ? length : 0, isTagged, tag,
+                        (RET_OK == retval) ? &self->image[addr] : NULL);
+}
+
+// Receives the compressed payload of a write and decompresses it into the
+// image if retval is RET_OK. A payload that is corrupted fails the write.
+static bool recvCompressed(ProxyNvmServer* self, int fd, int8_t* retval,
+                           size_t addr, size_t length)
+{
+    uint8_t hdr[COMPRESSED_LEN_SIZE];
+
+    if (RECV_OK != recvAll(self, fd, hdr, sizeof(hdr)))
+    {
+        return false;
+    }
+
+    size_t const compressedLen = BitConverter_getUint32BE(hdr);
+
+    if (compressedLen > DROP_BUF_SIZE)
+    {
+        Debug_LOG_ERROR("unsupported compressed length %zu", compressedLen);
+        return false;
+    }
+
+    if (RECV_OK != recvAll(self, fd, self->buf, compressedLen))
+    {
+        return false;
+    }
+
+    if ((RET_OK == *retval)
+        && !ProxyNVM_decompress(self->buf, compressedLen, &self->image[addr],
+                                length))
+    {
+        Debug_LOG_ERROR("corrupted payload for %zu bytes at 0x%zx", length,
+                        addr);
+        *retval = RET_WRITE_ERR;
+    }
+
+    return true;
+}
+
+// Sends the response of a successful read, compressed if this makes it smaller.
+static bool sendCompressed(ProxyNvmServer* self, int fd, uint8_t first,
+                           bool isTagged, uint8_t tag, size_t addr,
+                           size_t length)
+{
+    size_t const limit = (length > COMPRESSED_LEN_SIZE + 1)
+                         ? (length - COMPRESSED_LEN_SIZE - 1)
+                         : 0;
+    size_t const compressedLen =
+        ProxyNVM_compress(&self->codec, &self->image[addr], length, self->buf,
+                          (limit < DROP_BUF_SIZE) ? limit : DROP_BUF_SIZE);
+
+    if (0 == compressedLen)
+    {
+        return sendResponse(self, fd, first, RET_OK, length, isTagged, tag,
+                            &self->image[addr]);
+    }
+
+    uint8_t hdr[COMPRESSED_LEN_SIZE];
+
+    BitConverter_putUint32BE((uint32_t) compressedLen, hdr);
+
+    return sendResponse(self, fd, first | COMPRESSED_FLAG, RET_OK, length,
+                        isTagged, tag, NULL)
+           && sendAll(self, fd, hdr, sizeof(hdr))
+           && sendAll(self, fd, self->buf, compressedLen);
+}
+
+// True if the range holds more than one byte, all of the same value.
+static bool isFilled(ProxyNvmServer* self, size_t addr, size_t length)
+{
+    return (length > FILL_LEN)
+           && (0 == memcmp(&self->image[addr], &self->image[addr + 1],
+                           length - 1));
+}
+
+static bool handleVectored(ProxyNvmServer* self, int fd, uint8_t command,
+                           bool isTagged)
+{
+    size_t const f = self->fieldSize;
+    size_t const descSize = SEG_DESC_LEN_OF(f);
+    size_t const resultSize = SEG_RESULT_LEN_OF(f);
+    uint8_t hdr[MAX_REQUEST_HEADER_LEN + TAG_LEN];
+    size_t const hdrLen = REQ_HEADER_LEN_OF(f) - 1 + (isTagged ? TAG_LEN : 0);
+    uint8_t const first = command | (isTagged ? TAG_FLAG : 0);
+
+    if (RECV_OK != recvAll(self, fd, &hdr[REQ_ADDR_INDEX], hdrLen))
+    {
+        return false;
+    }
+
+    size_t const count = getField(self, &hdr[REQ_ADDR_INDEX]);
+    uint8_t const tag = isTagged ? hdr[REQ_HEADER_LEN_OF(f)] : 0;
+    size_t const descLen = count * descSize;
+
+    // descriptors and results are kept in buf
+    if ((0 == count) || (count > DROP_BUF_SIZE / 2 / descSize))
+    {
+        Debug_LOG_ERROR("unsupported segment count %zu", count);
+        return false;
+    }
+
+    uint8_t* const desc = self->buf;
+    uint8_t* const results = &self->buf[DROP_BUF_SIZE / 2];
+
+    if (RECV_OK != recvAll(self, fd, desc, descLen))
+    {
+        return false;
+    }
+
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        total += getField(self, &desc[(i * descSize) + f]);
+    }
+
+    size_t const hdrRoom = (isTagged ? TAG_LEN : 0)
+                           + ((COMMAND_READV == command)
+                              ? (RESP_HEADER_LEN_OF(f) + (count * resultSize))
+                              : (REQ_HEADER_LEN_OF(f) + descLen));
+    bool const isTooLarge = (hdrRoom > self->frameSize)
+                            || (total > self->frameSize - hdrRoom);
+    size_t bytes = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t const addr = getField(self, &desc[i * descSize]);
+        size_t const length = getField(self, &desc[(i * descSize) + f]);
+        int8_t const retval = checkRange(self, addr, length);
+
+        // the data of writes follows in any case
+        if (COMMAND_WRITEV == command)
+        {
+            bool const isOk = ((RET_OK == retval) && !isTooLarge)
+                              ? (RECV_OK == recvAll(self, fd, &self->image[addr],
+                                                    length))
+                              : dropPayload(self, fd, length);
+            if (!isOk)
+            {
+                return false;
+            }
+        }
+
+        results[i * resultSize] = (uint8_t) retval;
+        putField(self, &results[(i * resultSize) + 1],
+                 (RET_OK == retval) ? length : 0);
+        bytes += (RET_OK == retval) ? length : 0;
+    }
+
+    if (isTooLarge)
+    {
+        return sendResponse(self, fd, first, RET_LEN_OUT_OF_BOUNDS, 0,
+                            isTagged, tag, NULL);
+    }
+
+    if (!sendResponse(self, fd, first, RET_OK, bytes, isTagged, tag, NULL)
+        || !sendAll(self, fd, results, count * resultSize))
+    {
+        return false;
+    }
+
+    for (size_t i = 0; (COMMAND_READV == command) && (i < count); i++)
+    {
+        size_t const addr = getField(self, &desc[i * descSize]);
+        size_t const length = getField(self, &results[(i * resultSize) + 1]);
+
+        if (!sendAll(self, fd, &self->image[addr], length))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool handleErase(ProxyNvmServer* self, int fd)
+{
+    size_t const f = self->fieldSize;
+    uint8_t hdr[MAX_REQUEST_HEADER_LEN];
+
+    if (RECV_OK != recvAll(self, fd, &hdr[REQ_ADDR_INDEX], REQ_HEADER_LEN_OF(f) - 1))
+    {
+        return false;
+    }
+
+    size_t const addr = getField(self, &hdr[REQ_ADDR_INDEX]);
+    size_t const length = getField(self, &hdr[REQ_LEN_INDEX_OF(f)]);
+    int8_t const retval = checkRange(self, addr, length);
+
+    if (RET_OK == retval)
+    {
+        memset(&self->image[addr], 0xFF, length);
+    }
+
+    return sendResponse(self, fd, COMMAND_ERASE, retval,
+                        (RET_OK == retval) ? length : 0, false, 0, NULL);
+}
+
+static bool handleGetHashes(ProxyNvmServer* self, int fd)
+{
+    size_t const f = self->fieldSize;
+    uint8_t hdr[MAX_REQUEST_HEADER_LEN + BLOCK_SIZE_LEN];
+
+    if (RECV_OK != recvAll(self, fd, &hdr[REQ_ADDR_INDEX],
+                           REQ_HEADER_LEN_OF(f) - 1 + BLOCK_SIZE_LEN))
+    {
+        return false;
+    }
+
+    size_t const addr = getField(self, &hdr[REQ_ADDR_INDEX]);
+    size_t const length = getField(self, &hdr[REQ_LEN_INDEX_OF(f)]);
+    size_t const blockSize =
+        BitConverter_getUint32BE(&hdr[REQ_HEADER_LEN_OF(f)]);
+    int8_t retval = checkRange(self, addr, length);
+    size_t const count = (0 == blockSize)
+                         ? 0
+                         : ((length + blockSize - 1) / blockSize);
+
+    // the hashes are collected in buf
+    if ((RET_OK == retval)
+        && ((0 == blockSize)
+            || (count * HASH_LEN > self->frameSize - RESP_HEADER_LEN_OF(f))
+            || (count * HASH_LEN > DROP_BUF_SIZE)))
+    {
+        retval = RET_LEN_OUT_OF_BOUNDS;
+    }
+
+    if (RET_OK != retval)
+    {
+        return sendResponse(self, fd, COMMAND_GET_HASHES, retval, 0, false, 0,
+                            NULL);
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t const offset = i * blockSize;
+        size_t const len = ((length - offset) < blockSize)
+                           ? (length - offset)
+                           : blockSize;
+        uint64_t const hash = ProxyNVM_hash(ProxyNVM_HASH_INIT,
+                                            &self->image[addr + offset], len);
+
+        BitConverter_putUint32BE((uint32_t) (hash >> 32),
+                                 &self->buf[i * HASH_LEN]);
+        BitConverter_putUint32BE((uint32_t) hash,
+                                 &self->buf[(i * HASH_LEN) + (HASH_LEN / 2)]);
+    }
+
+    return sendResponse(self, fd, COMMAND_GET_HASHES, RET_OK, length, false,
+                        0, NULL)
+           && sendAll(self, fd, self->buf, count * HASH_LEN);
+}
+
+// The image is memory, so copying a chunk can't fail once the ranges are
+// checked. The chunks are still copied one by one in the order the protocol
+// describes.
+static bool handleCopy(ProxyNvmServer* self, int fd)
+{
+    size_t const f = self->fieldSize;
+    size_t const resultSize = SEG_RESULT_LEN_OF(f);
+    uint8_t hdr[MAX_REQUEST_HEADER_LEN + WIDE_FIELD_SIZE + CHUNK_SIZE_LEN];
+
+    if (RECV_OK != recvAll(self, fd, &hdr[REQ_ADDR_INDEX],
+                           REQ_HEADER_LEN_OF(f) - 1 + f + CHUNK_SIZE_LEN))
+    {
+        return false;
+    }
+
+    size_t const dst = getField(self, &hdr[REQ_ADDR_INDEX]);
+    size_t const length = getField(self, &hdr[REQ_LEN_INDEX_OF(f)]);
+    size_t const src = getField(self, &hdr[REQ_HEADER_LEN_OF(f)]);
+    size_t const chunkSize =
+        BitConverter_getUint32BE(&hdr[REQ_HEADER_LEN_OF(f) + f]);
+    int8_t retval = checkRange(self, dst, length);
+    size_t const count = (0 == chunkSize)
+                         ? 0
+                         : ((length + chunkSize - 1) / chunkSize);
+
+    if (RET_OK == retval)
+    {
+        retval = checkRange(self, src, length);
+    }
+
+    // the results are collected in buf
+    if ((RET_OK == retval)
+        && ((0 == chunkSize)
+            || (count * resultSize > self->frameSize - RESP_HEADER_LEN_OF(f))
+            || (count * resultSize > DROP_BUF_SIZE)))
+    {
+        retval = RET_LEN_OUT_OF_BOUNDS;
+    }
+
+    if (RET_OK != retval)
+    {
+        return sendResponse(self, fd, COMMAND_COPY, retval, 0, false, 0,
+                            NULL);
+    }
+
+    bool const isBackwards = (dst > src) && ((dst - src) < length);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t const chunk = isBackwards ? (count - 1 - i) : i;
+        size_t const offset = chunk * chunkSize;
+        size_t const len = ((length - offset) < chunkSize)
+                           ? (length - offset)
+                           : chunkSize;
+
+        memmove(&self->image[dst + offset], &self->image[src + offset], len);
+
+        self->buf[chunk * resultSize] = RET_OK;
+        putField(self, &self->buf[(chunk * resultSize) + 1], len);
+    }
+
+    return sendResponse(self, fd, COMMAND_COPY, RET_OK, length, false, 0,
+                        NULL)
+           && sendAll(self, fd, self->buf, count * resultSize);
+}
+
+// The whole pages of the range are punched out of the image file, which
+// releases their space and makes the mapping read them as 0. The partial pages
+// at the edges, or everything if the file system can't punch holes, are
+// zeroed.
+static bool handleDiscard(ProxyNvmServer* self, int fd)
+{
+    size_t const f = self->fieldSize;
+    uint8_t hdr[MAX_REQUEST_HEADER_LEN];
+
+    if (RECV_OK != recvAll(self, fd, &hdr[REQ_ADDR_INDEX], REQ_HEADER_LEN_OF(f) - 1))
+    {
+        return false;
+    }
+
+    size_t const addr = getField(self, &hdr[REQ_ADDR_INDEX]);
+    size_t const length = getField(self, &hdr[REQ_LEN_INDEX_OF(f)]);
+    int8_t const retval = checkRange(self, addr, length);
+
+    if (RET_OK != retval)
+    {
+        return sendResponse(self, fd, COMMAND_DISCARD, retval, 0, false, 0,
+                            NULL);
+    }
+
+    size_t const page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t const first = (addr + page - 1) / page * page;
+    size_t const end = (addr + length) / page * page;
+
+    if ((first < end)
+        && (0 == fallocate(self->imageFd,
+                           FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                           (off_t) first, (off_t) (end - first))))
+    {
+        memset(&self->image[addr], 0, first - addr);
+        memset(&self->image[end], 0, addr + length - end);
+    }
+    else
+    {
+        memset(&self->image[addr], 0, length);
+    }
+
+    return sendResponse(self, fd, COMMAND_DISCARD, RET_OK, length, false, 0,
+                        NULL);
+}
+
+static bool handleHello(ProxyNvmServer* self, int fd)
+{
+    uint8_t caps[HELLO_RESP_LEN - RESP_HEADER_LEN];
+
+    BitConverter_putUint32BE((uint32_t) self->frameSize,
+                             &caps[HELLO_FRAME_SIZE_INDEX - RESP_HEADER_LEN]);
+    BitConverter_putUint32BE((uint32_t) self->config.maxOutstanding,
+                             &caps[HELLO_WINDOW_INDEX - RESP_HEADER_LEN]);
+    BitConverter_putUint32BE(self->config.features,
+                             &caps[HELLO_FEATURES_INDEX - RESP_HEADER_LEN]);
+
+    return sendResponse(self, fd, COMMAND_HELLO, RET_OK,
+                        ProxyNVM_PROTOCOL_VERSION, false, 0, NULL)
+           && sendAll(self, fd, caps, sizeof(caps));
+}
+
+static bool handleSetFrameSize(ProxyNvmServer* self, int fd)
+{
+    uint8_t hdr[WIDE_FIELD_SIZE];
+
+    if (RECV_OK != recvAll(self, fd, hdr, self->fieldSize))
+    {
+        return false;
+    }
+
+    size_t const proposed = getField(self, hdr);
+
+    self->frameSize = (proposed < self->config.maxFrameSize)
+                      ? proposed
+                      : self->config.maxFrameSize;
+
+    return sendResponse(self, fd, COMMAND_SET_FRAME_SIZE, RET_OK,
+                        self->frameSize, false, 0, NULL);
+}
+
+// The request byte is already counted, the counts always have 64 bit.
+static bool handleSync(ProxyNvmServer* self, int fd)
+{
+    uint8_t resp[SYNC_RESP_LEN];
+    uint8_t* const received = &resp[SYNC_RECEIVED_INDEX];
+    uint8_t* const sent = &resp[SYNC_SENT_INDEX];
+
+    resp[RESP_COMM_INDEX]   = COMMAND_SYNC;
+    resp[RESP_RETVAL_INDEX] = RET_OK;
+    BitConverter_putUint32BE((uint32_t) (self->bytesReceived >> 32), received);
+    BitConverter_putUint32BE((uint32_t) self->bytesReceived,
+                             &received[ADDRESS_SIZE]);
+    BitConverter_putUint32BE((uint32_t) (self->bytesSent >> 32), sent);
+    BitConverter_putUint32BE((uint32_t) self->bytesSent, &sent[ADDRESS_SIZE]);
+
+    return sendAll(self, fd, resp, sizeof(resp));
+}
+
+// The response still has fields of the old size, the new one applies from the
+// next request on.
+static bool handleSetAddressSize(ProxyNvmServer* self, int fd)
+{
+    uint8_t hdr[WIDE_FIELD_SIZE];
+
+    if (RECV_OK != recvAll(self, fd, hdr, self->fieldSize))
+    {
+        return false;
+    }
+
+    size_t const proposed = getField(self, hdr);
+    int8_t const retval = ((ADDRESS_SIZE == proposed)
+                           || (WIDE_FIELD_SIZE == proposed))
+                          ? RET_OK : RET_GENERIC_ERR;
+    bool const isOk = sendResponse(self, fd, COMMAND_SET_ADDRESS_SIZE, retval,
+                                   (RET_OK == retval) ? proposed : 0, false,
+                                   0, NULL);
+
+    if (RET_OK == retval)
+    {
+        self->fieldSize = proposed;
+    }
+
+    return isOk;
+}
+
+static int8_t checkRange(ProxyNvmServer* self, size_t addr, size_t length)
+{
+    if (addr > self->size)
+    {
+        return RET_ADDR_OUT_OF_BOUNDS;
+    }
+    if (length > self->size - addr)
+    {
+        return RET_LEN_OUT_OF_BOUNDS;
+    }
+    return RET_OK;
+}
+
+static bool sendResponse(ProxyNvmServer* self, int fd, uint8_t command,
+                         int8_t retval, size_t bytes, bool isTagged,
+                         uint8_t tag, void const* payload)
+{
+    uint8_t hdr[MAX_RESP_HEADER_LEN + TAG_LEN];
+    size_t hdrLen = RESP_HEADER_LEN_OF(self->fieldSize);
+
+    hdr[RESP_COMM_INDEX]   = command;
+    hdr[RESP_RETVAL_INDEX] = (uint8_t) retval;
+    putField(self, &hdr[RESP_BYTES_INDEX], bytes);
+
+    if (isTagged)
+    {
+        hdr[hdrLen++] = tag;
+    }
+
+    return sendAll(self, fd, hdr, hdrLen)
+           && ((NULL == payload) || sendAll(self, fd, payload, bytes));
+}
+
+// Writes an ADDR, LENGTH or BYTES field of the negotiated size, big endian.
+static void putField(ProxyNvmServer* self, uint8_t* field, size_t value)
+{
+    if (WIDE_FIELD_SIZE == self->fieldSize)
+    {
+        BitConverter_putUint32BE((uint32_t) ((uint64_t) value >> 32), field);
+        field += ADDRESS_SIZE;
+    }
+
+    BitConverter_putUint32BE((uint32_t) value, field);
+}
+
+static size_t getField(ProxyNvmServer* self, uint8_t const* field)
+{
+    if (WIDE_FIELD_SIZE == self->fieldSize)
+    {
+        return (size_t) (((uint64_t) BitConverter_getUint32BE(field) << 32)
+                         | BitConverter_getUint32BE(&field[ADDRESS_SIZE]));
+    }
+
+    return BitConverter_getUint32BE(field);
+}
+
+static bool dropPayload(ProxyNvmServer* self, int fd, size_t length)
+{
+    while (length > 0)
+    {
+        size_t const len = (length < DROP_BUF_SIZE) ? length : DROP_BUF_SIZE;
+
+        if (RECV_OK != recvAll(self, fd, self->buf, len))
+        {
+            return false;
+        }
+        length -= len;
+    }
+
+    return true;
+}
+
+static RecvResult recvAll(ProxyNvmServer* self, int fd, void* buf,
+                          size_t len)
+{
+    uint8_t* p = buf;
+    size_t done = 0;
+
+    while (done < len)
+    {
+        ssize_t const ret = read(fd, &p[done], len - done);
+        if (ret < 0)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+            Debug_LOG_ERROR("read() failed: %s", strerror(errno));
+            return RECV_FAILED;
+        }
+        if (0 == ret)
+        {
+            return (0 == done) ? RECV_CLOSED : RECV_FAILED;
+        }
+        done += (size_t) ret;
+        self->bytesReceived += (size_t) ret;
+    }
+
+    return RECV_OK;
+}
+
+static bool sendAll(ProxyNvmServer* self, int fd, void const* buf,
+                    size_t len)
+{
+    uint8_t const* p = buf;
+    size_t done = 0;
+
+    while (done < len)
+    {
+        ssize_t const ret = write(fd, &p[done], len - done);
+        if (ret < 0)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+            Debug_LOG_ERROR("write() failed: %s", strerror(errno));
+            return false;
+        }
+        done += (size_t) ret;
+        self->bytesSent += (size_t) ret;
+    }
+
+    return true;
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+/**
+ * @file
+ *
+ * @brief reference implementation of the proxy side of the protocol described
+ *  in ProxyNVM.c, backed by an image file that is mapped into memory. It is
+ *  meant for running the drivers on a Linux host, not as a replacement for the
+ *  proxy application.
+ *
+ */
+#pragma once
+
+/* Includes ------------------------------------------------------------------*/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ProxyNVM_Codec.h"
+
+
+/* Exported types ------------------------------------------------------------*/
+
+typedef struct
+{
+    char const* imagePath;  //!< created if it does not exist
+    size_t  imageSize;      //!< resize the image to this, 0 keeps its size
+    uint32_t features;      //!< ProxyNVM_FEATURE_xxx bits the server reports,
+                            //!< 0 behaves like a proxy without COMMAND_GET_FEATURES
+    size_t  maxFrameSize;   //!< largest message the server accepts or sends
+    size_t  maxOutstanding; //!< requests in flight reported by COMMAND_HELLO,
+                            //!< 0 behaves like a proxy without COMMAND_HELLO
+} ProxyNvmServer_Config;
+
+typedef struct
+{
+    ProxyNvmServer_Config config;
+    int         imageFd;
+    uint8_t*    image;
+    size_t      size;
+    size_t      frameSize;  //!< current frame size, may be negotiated down
+    size_t      fieldSize;  //!< size of ADDR, LENGTH and BYTES, negotiated
+    uint8_t*    buf;        //!< receives payloads of failed writes
+    size_t      requests;   //!< number of requests handled
+    uint64_t    bytesReceived; //!< on the channel, reported by COMMAND_SYNC
+    uint64_t    bytesSent;
+    ProxyNVM_CodecWorkspace codec;
+} ProxyNvmServer;
+
+
+/* Exported functions ------------------------------------------------------- */
+/**
+ * @brief constructor, opens and maps the image.
+ *
+ * @return true if success
+ *
+ */
+bool
+ProxyNvmServer_ctor(ProxyNvmServer* self, ProxyNvmServer_Config const* config);
+
+/**
+ * @brief handles requests from fd until it is closed.
+ *
+ * Responses are written to the same descriptor, so fd is usually a socket.
+ *
+ * @return true if the channel was closed between requests
+ *
+ */
+bool
+ProxyNvmServer_serve(ProxyNvmServer* self, int fd);
+
+void
+ProxyNvmServer_dtor(ProxyNvmServer* self);
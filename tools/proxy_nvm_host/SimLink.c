@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "SimLink.h"
+#include "lib_debug/Debug.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Defines -------------------------------------------------------------------*/
+#define CHUNK_SIZE      (64 * 1024)
+#define NS_PER_SEC      1000000000ull
+
+/* Private types -------------------------------------------------------------*/
+
+struct SimLink_Chunk
+{
+    SimLink_Chunk*  next;
+    uint64_t        deliverNs;  //!< time the chunk arrives at the other side
+    size_t          length;     //!< 0 marks the end of the stream
+    char            data[];
+};
+
+/* Private functions prototypes ----------------------------------------------*/
+static uint64_t now(void);
+static void* readerThread(void* arg);
+static void* writerThread(void* arg);
+static void push(SimLink_Direction* dir, SimLink_Chunk* chunk);
+static SimLink_Chunk* pop(SimLink_Direction* dir);
+
+/* Public functions ----------------------------------------------------------*/
+
+bool
+SimLink_ctor(SimLink* self, SimLink_Config const* config, int fdA, int fdB)
+{
+    Debug_ASSERT_SELF(self);
+    Debug_ASSERT(config != NULL);
+
+    memset(self, 0, sizeof(*self));
+    self->config = *config;
+
+    int const fds[2][2] = { { fdA, fdB }, { fdB, fdA } };
+
+    for (size_t i = 0; i < 2; i++)
+    {
+        SimLink_Direction* const dir = &self->dir[i];
+
+        dir->config = &self->config;
+        dir->in     = fds[i][0];
+        dir->out    = fds[i][1];
+        pthread_mutex_init(&dir->lock, NULL);
+        pthread_cond_init(&dir->cond, NULL);
+
+        if ((0 != pthread_create(&dir->writer, NULL, writerThread, dir))
+            || (0 != pthread_create(&dir->reader, NULL, readerThread, dir)))
+        {
+            Debug_LOG_ERROR("pthread_create() failed");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void
+SimLink_dtor(SimLink* self)
+{
+    Debug_ASSERT_SELF(self);
+
+    for (size_t i = 0; i < 2; i++)
+    {
+        SimLink_Direction* const dir = &self->dir[i];
+
+        pthread_join(dir->reader, NULL);
+        pthread_join(dir->writer, NULL);
+        pthread_cond_destroy(&dir->cond);
+        pthread_mutex_destroy(&dir->lock);
+    }
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+static uint64_t now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec * NS_PER_SEC) + (uint64_t) ts.tv_nsec;
+}
+
+// Reads whatever is available and timestamps it. The sender is busy until the
+// previous data is transmitted, so a chunk starts transmitting at the later of
+// now and that time.
+static void* readerThread(void* arg)
+{
+    SimLink_Direction* const dir = arg;
+
+    for (;;)
+    {
+        SimLink_Chunk* const chunk = malloc(sizeof(*chunk) + CHUNK_SIZE);
+        if (NULL == chunk)
+        {
+            Debug_LOG_ERROR("malloc() failed");
+            abort();
+        }
+
+        ssize_t ret;
+        do
+        {
+            ret = read(dir->in, chunk->data, CHUNK_SIZE);
+        }
+        while ((ret < 0) && (EINTR == errno));
+
+        chunk->length = (ret > 0) ? (size_t) ret : 0;
+
+        uint64_t const t = now();
+        uint64_t const txNs = (0 == dir->config->bandwidth)
+                              ? 0
+                              : (chunk->length * NS_PER_SEC)
+                              / dir->config->bandwidth;
+
+        dir->txFreeNs = ((dir->txFreeNs > t) ? dir->txFreeNs : t) + txNs;
+        chunk->deliverNs = dir->txFreeNs + (dir->config->latencyUs * 1000);
+
+        push(dir, chunk);
+
+        if (0 == chunk->length)
+        {
+            return NULL;
+        }
+    }
+}
+
+static void* writerThread(void* arg)
+{
+    SimLink_Direction* const dir = arg;
+
+    for (;;)
+    {
+        SimLink_Chunk* const chunk = pop(dir);
+        struct timespec const ts =
+        {
+            .tv_sec  = (time_t)(chunk->deliverNs / NS_PER_SEC),
+            .tv_nsec = (long)(chunk->deliverNs % NS_PER_SEC),
+        };
+
+        while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts,
+                                        NULL))
+        {
+        }
+
+        if (0 == chunk->length)
+        {
+            free(chunk);
+            shutdown(dir->out, SHUT_WR);
+            return NULL;
+        }
+
+        size_t done = 0;
+        while (done < chunk->length)
+        {
+            ssize_t const ret = write(dir->out, &chunk->data[done],
+                                      chunk->length - done);
+            if (ret < 0)
+            {
+                if (EINTR == errno)
+                {
+                    continue;
+                }
+                // the receiver is gone, drop the rest of the stream
+                break;
+            }
+            done += (size_t) ret;
+        }
+
+        free(chunk);
+    }
+}
+
+static void push(SimLink_Direction* dir, SimLink_Chunk* chunk)
+{
+    chunk->next = NULL;
+
+    pthread_mutex_lock(&dir->lock);
+    if (NULL == dir->tail)
+    {
+        dir->head = chunk;
+    }
+    else
+    {
+        dir->tail->next = chunk;
+    }
+    dir->tail = chunk;
+    pthread_cond_signal(&dir->cond);
+    pthread_mutex_unlock(&dir->lock);
+}
+
+static SimLink_Chunk* pop(SimLink_Direction* dir)
+{
+    pthread_mutex_lock(&dir->lock);
+    while (NULL == dir->head)
+    {
+        pthread_cond_wait(&dir->cond, &dir->lock);
+    }
+
+    SimLink_Chunk* const chunk = dir->head;
+    dir->head = chunk->next;
+    if (NULL == dir->head)
+    {
+        dir->tail = NULL;
+    }
+    pthread_mutex_unlock(&dir->lock);
+
+    return chunk;
+}
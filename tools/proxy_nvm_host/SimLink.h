@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+/**
+ * @file
+ *
+ * @brief relays a byte stream between two file descriptors in both directions
+ *  and delays it like a full-duplex serial link. Each direction has its own
+ *  bandwidth, data arrives when it is completely transmitted plus the latency.
+ *  Several messages can be in flight at the same time, so pipelining pays off
+ *  as it would on the real link.
+ *
+ */
+#pragma once
+
+/* Includes ------------------------------------------------------------------*/
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/* Exported types ------------------------------------------------------------*/
+
+typedef struct SimLink_Chunk SimLink_Chunk;
+
+typedef struct
+{
+    uint64_t bandwidth;     //!< bytes per second in each direction, 0 = unlimited
+    uint64_t latencyUs;     //!< one-way latency in microseconds
+} SimLink_Config;
+
+typedef struct
+{
+    SimLink_Config const* config;
+    int         in;
+    int         out;
+    uint64_t    txFreeNs;   //!< time the sender finishes the queued data
+    SimLink_Chunk* head;
+    SimLink_Chunk* tail;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    pthread_t   reader;
+    pthread_t   writer;
+} SimLink_Direction;
+
+typedef struct
+{
+    SimLink_Config      config;
+    SimLink_Direction   dir[2];
+} SimLink;
+
+
+/* Exported functions ------------------------------------------------------- */
+/**
+ * @brief starts relaying between fdA and fdB.
+ *
+ * Data read from fdA is written to fdB and vice versa. When one side closes,
+ * the write direction of the other side is shut down after the queued data is
+ * delivered.
+ *
+ * @return true if success
+ *
+ */
+bool
+SimLink_ctor(SimLink* self, SimLink_Config const* config, int fdA, int fdB);
+
+/**
+ * @brief waits until both directions are closed.
+ *
+ */
+void
+SimLink_dtor(SimLink* self);
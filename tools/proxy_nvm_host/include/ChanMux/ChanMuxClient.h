@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+// Host build stand-in for the SDK header. The channel is a file descriptor,
+// usually one end of a socketpair, instead of a pair of dataports. Reads and
+// writes block until all bytes are transferred. Implemented in
+// LoopbackChanMuxClient.c.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "OS_Error.h"
+
+typedef struct
+{
+    int fd;
+} ChanMuxClientConfig_t;
+
+typedef struct
+{
+    int     fd;
+    size_t  writes;         //!< number of ChanMuxClient_write() calls
+    size_t  bytesWritten;
+    size_t  reads;          //!< number of ChanMuxClient_read() calls
+    size_t  bytesRead;
+} ChanMuxClient;
+
+bool
+ChanMuxClient_ctor(
+    ChanMuxClient*                self,
+    const ChanMuxClientConfig_t*  config);
+
+void
+ChanMuxClient_dtor(
+    ChanMuxClient*  self);
+
+OS_Error_t
+ChanMuxClient_write(
+    ChanMuxClient*  self,
+    const void*     buf,
+    size_t          len,
+    size_t*         written);
+
+OS_Error_t
+ChanMuxClient_read(
+    ChanMuxClient*  self,
+    void*           buf,
+    size_t          len,
+    size_t*         read);
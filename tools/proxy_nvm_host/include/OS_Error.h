@@ -0,0 +1,27 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+// Host build stand-in for the SDK header, only the codes used by the drivers.
+
+#pragma once
+
+typedef enum
+{
+    OS_SUCCESS                  = 0,
+    OS_ERROR_GENERIC            = -1,
+    OS_ERROR_INVALID_PARAMETER  = -2,
+    OS_ERROR_INVALID_STATE      = -3,
+    OS_ERROR_NOT_SUPPORTED      = -4,
+    OS_ERROR_BUFFER_TOO_SMALL   = -5,
+    OS_ERROR_ABORTED            = -6,
+    OS_ERROR_TRY_AGAIN          = -7,
+    OS_ERROR_INSUFFICIENT_SPACE = -8,
+    OS_ERROR_NOT_FOUND          = -9,
+    OS_ERROR_OUT_OF_BOUNDS      = -10,
+    OS_ERROR_IN_PROGRESS        = -11,
+} OS_Error_t;
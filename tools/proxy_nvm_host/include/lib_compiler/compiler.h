@@ -0,0 +1,13 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+// Host build stand-in for the SDK header.
+
+#pragma once
+
+#define DECL_UNUSED_VAR(x)  __attribute__((unused)) x
@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+// Host build stand-in for the SDK header. Errors and warnings go to stderr,
+// the other levels are only printed with -DHOST_DEBUG_VERBOSE, so they don't
+// distort measurements.
+
+#pragma once
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "lib_compiler/compiler.h"
+
+#define Debug_LOG(_lvl_, ...) \
+    do { \
+        fprintf(stderr, _lvl_ " %s: ", __func__); \
+        fprintf(stderr, __VA_ARGS__); \
+        fprintf(stderr, "\n"); \
+    } while (0)
+
+#define Debug_LOG_ERROR(...)    Debug_LOG("ERROR", __VA_ARGS__)
+#define Debug_LOG_WARNING(...)  Debug_LOG("WARN ", __VA_ARGS__)
+
+#if defined(HOST_DEBUG_VERBOSE)
+#   define Debug_LOG_INFO(...)  Debug_LOG("INFO ", __VA_ARGS__)
+#   define Debug_LOG_DEBUG(...) Debug_LOG("DEBUG", __VA_ARGS__)
+#   define Debug_LOG_TRACE(...) Debug_LOG("TRACE", __VA_ARGS__)
+#else
+#   define Debug_LOG_INFO(...)  do { } while (0)
+#   define Debug_LOG_DEBUG(...) do { } while (0)
+#   define Debug_LOG_TRACE(...) do { } while (0)
+#endif
+
+#define Debug_ASSERT(x)         assert(x)
+#define Debug_ASSERT_SELF(x)    assert(NULL != (x))
@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+// Host build stand-in for the SDK header, same vtable layout as lib_mem.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lib_debug/Debug.h"
+
+typedef struct Nvm Nvm;
+
+typedef size_t (*Nvm_WriteT)(Nvm* self, size_t addr, void const* buffer,
+                             size_t length);
+typedef size_t (*Nvm_ReadT)(Nvm* self, size_t addr, void* buffer,
+                            size_t length);
+typedef size_t (*Nvm_EraseT)(Nvm* self, size_t addr, size_t length);
+typedef size_t (*Nvm_GetSizeT)(Nvm* self);
+typedef void (*Nvm_DtorT)(Nvm* self);
+
+typedef struct
+{
+    Nvm_WriteT      write;
+    Nvm_ReadT       read;
+    Nvm_EraseT      erase;
+    Nvm_GetSizeT    getSize;
+    Nvm_DtorT       dtor;
+} Nvm_Vtable;
+
+struct Nvm
+{
+    const Nvm_Vtable* vtable;
+};
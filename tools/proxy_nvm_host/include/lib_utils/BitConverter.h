@@ -0,0 +1,19 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+// Host build stand-in for the SDK header, implemented in HostShims.c.
+
+#pragma once
+
+#include <stdint.h>
+
+void
+BitConverter_putUint32BE(uint32_t value, void* buffer);
+
+uint32_t
+BitConverter_getUint32BE(void const* buffer);
@@ -0,0 +1,632 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+// Benchmark of the storage path below the storage_rpc_xxx() functions. It
+// drives the Nvm of a ChanMuxNvmDriver, optionally with a CacheNVM on top like
+// the component, against the reference proxy of the LoopbackHarness. For each
+// workload and request size it prints one JSON object per line, see README.md.
+
+/* Includes ------------------------------------------------------------------*/
+#include "LoopbackHarness.h"
+#include "ChanMuxNvmDriver.h"
+#include "CacheNVM.h"
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Defines -------------------------------------------------------------------*/
+#define NS_PER_SEC          1000000000ull
+#define CACHE_BLOCK_SIZE    512
+#define HASH_BLOCK_SIZE     512
+#define MIXED_READ_PERCENT  70
+
+/* Private types -------------------------------------------------------------*/
+
+typedef enum
+{
+    OP_READ,
+    OP_WRITE,
+    OP_ERASE,
+    OP_DISCARD,
+    OP_COPY,
+    OP_READV,
+    OP_WRITEV
+} Op;
+
+typedef struct
+{
+    char const* name;
+    Op          op;         // OP_READ with isMixed picks reads and writes
+    bool        isRandom;
+    bool        isMixed;
+} Workload;
+
+typedef struct
+{
+    ProxyNvmServer_Config server;
+    SimLink_Config link;
+    bool        isLinkSimulated;
+    size_t      ops;            // operations per workload and size
+    size_t      maxSize;        // largest request, the dataport size
+    size_t      cacheBlocks;    // 0 runs without CacheNVM
+    size_t      writeBack;      // dirty limit of the cache, 0 = write-through
+    size_t      readAhead;      // read-ahead buffer size, 0 = disabled
+    size_t      segments;       // segments of a vectored operation
+    unsigned    seed;
+    char const* workloads;      // comma separated names, NULL = all
+    bool        isCompressed;   // the driver compresses payloads
+    size_t      hashBlocks;     // blocks with known hashes, 0 = disabled
+    size_t      erasedBlocks;   // bits of the map of erased blocks, 0 = none
+    char const* pattern;        // data written: random, zero or text
+} Options;
+
+/* Private variables ---------------------------------------------------------*/
+
+static Workload const workloads[] =
+{
+    { "seqread",   OP_READ,  false, false },
+    { "seqwrite",  OP_WRITE, false, false },
+    { "seqerase",  OP_ERASE, false, false },
+    { "randread",  OP_READ,  true,  false },
+    { "randwrite", OP_WRITE, true,  false },
+    { "randerase", OP_ERASE, true,  false },
+    { "randdiscard", OP_DISCARD, true, false },
+    { "randcopy",  OP_COPY,  true,  false },
+    { "mixed",     OP_READ,  true,  true  },
+    { "randreadv", OP_READV, true,  false },
+    { "randwritev", OP_WRITEV, true, false },
+};
+
+// one harness per channel, their servers share the image
+static LoopbackHarness  harness[ChanMuxNvmDriver_CHANNELS];
+static ChanMuxClientConfig_t chanMuxConfig[ChanMuxNvmDriver_CHANNELS];
+static ChanMuxNvmDriver driver;
+static CacheNVM         cache;
+static ProxyNVM_Segment* segs;
+static ProxyNVM_CodecWorkspace codecWorkspace[ChanMuxNvmDriver_CHANNELS];
+
+/* Private functions prototypes ----------------------------------------------*/
+static bool parseOptions(Options* opt, int argc, char* argv[]);
+static bool isSelected(Options const* opt, char const* name);
+static void fillData(Options* opt, char* buf);
+static void runCase(Options const* opt, Nvm* nvm, Workload const* wl,
+                    size_t reqSize, char const* buf, char* readBuf);
+static uint64_t now(void);
+static size_t serverRequests(void);
+static size_t wireBytes(void);
+static void stopHarnesses(size_t count);
+static int compareU64(void const* a, void const* b);
+static uint64_t percentile(uint64_t const* sorted, size_t count, unsigned perMille);
+
+/* Public functions ----------------------------------------------------------*/
+
+int main(int argc, char* argv[])
+{
+    Options opt;
+
+    if (!parseOptions(&opt, argc, argv))
+    {
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < ChanMuxNvmDriver_CHANNELS; i++)
+    {
+        if (!LoopbackHarness_ctor(&harness[i], &opt.server,
+                                  opt.isLinkSimulated ? &opt.link : NULL))
+        {
+            stopHarnesses(i);
+            return EXIT_FAILURE;
+        }
+        chanMuxConfig[i] = harness[i].chanMuxConfig;
+    }
+
+    if (!ChanMuxNvmDriver_ctor(&driver, chanMuxConfig))
+    {
+        stopHarnesses(ChanMuxNvmDriver_CHANNELS);
+        return EXIT_FAILURE;
+    }
+
+    static char* readAheadBuf;
+    if (opt.readAhead > 0)
+    {
+        readAheadBuf = malloc(opt.readAhead);
+        if (!ChanMuxNvmDriver_enableReadAhead(&driver, readAheadBuf,
+                                              opt.readAhead))
+        {
+            stopHarnesses(ChanMuxNvmDriver_CHANNELS);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (opt.isCompressed)
+    {
+        ChanMuxNvmDriver_enableCompression(&driver, codecWorkspace);
+    }
+
+    uint32_t* erasedMap = NULL;
+    if (opt.erasedBlocks > 0)
+    {
+        erasedMap = malloc(((opt.erasedBlocks + 31) / 32) * sizeof(*erasedMap));
+        if (!ChanMuxNvmDriver_enableErasedMap(&driver, erasedMap,
+                                              opt.erasedBlocks))
+        {
+            stopHarnesses(ChanMuxNvmDriver_CHANNELS);
+            return EXIT_FAILURE;
+        }
+        // only possible if the proxy supports hashes
+        ChanMuxNvmDriver_scanErased(&driver);
+    }
+
+    uint64_t* hashTable = NULL;
+    if (opt.hashBlocks > 0)
+    {
+        hashTable = malloc(opt.hashBlocks * sizeof(*hashTable));
+        if (!ChanMuxNvmDriver_enableHashes(&driver, hashTable, opt.hashBlocks,
+                                           HASH_BLOCK_SIZE))
+        {
+            stopHarnesses(ChanMuxNvmDriver_CHANNELS);
+            return EXIT_FAILURE;
+        }
+    }
+
+    Nvm* nvm = ChanMuxNvmDriver_get_nvm(&driver);
+    CacheNVM_Block* blocks = NULL;
+    char* cacheData = NULL;
+    char* flushBuf = NULL;
+
+    if (opt.cacheBlocks > 0)
+    {
+        size_t const flushBufSize = ChanMuxNvmDriver_FRAME_SIZE
+                                    * ProxyNVM_PIPELINE_WINDOW;
+
+        blocks    = calloc(opt.cacheBlocks, sizeof(*blocks));
+        cacheData = malloc(opt.cacheBlocks * CACHE_BLOCK_SIZE);
+        flushBuf  = malloc(flushBufSize);
+
+        if (!CacheNVM_ctor(&cache, nvm, blocks, cacheData, opt.cacheBlocks,
+                           CACHE_BLOCK_SIZE)
+            || ((opt.writeBack > 0)
+                && !CacheNVM_enableWriteBack(&cache, flushBuf, flushBufSize,
+                                             opt.writeBack)))
+        {
+            fprintf(stderr, "cache setup failed\n");
+            return EXIT_FAILURE;
+        }
+        nvm = CacheNVM_TO_NVM(&cache);
+    }
+
+    segs = calloc(opt.segments, sizeof(*segs));
+
+    // reads go to their own buffer, so the data written stays as filled
+    char* const buf = malloc(opt.maxSize);
+    char* const readBuf = malloc(opt.maxSize);
+    fillData(&opt, buf);
+
+    for (size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++)
+    {
+        if (!isSelected(&opt, workloads[w].name))
+        {
+            continue;
+        }
+        // discards, copies and vectored operations go around the cache
+        if ((workloads[w].op >= OP_DISCARD) && (opt.cacheBlocks > 0))
+        {
+            fprintf(stderr, "skipping %s with cache\n", workloads[w].name);
+            continue;
+        }
+        // 1, 4, 16, ... bytes and the dataport size itself
+        for (size_t size = 1; ; size *= 4)
+        {
+            size_t const reqSize = (size < opt.maxSize) ? size : opt.maxSize;
+
+            runCase(&opt, nvm, &workloads[w], reqSize, buf, readBuf);
+            if (reqSize == opt.maxSize)
+            {
+                break;
+            }
+        }
+    }
+
+    if (opt.cacheBlocks > 0)
+    {
+        CacheNVM_dtor(CacheNVM_TO_NVM(&cache));
+    }
+    ChanMuxNvmDriver_dtor(&driver);
+    stopHarnesses(ChanMuxNvmDriver_CHANNELS);
+
+    free(buf);
+    free(readBuf);
+    free(segs);
+    free(flushBuf);
+    free(cacheData);
+    free(blocks);
+    free(readAheadBuf);
+    free(hashTable);
+    free(erasedMap);
+
+    return EXIT_SUCCESS;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+static void usage(char const* prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -i PATH   image file (nvm_bench.img)\n"
+            "  -S BYTES  image size (16777216)\n"
+            "  -f BITS   features the proxy reports (0x7ff)\n"
+            "  -F BYTES  largest frame the proxy accepts (65536)\n"
+            "  -q REQS   outstanding requests the proxy accepts, 0 = proxy\n"
+            "            without COMMAND_HELLO (8)\n"
+            "  -b BPS    link bandwidth in bytes/s, 0 = unlimited (0)\n"
+            "  -l USEC   link latency in microseconds (0)\n"
+            "  -n OPS    operations per workload and size (2000)\n"
+            "  -d BYTES  largest request size, the dataport size (%d)\n"
+            "  -c BLOCKS blocks of %d bytes in a CacheNVM on top, 0 = none (0)\n"
+            "  -W BYTES  dirty limit of the cache in write-back mode (0)\n"
+            "  -r BYTES  read-ahead buffer size (0)\n"
+            "  -s SEED   random seed (1)\n"
+            "  -v SEGS   segments of a vectored operation (16)\n"
+            "  -z        compress payloads if the proxy supports it\n"
+            "  -p NAME   data to write: random, zero or text (random)\n"
+            "  -H BLOCKS blocks of %d bytes with known hashes, ones with a\n"
+            "            matching hash aren't written, 0 = none (0)\n"
+            "  -e BLOCKS blocks in the map of erased blocks, 0 = none (0)\n"
+            "  -w LIST   comma separated workloads (all):\n"
+            "            seqread,seqwrite,seqerase,randread,randwrite,\n"
+            "            randerase,randdiscard,randcopy,mixed,randreadv,\n"
+            "            randwritev\n"
+            "Vectored operations use segments of the request size, as many\n"
+            "as fit into the dataport. Copies are read and written back if\n"
+            "the proxy doesn't support COMMAND_COPY.\n"
+            "The link is simulated if -b or -l is given.\n",
+            prog, PAGE_SIZE, CACHE_BLOCK_SIZE, HASH_BLOCK_SIZE);
+}
+
+static bool parseOptions(Options* opt, int argc, char* argv[])
+{
+    int c;
+
+    memset(opt, 0, sizeof(*opt));
+    opt->server.imagePath    = "nvm_bench.img";
+    opt->server.imageSize    = 16 * 1024 * 1024;
+    opt->server.features     = ProxyNVM_FEATURE_ERASE
+                               | ProxyNVM_FEATURE_TAGGED
+                               | ProxyNVM_FEATURE_FRAME_SIZE
+                               | ProxyNVM_FEATURE_VECTORED
+                               | ProxyNVM_FEATURE_COMPRESSION
+                               | ProxyNVM_FEATURE_FILL
+                               | ProxyNVM_FEATURE_HASHES
+                               | ProxyNVM_FEATURE_WIDE
+                               | ProxyNVM_FEATURE_COPY
+                               | ProxyNVM_FEATURE_DISCARD
+                              | ProxyNVM_FEATURE_SYNC;
+    opt->server.maxFrameSize = 64 * 1024;
+    opt->server.maxOutstanding = 8;
+    opt->ops     = 2000;
+    opt->maxSize = PAGE_SIZE;
+    opt->seed    = 1;
+    opt->segments = 16;
+    opt->pattern = "random";
+
+    while (-1 != (c = getopt(argc, argv, "i:S:f:F:q:b:l:n:d:c:W:r:s:v:w:zp:H:e:h")))
+    {
+        switch (c)
+        {
+        case 'i': opt->server.imagePath = optarg; break;
+        case 'S': opt->server.imageSize = strtoull(optarg, NULL, 0); break;
+        case 'f': opt->server.features = strtoul(optarg, NULL, 0); break;
+        case 'F': opt->server.maxFrameSize = strtoull(optarg, NULL, 0); break;
+        case 'q': opt->server.maxOutstanding = strtoull(optarg, NULL, 0); break;
+        case 'b':
+            opt->link.bandwidth = strtoull(optarg, NULL, 0);
+            opt->isLinkSimulated = true;
+            break;
+        case 'l':
+            opt->link.latencyUs = strtoull(optarg, NULL, 0);
+            opt->isLinkSimulated = true;
+            break;
+        case 'n': opt->ops = strtoull(optarg, NULL, 0); break;
+        case 'd': opt->maxSize = strtoull(optarg, NULL, 0); break;
+        case 'c': opt->cacheBlocks = strtoull(optarg, NULL, 0); break;
+        case 'W': opt->writeBack = strtoull(optarg, NULL, 0); break;
+        case 'r': opt->readAhead = strtoull(optarg, NULL, 0); break;
+        case 's': opt->seed = (unsigned) strtoul(optarg, NULL, 0); break;
+        case 'v': opt->segments = strtoull(optarg, NULL, 0); break;
+        case 'w': opt->workloads = optarg; break;
+        case 'z': opt->isCompressed = true; break;
+        case 'p': opt->pattern = optarg; break;
+        case 'H': opt->hashBlocks = strtoull(optarg, NULL, 0); break;
+        case 'e': opt->erasedBlocks = strtoull(optarg, NULL, 0); break;
+        default:
+            usage(argv[0]);
+            return false;
+        }
+    }
+
+    if ((0 == opt->ops) || (0 == opt->maxSize) || (0 == opt->segments)
+        || (opt->maxSize > opt->server.imageSize)
+        || ((opt->writeBack > 0) && (0 == opt->cacheBlocks))
+        || ((0 != strcmp(opt->pattern, "random"))
+            && (0 != strcmp(opt->pattern, "zero"))
+            && (0 != strcmp(opt->pattern, "text"))))
+    {
+        usage(argv[0]);
+        return false;
+    }
+
+    return true;
+}
+
+static bool isSelected(Options const* opt, char const* name)
+{
+    if (NULL == opt->workloads)
+    {
+        return true;
+    }
+
+    size_t const len = strlen(name);
+
+    for (char const* p = opt->workloads; NULL != p; p = strchr(p, ','))
+    {
+        p += (',' == *p) ? 1 : 0;
+        if ((0 == strncmp(p, name, len)) && ((',' == p[len]) || ('\0' == p[len])))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Fills the data to write. The text is a log with a JSON record per line,
+// which compresses like real logs and configurations.
+static void fillData(Options* opt, char* buf)
+{
+    if (0 == strcmp(opt->pattern, "zero"))
+    {
+        memset(buf, 0, opt->maxSize);
+        return;
+    }
+
+    if (0 == strcmp(opt->pattern, "text"))
+    {
+        char line[128];
+        size_t pos = 0;
+
+        for (size_t seq = 0; pos < opt->maxSize; seq++)
+        {
+            int const len = snprintf(line, sizeof(line),
+                                     "{\"seq\":%zu,\"level\":\"info\","
+                                     "\"sensor\":%u,\"value\":%u}\n", seq,
+                                     rand_r(&opt->seed) % 8,
+                                     rand_r(&opt->seed) % 1000);
+            size_t const n = ((size_t) len < opt->maxSize - pos)
+                             ? (size_t) len : (opt->maxSize - pos);
+
+            memcpy(&buf[pos], line, n);
+            pos += n;
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < opt->maxSize; i++)
+    {
+        buf[i] = (char) rand_r(&opt->seed);
+    }
+}
+
+// Runs opt->ops operations of reqSize bytes. Random workloads use addresses
+// aligned to the request size, sequential ones wrap around at the end of the
+// image. The frame count is taken from the server, so it includes the frames
+// a cache flush or read-ahead causes.
+static void runCase(Options const* opt, Nvm* nvm, Workload const* wl,
+                    size_t reqSize, char const* buf, char* readBuf)
+{
+    size_t const size = nvm->vtable->getSize(nvm);
+    size_t const slots = size / reqSize;
+    uint64_t* const lat = malloc(opt->ops * sizeof(*lat));
+    unsigned seed = opt->seed;
+    size_t failed = 0;
+    size_t bytes = 0;
+    size_t reads = 0;
+    size_t segCount = 1;
+
+    if (wl->op >= OP_READV)
+    {
+        segCount = opt->maxSize / reqSize;
+        segCount = (segCount < opt->segments) ? segCount : opt->segments;
+    }
+
+    // the first access of a workload shouldn't pay for what the previous one
+    // left behind
+    if (opt->cacheBlocks > 0)
+    {
+        CacheNVM_flush(&cache);
+        CacheNVM_invalidate(&cache);
+    }
+
+    size_t const frames0 = serverRequests();
+    size_t const wire0 = wireBytes();
+    uint64_t const t0 = now();
+
+    for (size_t i = 0; i < opt->ops; i++)
+    {
+        size_t const addr = wl->isRandom
+                            ? ((size_t) rand_r(&seed) % slots) * reqSize
+                            : (i % slots) * reqSize;
+        Op const op = !wl->isMixed
+                      ? wl->op
+                      : ((rand_r(&seed) % 100) < MIXED_READ_PERCENT)
+                      ? OP_READ : OP_WRITE;
+        // each segment has its own random address, the data is contiguous
+        for (size_t j = 0; (op >= OP_READV) && (j < segCount); j++)
+        {
+            segs[j].addr   = ((size_t) rand_r(&seed) % slots) * reqSize;
+            segs[j].buffer = (OP_READV == op)
+                             ? &readBuf[j * reqSize]
+                             : (char*) &buf[j * reqSize];
+            segs[j].length = reqSize;
+        }
+
+        uint64_t const start = now();
+        size_t done = 0;
+
+        switch (op)
+        {
+        case OP_READ:
+            done = nvm->vtable->read(nvm, addr, readBuf, reqSize);
+            reads++;
+            break;
+        case OP_WRITE:
+            done = nvm->vtable->write(nvm, addr, buf, reqSize);
+            break;
+        case OP_ERASE:
+            done = nvm->vtable->erase(nvm, addr, reqSize);
+            break;
+        case OP_DISCARD:
+            done = ChanMuxNvmDriver_discard(&driver, addr, reqSize);
+            break;
+        case OP_COPY:
+        {
+            // like the component's copy(), to another random slot
+            size_t const dst = ((size_t) rand_r(&seed) % slots) * reqSize;
+
+            if (ChanMuxNvmDriver_getFeatures(&driver) & ProxyNVM_FEATURE_COPY)
+            {
+                done = ChanMuxNvmDriver_copy(&driver, dst, addr, reqSize);
+            }
+            else if (nvm->vtable->read(nvm, addr, readBuf, reqSize) == reqSize)
+            {
+                done = nvm->vtable->write(nvm, dst, readBuf, reqSize);
+            }
+            break;
+        }
+        default:
+            if (OP_READV == op)
+            {
+                ChanMuxNvmDriver_readv(&driver, segs, segCount);
+                reads++;
+            }
+            else
+            {
+                ChanMuxNvmDriver_writev(&driver, segs, segCount);
+            }
+            for (size_t j = 0; j < segCount; j++)
+            {
+                done += segs[j].done;
+            }
+            break;
+        }
+
+        lat[i] = now() - start;
+        bytes += done;
+        failed += (done != reqSize * segCount) ? 1 : 0;
+    }
+
+    // data that is only in the cache is not written yet
+    if ((opt->cacheBlocks > 0) && (opt->writeBack > 0))
+    {
+        CacheNVM_flush(&cache);
+    }
+
+    uint64_t const elapsed = now() - t0;
+    size_t const frames = serverRequests() - frames0;
+    size_t const wire = wireBytes() - wire0;
+
+    qsort(lat, opt->ops, sizeof(*lat), compareU64);
+
+    printf("{\"workload\":\"%s\",\"size\":%zu,\"ops\":%zu,\"failed\":%zu,"
+           "\"reads\":%zu,\"bytes\":%zu,\"seconds\":%.6f,"
+           "\"ops_per_sec\":%.1f,\"bytes_per_sec\":%.1f,"
+           "\"lat_p50_us\":%.2f,\"lat_p99_us\":%.2f,\"lat_p999_us\":%.2f,"
+           "\"lat_max_us\":%.2f,\"frames\":%zu,\"frames_per_op\":%.3f,"
+           "\"features\":%" PRIu32 ",\"link_bps\":%" PRIu64 ","
+           "\"link_latency_us\":%" PRIu64 ",\"cache_blocks\":%zu,"
+           "\"write_back\":%zu,\"read_ahead\":%zu,\"segments\":%zu,"
+           "\"wire_bytes\":%zu,\"compression\":%s,\"pattern\":\"%s\","
+           "\"hash_blocks\":%zu,\"erased_blocks\":%zu,"
+           "\"max_outstanding\":%zu,\"channels\":%d}\n",
+           wl->name, reqSize, opt->ops, failed, reads, bytes,
+           (double) elapsed / NS_PER_SEC,
+           (double) opt->ops * NS_PER_SEC / elapsed,
+           (double) bytes * NS_PER_SEC / elapsed,
+           percentile(lat, opt->ops, 500) / 1000.0,
+           percentile(lat, opt->ops, 990) / 1000.0,
+           percentile(lat, opt->ops, 999) / 1000.0,
+           lat[opt->ops - 1] / 1000.0,
+           frames, (double) frames / opt->ops,
+           opt->server.features, opt->link.bandwidth, opt->link.latencyUs,
+           opt->cacheBlocks, opt->writeBack, opt->readAhead, segCount,
+           wire, opt->isCompressed ? "true" : "false", opt->pattern,
+           opt->hashBlocks, opt->erasedBlocks, opt->server.maxOutstanding,
+           ChanMuxNvmDriver_CHANNELS);
+    fflush(stdout);
+
+    free(lat);
+}
+
+static uint64_t now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec * NS_PER_SEC) + (uint64_t) ts.tv_nsec;
+}
+
+static size_t serverRequests(void)
+{
+    size_t requests = 0;
+
+    for (size_t i = 0; i < ChanMuxNvmDriver_CHANNELS; i++)
+    {
+        requests += harness[i].server.requests;
+    }
+    return requests;
+}
+
+static size_t wireBytes(void)
+{
+    size_t bytes = 0;
+
+    for (size_t i = 0; i < ChanMuxNvmDriver_CHANNELS; i++)
+    {
+        bytes += driver.chanMuxClient[i].bytesWritten
+                 + driver.chanMuxClient[i].bytesRead;
+    }
+    return bytes;
+}
+
+static void stopHarnesses(size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        LoopbackHarness_dtor(&harness[i]);
+    }
+}
+
+static int compareU64(void const* a, void const* b)
+{
+    uint64_t const x = *(uint64_t const*) a;
+    uint64_t const y = *(uint64_t const*) b;
+
+    return (x > y) - (x < y);
+}
+
+// nearest-rank percentile, perMille = 500 is the median
+static uint64_t percentile(uint64_t const* sorted, size_t count, unsigned perMille)
+{
+    size_t rank = (count * perMille + 999) / 1000;
+
+    return sorted[(rank > 0) ? (rank - 1) : 0];
+}
@@ -0,0 +1,956 @@
+/*
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+// Self-checking test of the storage path. It runs random reads, writes,
+// erases, copies, discards, vectored reads and writes and batches of
+// submissions through a ChanMuxNvmDriver, optionally with a CacheNVM on top,
+// against the reference proxy of the LoopbackHarness. Copies, discards,
+// vectored operations and submissions go through the Storage_ChanMux_Core of
+// the component, for two clients with different windows. A shadow of the
+// image predicts the result of every read, the first difference or failed
+// operation ends the run with EXIT_FAILURE, see README.md.
+
+/* Includes ------------------------------------------------------------------*/
+#include "LoopbackHarness.h"
+#include "ChanMuxNvmDriver.h"
+#include "CacheNVM.h"
+#include "Storage_ChanMux_Core.h"
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Defines -------------------------------------------------------------------*/
+#define CACHE_BLOCK_SIZE    512
+#define HASH_BLOCK_SIZE     512
+#define MAX_SEGMENTS        16
+#define MAX_SUBMISSIONS     24      // per client and batch
+
+// the segment list of a vectored operation is at the start of the dataport,
+// the data follows it
+#define LIST_SIZE           (MAX_SEGMENTS * sizeof(Storage_ChanMux_Segment))
+
+// client 0 sees the whole image, client 1 its second half but the last
+// GUARD_SIZE bytes
+#define GUARD_SIZE          4096
+#if Storage_ChanMux_CLIENTS != 2
+#   error "nvm_check needs Storage_ChanMux_CLIENTS=2"
+#endif
+#if !Storage_ChanMux_ASYNC
+#   error "nvm_check needs Storage_ChanMux_ASYNC=1"
+#endif
+
+/* Private types -------------------------------------------------------------*/
+
+typedef enum
+{
+    OP_READ,
+    OP_WRITE,
+    OP_REWRITE,     // writes what the image holds, for skipping by hashes
+    OP_ERASE,
+    OP_COPY,
+    OP_DISCARD,
+    OP_READV,
+    OP_WRITEV,
+    OP_SUBMIT,      // a batch of submissions of both clients
+    OP_COUNT
+} Op;
+
+typedef struct
+{
+    ProxyNvmServer_Config server;
+    size_t      ops;
+    size_t      maxLength;      // longest operation
+    size_t      cacheBlocks;    // 0 runs without CacheNVM
+    size_t      writeBack;      // dirty limit of the cache, 0 = write-through
+    size_t      readAhead;      // read-ahead buffer size, 0 = disabled
+    unsigned    seed;
+    bool        isCompressed;   // the driver compresses payloads
+    size_t      hashBlocks;     // blocks with known hashes, 0 = disabled
+    size_t      erasedBlocks;   // bits of the map of erased blocks, 0 = none
+} Options;
+
+// submission of a batch and the result expected for it
+typedef struct
+{
+    Storage_ChanMux_Submission sub;
+    size_t      client;
+    OS_Error_t  error;
+    bool        isCompleted;
+} Submitted;
+
+/* Private variables ---------------------------------------------------------*/
+
+static char const* const opNames[OP_COUNT] =
+{
+    "read", "write", "rewrite", "erase", "copy", "discard", "readv", "writev",
+    "submit"
+};
+
+// share of each operation in percent
+static unsigned const opWeights[OP_COUNT] =
+{
+    22, 18, 5, 10, 10, 6, 10, 10, 9
+};
+
+// one harness per channel, their servers share the image
+static LoopbackHarness  harness[ChanMuxNvmDriver_CHANNELS];
+static ChanMuxClientConfig_t chanMuxConfig[ChanMuxNvmDriver_CHANNELS];
+static ChanMuxNvmDriver driver;
+static CacheNVM         cache;
+static ProxyNVM_CodecWorkspace codecWorkspace[ChanMuxNvmDriver_CHANNELS];
+static Storage_ChanMux_Core core;
+static Storage_ChanMux_Rings rings[Storage_ChanMux_CLIENTS];
+static size_t           portSize;
+static uint8_t*         expected[Storage_ChanMux_CLIENTS];   // data of reads
+static uint8_t*         expectedKnown[Storage_ChanMux_CLIENTS];
+static Submitted        submitted[Storage_ChanMux_CLIENTS * MAX_SUBMISSIONS];
+
+static Options          opt;
+static Nvm*             nvm;
+static uint8_t*         shadow;     // expected content of the image
+static uint8_t*         known;      // 0 where the content is undefined
+static uint8_t*         buf;
+static size_t           counts[OP_COUNT];
+
+/* Private functions prototypes ----------------------------------------------*/
+static bool parseOptions(int argc, char* argv[]);
+static bool setUp(void);
+static void tearDown(void);
+static bool runOp(size_t n);
+static bool doRead(size_t addr, size_t length);
+static bool doWrite(size_t addr, size_t length, bool isRewrite);
+static bool doErase(size_t addr, size_t length);
+static bool doCopy(size_t dst, size_t src, size_t length);
+static bool doDiscard(size_t addr, size_t length);
+static bool doVectored(bool isWrite);
+static bool doSubmit(void);
+static size_t postSubmissions(size_t c, size_t first);
+static bool reapCompletions(size_t c, size_t first, size_t count);
+static bool checkImage(void);
+static bool compare(char const* what, size_t addr, uint8_t const* data,
+                    size_t length);
+static void fillData(uint8_t* data, size_t length);
+static size_t randomLength(void);
+static bool hasFeature(uint32_t feature);
+
+/* Public functions ----------------------------------------------------------*/
+
+int main(int argc, char* argv[])
+{
+    if (!parseOptions(argc, argv))
+    {
+        return EXIT_FAILURE;
+    }
+
+    unlink(opt.server.imagePath);
+
+    if (!setUp())
+    {
+        return EXIT_FAILURE;
+    }
+
+    bool isOk = true;
+
+    for (size_t n = 0; isOk && (n < opt.ops); n++)
+    {
+        isOk = runOp(n);
+    }
+
+    isOk = isOk && checkImage();
+
+    printf("%s: %zu operations, features 0x%x, cache %zu/%zu, read-ahead "
+           "%zu, compression %d, hashes %zu, erased map %zu, channels %d\n",
+           isOk ? "PASSED" : "FAILED", opt.ops, opt.server.features,
+           opt.cacheBlocks, opt.writeBack, opt.readAhead, opt.isCompressed,
+           opt.hashBlocks, opt.erasedBlocks, ChanMuxNvmDriver_CHANNELS);
+    for (size_t i = 0; i < OP_COUNT; i++)
+    {
+        printf("  %-8s %zu\n", opNames[i], counts[i]);
+    }
+
+    tearDown();
+    unlink(opt.server.imagePath);
+
+    return isOk ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+static void usage(char const* prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -i PATH   image file, deleted before and after (nvm_check.img)\n"
+            "  -S BYTES  image size (4194304)\n"
+            "  -f BITS   features the proxy reports (0x7ff)\n"
+            "  -F BYTES  largest frame the proxy accepts (65536)\n"
+            "  -q REQS   outstanding requests the proxy accepts, 0 = proxy\n"
+            "            without COMMAND_HELLO (8)\n"
+            "  -n OPS    operations (3000)\n"
+            "  -d BYTES  longest operation (65536)\n"
+            "  -c BLOCKS blocks of %d bytes in a CacheNVM on top, 0 = none (0)\n"
+            "  -W BYTES  dirty limit of the cache in write-back mode (0)\n"
+            "  -r BYTES  read-ahead buffer size (0)\n"
+            "  -s SEED   random seed (1)\n"
+            "  -z        compress payloads if the proxy supports it\n"
+            "  -H BLOCKS blocks of %d bytes with known hashes (0)\n"
+            "  -e BLOCKS blocks in the map of erased blocks (0)\n",
+            prog, CACHE_BLOCK_SIZE, HASH_BLOCK_SIZE);
+}
+
+static bool parseOptions(int argc, char* argv[])
+{
+    int c;
+
+    memset(&opt, 0, sizeof(opt));
+    opt.server.imagePath    = "nvm_check.img";
+    opt.server.imageSize    = 4 * 1024 * 1024;
+    opt.server.features     = ProxyNVM_FEATURE_ERASE
+                              | ProxyNVM_FEATURE_TAGGED
+                              | ProxyNVM_FEATURE_FRAME_SIZE
+                              | ProxyNVM_FEATURE_VECTORED
+                              | ProxyNVM_FEATURE_COMPRESSION
+                              | ProxyNVM_FEATURE_FILL
+                              | ProxyNVM_FEATURE_HASHES
+                              | ProxyNVM_FEATURE_WIDE
+                              | ProxyNVM_FEATURE_COPY
+                              | ProxyNVM_FEATURE_DISCARD
+                              | ProxyNVM_FEATURE_SYNC;
+    opt.server.maxFrameSize = 64 * 1024;
+    opt.server.maxOutstanding = 8;
+    opt.ops       = 3000;
+    opt.maxLength = 64 * 1024;
+    opt.seed      = 1;
+
+    while (-1 != (c = getopt(argc, argv, "i:S:f:F:q:n:d:c:W:r:s:zH:e:h")))
+    {
+        switch (c)
+        {
+        case 'i': opt.server.imagePath = optarg; break;
+        case 'S': opt.server.imageSize = strtoull(optarg, NULL, 0); break;
+        case 'f': opt.server.features = strtoul(optarg, NULL, 0); break;
+        case 'F': opt.server.maxFrameSize = strtoull(optarg, NULL, 0); break;
+        case 'q': opt.server.maxOutstanding = strtoull(optarg, NULL, 0); break;
+        case 'n': opt.ops = strtoull(optarg, NULL, 0); break;
+        case 'd': opt.maxLength = strtoull(optarg, NULL, 0); break;
+        case 'c': opt.cacheBlocks = strtoull(optarg, NULL, 0); break;
+        case 'W': opt.writeBack = strtoull(optarg, NULL, 0); break;
+        case 'r': opt.readAhead = strtoull(optarg, NULL, 0); break;
+        case 's': opt.seed = (unsigned) strtoul(optarg, NULL, 0); break;
+        case 'z': opt.isCompressed = true; break;
+        case 'H': opt.hashBlocks = strtoull(optarg, NULL, 0); break;
+        case 'e': opt.erasedBlocks = strtoull(optarg, NULL, 0); break;
+        default:
+            usage(argv[0]);
+            return false;
+        }
+    }
+
+    // the segments of a vectored operation are placed in the first half
+    if ((0 == opt.maxLength) || (opt.maxLength * 2 > opt.server.imageSize)
+        || ((opt.writeBack > 0) && (0 == opt.cacheBlocks)))
+    {
+        usage(argv[0]);
+        return false;
+    }
+
+    return true;
+}
+
+static bool setUp(void)
+{
+    size_t const size = opt.server.imageSize;
+
+    shadow = calloc(size, 1);
+    known  = malloc(size);
+    buf    = malloc(opt.maxLength);
+    if ((NULL == shadow) || (NULL == known) || (NULL == buf))
+    {
+        fprintf(stderr, "no memory for a shadow of %zu bytes\n", size);
+        return false;
+    }
+
+    // ftruncate() creates the image with zeros
+    memset(known, 1, size);
+
+    for (size_t i = 0; i < ChanMuxNvmDriver_CHANNELS; i++)
+    {
+        if (!LoopbackHarness_ctor(&harness[i], &opt.server, NULL))
+        {
+            return false;
+        }
+        chanMuxConfig[i] = harness[i].chanMuxConfig;
+    }
+
+    if (!ChanMuxNvmDriver_ctor(&driver, chanMuxConfig))
+    {
+        return false;
+    }
+
+    if ((opt.readAhead > 0)
+        && !ChanMuxNvmDriver_enableReadAhead(&driver, malloc(opt.readAhead),
+                                             opt.readAhead))
+    {
+        fprintf(stderr, "read-ahead setup failed\n");
+        return false;
+    }
+    if (opt.isCompressed)
+    {
+        ChanMuxNvmDriver_enableCompression(&driver, codecWorkspace);
+    }
+    if (opt.erasedBlocks > 0)
+    {
+        if (!ChanMuxNvmDriver_enableErasedMap(
+                &driver, calloc((opt.erasedBlocks + 31) / 32, sizeof(uint32_t)),
+                opt.erasedBlocks))
+        {
+            fprintf(stderr, "erased map setup failed\n");
+            return false;
+        }
+        // only possible if the proxy supports hashes
+        ChanMuxNvmDriver_scanErased(&driver);
+    }
+    if ((opt.hashBlocks > 0)
+        && !ChanMuxNvmDriver_enableHashes(&driver,
+                                          calloc(opt.hashBlocks,
+                                                 sizeof(uint64_t)),
+                                          opt.hashBlocks, HASH_BLOCK_SIZE))
+    {
+        fprintf(stderr, "hashes setup failed\n");
+        return false;
+    }
+
+    nvm = ChanMuxNvmDriver_get_nvm(&driver);
+
+    if (opt.cacheBlocks > 0)
+    {
+        size_t const flushBufSize = ChanMuxNvmDriver_FRAME_SIZE
+                                    * ProxyNVM_PIPELINE_WINDOW;
+
+        if (!CacheNVM_ctor(&cache, nvm,
+                           calloc(opt.cacheBlocks, sizeof(CacheNVM_Block)),
+                           malloc(opt.cacheBlocks * CACHE_BLOCK_SIZE),
+                           opt.cacheBlocks, CACHE_BLOCK_SIZE)
+            || ((opt.writeBack > 0)
+                && !CacheNVM_enableWriteBack(&cache, malloc(flushBufSize),
+                                             flushBufSize, opt.writeBack)))
+        {
+            fprintf(stderr, "cache setup failed\n");
+            return false;
+        }
+        nvm = CacheNVM_TO_NVM(&cache);
+    }
+
+    if (nvm->vtable->getSize(nvm) != size)
+    {
+        fprintf(stderr, "capacity %zu, expected %zu\n",
+                nvm->vtable->getSize(nvm), size);
+        return false;
+    }
+
+    if (!Storage_ChanMux_Core_ctor(&core, &driver,
+                                   (opt.cacheBlocks > 0) ? &cache : NULL))
+    {
+        return false;
+    }
+
+    portSize = LIST_SIZE + opt.maxLength;
+
+    for (size_t c = 0; c < Storage_ChanMux_CLIENTS; c++)
+    {
+        Storage_ChanMux_Core_Client* const client = &core.clients[c];
+
+        client->port     = malloc(portSize);
+        client->portSize = portSize;
+        client->rings    = &rings[c];
+        client->offset   = c * (size / 2);
+        client->size     = (c > 0) ? (size / 2 - GUARD_SIZE) : 0;
+        client->weight   = c + 1;
+        expected[c]      = malloc(portSize);
+        expectedKnown[c] = malloc(portSize);
+        if ((NULL == client->port) || (NULL == expected[c])
+            || (NULL == expectedKnown[c]))
+        {
+            fprintf(stderr, "no memory for the dataports\n");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// The memory of the run is left to the end of the process.
+static void tearDown(void)
+{
+    if (opt.cacheBlocks > 0)
+    {
+        CacheNVM_dtor(CacheNVM_TO_NVM(&cache));
+    }
+    ChanMuxNvmDriver_dtor(&driver);
+
+    for (size_t i = 0; i < ChanMuxNvmDriver_CHANNELS; i++)
+    {
+        LoopbackHarness_dtor(&harness[i]);
+    }
+}
+
+static bool runOp(size_t n)
+{
+    size_t const size = opt.server.imageSize;
+    unsigned pick = (unsigned) rand_r(&opt.seed) % 100;
+    Op op = OP_READ;
+
+    while (pick >= opWeights[op])
+    {
+        pick -= opWeights[op];
+        op++;
+    }
+
+    size_t const length = randomLength();
+    size_t const addr = (size_t) rand_r(&opt.seed) % (size - length + 1);
+    bool isOk = false;
+
+    counts[op]++;
+
+    switch (op)
+    {
+    case OP_READ:
+        isOk = doRead(addr, length);
+        break;
+    case OP_WRITE:
+    case OP_REWRITE:
+        isOk = doWrite(addr, length, (OP_REWRITE == op));
+        break;
+    case OP_ERASE:
+        isOk = doErase(addr, length);
+        break;
+    case OP_COPY:
+    {
+        // every second copy overlaps its source
+        size_t src = (size_t) rand_r(&opt.seed) % (size - length + 1);
+
+        if (n % 2)
+        {
+            size_t const shift = (size_t) rand_r(&opt.seed) % length;
+
+            src = ((rand_r(&opt.seed) % 2) && (addr >= shift))
+                  ? (addr - shift)
+                  : ((addr + shift <= size - length) ? (addr + shift) : addr);
+        }
+        isOk = doCopy(addr, src, length);
+        break;
+    }
+    case OP_DISCARD:
+        isOk = doDiscard(addr, length);
+        break;
+    case OP_READV:
+    case OP_WRITEV:
+        isOk = doVectored(OP_WRITEV == op);
+        break;
+    default:
+        isOk = doSubmit();
+        break;
+    }
+
+    if (!isOk)
+    {
+        fprintf(stderr, "operation %zu (%s) failed\n", n, opNames[op]);
+    }
+
+    return isOk;
+}
+
+static bool doRead(size_t addr, size_t length)
+{
+    memset(buf, 0xA5, length);
+
+    if (nvm->vtable->read(nvm, addr, buf, length) != length)
+    {
+        return false;
+    }
+
+    return compare("read", addr, buf, length);
+}
+
+static bool doWrite(size_t addr, size_t length, bool isRewrite)
+{
+    if (isRewrite)
+    {
+        memcpy(buf, &shadow[addr], length);
+    }
+    else
+    {
+        fillData(buf, length);
+    }
+
+    if (nvm->vtable->write(nvm, addr, buf, length) != length)
+    {
+        return false;
+    }
+
+    memcpy(&shadow[addr], buf, length);
+    memset(&known[addr], 1, length);
+
+    return true;
+}
+
+static bool doErase(size_t addr, size_t length)
+{
+    if (nvm->vtable->erase(nvm, addr, length) != length)
+    {
+        return false;
+    }
+
+    memset(&shadow[addr], 0xFF, length);
+    memset(&known[addr], 1, length);
+
+    return true;
+}
+
+// Like storage_ext_rpc_copy() of the component
+static bool doCopy(size_t dst, size_t src, size_t length)
+{
+    size_t const copied = Storage_ChanMux_Core_copy(&core, dst, src, length);
+
+    memmove(&shadow[dst], &shadow[src], length);
+    memmove(&known[dst], &known[src], length);
+
+    return (copied == length);
+}
+
+// Like storage_ext_rpc_discard() of the component. A proxy that supports
+// discards reads the range as 0x00, otherwise the content is undefined, as the
+// cache drops dirty data of it.
+static bool doDiscard(size_t addr, size_t length)
+{
+    if (Storage_ChanMux_Core_discard(&core, addr, length) != length)
+    {
+        return false;
+    }
+
+    bool const isZeroed = hasFeature(ProxyNVM_FEATURE_DISCARD);
+
+    memset(&shadow[addr], 0, length);
+    memset(&known[addr], isZeroed ? 1 : 0, length);
+
+    return true;
+}
+
+// A readv() or writev() of a random client. The segments don't overlap each
+// other on the image, their data is contiguous in the dataport. Sometimes a
+// segment reaching out of the client's window is added, it must be rejected
+// without affecting the others.
+static bool doVectored(bool isWrite)
+{
+    size_t const c = (size_t) rand_r(&opt.seed) % Storage_ChanMux_CLIENTS;
+    Storage_ChanMux_Core_Client* const client = &core.clients[c];
+    Storage_ChanMux_Segment* const list = (void*) client->port;
+    size_t const window = Storage_ChanMux_Core_windowSize(&core, client);
+    size_t const want = 1 + ((size_t) rand_r(&opt.seed) % MAX_SEGMENTS);
+    size_t count = 0;
+    size_t used = 0;
+
+    // segments go into distinct slots of the part both windows have
+    size_t const slot = Storage_ChanMux_Core_windowSize(&core, &core.clients[1])
+                        / MAX_SEGMENTS;
+    size_t const first = (size_t) rand_r(&opt.seed) % MAX_SEGMENTS;
+    size_t const invalid = ((rand_r(&opt.seed) % 8) == 0)
+                           ? ((size_t) rand_r(&opt.seed) % want) : MAX_SEGMENTS;
+
+    for (size_t i = 0; i < want; i++)
+    {
+        size_t length = (i == invalid)
+                        ? 2 : (1 + ((size_t) rand_r(&opt.seed) % (slot / 2)));
+
+        if (length > opt.maxLength - used)
+        {
+            // the segment out of the window needs its 2 bytes
+            length = (i == invalid) ? 0 : (opt.maxLength - used);
+        }
+        if (0 == length)
+        {
+            break;
+        }
+
+        list[count].offset     = (i == invalid)
+                                 ? (window - 1)
+                                 : ((((first + i) % MAX_SEGMENTS) * slot)
+                                    + ((size_t) rand_r(&opt.seed)
+                                       % (slot - length)));
+        list[count].portOffset = (uint32_t) (LIST_SIZE + used);
+        list[count].length     = (uint32_t) length;
+        used += length;
+        count++;
+    }
+
+    uint8_t* const data = (uint8_t*) &client->port[LIST_SIZE];
+    bool const isInvalid = (invalid < count);
+
+    if (isWrite)
+    {
+        fillData(data, used);
+    }
+    else
+    {
+        memset(data, 0xA5, used);
+    }
+
+    OS_Error_t const err = Storage_ChanMux_Core_transferVectored(
+                               &core, client, isWrite, 0, count, __func__);
+
+    if (err != (isInvalid ? OS_ERROR_GENERIC : OS_SUCCESS))
+    {
+        fprintf(stderr, "client %zu: %zu segments, error %d\n", c, count, err);
+        return false;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        Storage_ChanMux_Segment const* const seg = &list[i];
+        size_t const addr = client->offset + seg->offset;
+        uint8_t const* const segData = (uint8_t*) &client->port[seg->portOffset];
+
+        if (i == invalid)
+        {
+            if ((OS_ERROR_INVALID_PARAMETER != seg->error) || (0 != seg->done))
+            {
+                fprintf(stderr, "segment %zu out of the window: error %d, "
+                        "%" PRIu32 " bytes done\n", i, seg->error, seg->done);
+                return false;
+            }
+            continue;
+        }
+
+        if ((OS_SUCCESS != seg->error) || (seg->done != seg->length))
+        {
+            fprintf(stderr, "segment %zu of %zu: %" PRIu32 " of %" PRIu32
+                    " bytes done\n", i, count, seg->done, seg->length);
+            return false;
+        }
+
+        if (isWrite)
+        {
+            memcpy(&shadow[addr], segData, seg->length);
+            memset(&known[addr], 1, seg->length);
+        }
+        else if (!compare("readv", addr, segData, seg->length))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Both clients post a batch of submissions, which are handled like run() of
+// the component does it. The submissions of a client overlap each other, but
+// not those of the other client, so applying them to the shadow in the order
+// they were posted predicts the result of each.
+static bool doSubmit(void)
+{
+    size_t posted[Storage_ChanMux_CLIENTS];
+    size_t total = 0;
+
+    for (size_t c = 0; c < Storage_ChanMux_CLIENTS; c++)
+    {
+        posted[c] = postSubmissions(c, total);
+        total += posted[c];
+    }
+
+    size_t units = 0;
+
+    while (Storage_ChanMux_Core_fetchSubmissions(&core) > 0)
+    {
+        size_t prio;
+        Storage_ChanMux_Core_Client* const client =
+            Storage_ChanMux_Core_pickClient(&core, &prio);
+        size_t const cost = Storage_ChanMux_Core_runUnit(&core, client, prio);
+
+        Storage_ChanMux_Core_retireUnit(&core, client, cost);
+
+        // every unit completes a submission or a piece of one of a few units
+        if (++units > 64 * total)
+        {
+            fprintf(stderr, "submissions are not completed\n");
+            return false;
+        }
+    }
+
+    size_t first = 0;
+
+    for (size_t c = 0; c < Storage_ChanMux_CLIENTS; c++)
+    {
+        if (!reapCompletions(c, first, posted[c]))
+        {
+            return false;
+        }
+        first += posted[c];
+    }
+
+    return true;
+}
+
+// Puts random submissions of client c into its ring, their records start at
+// submitted[first]. Reads, writes, erases and discards with all priorities
+// fall into a range of a few units, some submissions are invalid. Returns the
+// number of submissions.
+static size_t postSubmissions(size_t c, size_t first)
+{
+    Storage_ChanMux_Core_Client* const client = &core.clients[c];
+    Storage_ChanMux_Rings* const ring = &rings[c];
+    size_t const window = Storage_ChanMux_Core_windowSize(&core, client);
+    size_t const area = Storage_ChanMux_Core_windowSize(&core, &core.clients[1]);
+    size_t const region = 4 * Storage_ChanMux_UNIT;
+    size_t const base = (size_t) rand_r(&opt.seed) % (area - region + 1);
+    size_t const want = 1 + ((size_t) rand_r(&opt.seed) % MAX_SUBMISSIONS);
+    uint32_t const head = ring->subHead;
+    size_t used = 0;
+    size_t n = 0;
+
+    for (; n < want; n++)
+    {
+        Submitted* const s = &submitted[first + n];
+        Storage_ChanMux_Submission* const sub = &s->sub;
+        unsigned const kind = (unsigned) rand_r(&opt.seed) % 20;
+        size_t const length = ((rand_r(&opt.seed) % 6) == 0)
+                              ? (1 + ((size_t) rand_r(&opt.seed) % region))
+                              : (1 + ((size_t) rand_r(&opt.seed) % 4096));
+
+        if (length > portSize - used)
+        {
+            break;
+        }
+
+        sub->userData   = first + n;
+        sub->offset     = base + ((size_t) rand_r(&opt.seed)
+                                  % (region - length + 1));
+        sub->portOffset = (uint32_t) used;
+        sub->length     = (uint32_t) length;
+        sub->priority   = (uint32_t) rand_r(&opt.seed)
+                          % Storage_ChanMux_PRIO_COUNT;
+        s->client       = c;
+        s->error        = OS_SUCCESS;
+        s->isCompleted  = false;
+
+        size_t const addr = client->offset + sub->offset;
+        uint8_t* const data = (uint8_t*) &client->port[used];
+
+        if (kind < 7)
+        {
+            sub->op = Storage_ChanMux_OP_READ;
+            memcpy(&expected[c][used], &shadow[addr], length);
+            memcpy(&expectedKnown[c][used], &known[addr], length);
+            memset(data, 0xA5, length);
+            used += length;
+        }
+        else if (kind < 14)
+        {
+            sub->op = Storage_ChanMux_OP_WRITE;
+            fillData(data, length);
+            memcpy(&shadow[addr], data, length);
+            memset(&known[addr], 1, length);
+            used += length;
+        }
+        else if (kind < 16)
+        {
+            sub->op = Storage_ChanMux_OP_ERASE;
+            memset(&shadow[addr], 0xFF, length);
+            memset(&known[addr], 1, length);
+        }
+        else if (kind < 18)
+        {
+            sub->op = Storage_ChanMux_OP_DISCARD;
+            memset(&shadow[addr], 0, length);
+            memset(&known[addr], hasFeature(ProxyNVM_FEATURE_DISCARD) ? 1 : 0,
+                   length);
+        }
+        else
+        {
+            // a write reaching out of the window, or one whose length would
+            // overflow the window and port checks, or an unknown priority
+            unsigned const flaw = (unsigned) rand_r(&opt.seed) % 3;
+
+            sub->op = Storage_ChanMux_OP_WRITE;
+            s->error = OS_ERROR_INVALID_PARAMETER;
+
+            if (0 == flaw)
+            {
+                sub->offset = window - 1;
+                sub->length = 2;
+            }
+            else if (1 == flaw)
+            {
+                sub->length = UINT32_MAX;
+            }
+            else
+            {
+                sub->priority = Storage_ChanMux_PRIO_COUNT;
+            }
+        }
+
+        ring->sub[(head + n) % Storage_ChanMux_RING_SIZE] = *sub;
+    }
+
+    __atomic_store_n(&ring->subHead, head + (uint32_t) n, __ATOMIC_RELEASE);
+
+    return n;
+}
+
+// Every submission of client c must be completed once, with the expected
+// result and for a read with the data the shadow predicted.
+static bool reapCompletions(size_t c, size_t first, size_t count)
+{
+    Storage_ChanMux_Rings* const ring = &rings[c];
+    uint32_t const head = __atomic_load_n(&ring->compHead, __ATOMIC_ACQUIRE);
+    char const* const port = core.clients[c].port;
+
+    if ((head - ring->compTail) != count)
+    {
+        fprintf(stderr, "client %zu: %" PRIu32 " completions for %zu "
+                "submissions\n", c, head - ring->compTail, count);
+        return false;
+    }
+
+    for (uint32_t i = ring->compTail; i != head; i++)
+    {
+        Storage_ChanMux_Completion const* const comp =
+            &ring->comp[i % Storage_ChanMux_RING_SIZE];
+
+        if ((comp->userData < first) || (comp->userData >= first + count)
+            || submitted[comp->userData].isCompleted)
+        {
+            fprintf(stderr, "client %zu: unexpected completion %" PRIu64 "\n",
+                    c, comp->userData);
+            return false;
+        }
+
+        Submitted* const s = &submitted[comp->userData];
+        Storage_ChanMux_Submission const* const sub = &s->sub;
+        size_t const done = (OS_SUCCESS == s->error) ? sub->length : 0;
+
+        s->isCompleted = true;
+
+        if ((comp->error != s->error) || (comp->done != done))
+        {
+            fprintf(stderr, "client %zu: submission %" PRIu64 " (op %" PRIu32
+                    ", priority %" PRIu32 "): error %d, %" PRIu32 " of %zu "
+                    "bytes done\n", c, comp->userData, sub->op, sub->priority,
+                    comp->error, comp->done, done);
+            return false;
+        }
+
+        if ((Storage_ChanMux_OP_READ != sub->op) || (OS_SUCCESS != s->error))
+        {
+            continue;
+        }
+
+        for (size_t j = sub->portOffset; j < sub->portOffset + sub->length; j++)
+        {
+            if (expectedKnown[c][j] && ((uint8_t) port[j] != expected[c][j]))
+            {
+                fprintf(stderr, "client %zu: submission %" PRIu64 " (priority "
+                        "%" PRIu32 "): mismatch at 0x%zx: 0x%02x, expected "
+                        "0x%02x\n", c, comp->userData, sub->priority,
+                        core.clients[c].offset + sub->offset
+                        + (j - sub->portOffset),
+                        (uint8_t) port[j], expected[c][j]);
+                return false;
+            }
+        }
+    }
+
+    __atomic_store_n(&ring->compTail, head, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+// After flushing the cache, the image of the server must hold the data
+// everywhere it is defined, and so must a read through the storage path.
+static bool checkImage(void)
+{
+    size_t const size = opt.server.imageSize;
+
+    if ((opt.cacheBlocks > 0) && !CacheNVM_flush(&cache))
+    {
+        fprintf(stderr, "flushing the cache failed\n");
+        return false;
+    }
+
+    if (!compare("image", 0, harness[0].server.image, size))
+    {
+        return false;
+    }
+
+    for (size_t addr = 0; addr < size; addr += opt.maxLength)
+    {
+        size_t const len = ((size - addr) < opt.maxLength)
+                           ? (size - addr) : opt.maxLength;
+
+        if (!doRead(addr, len))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool compare(char const* what, size_t addr, uint8_t const* data,
+                    size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        if (known[addr + i] && (data[i] != shadow[addr + i]))
+        {
+            fprintf(stderr, "%s: mismatch at 0x%zx: 0x%02x, expected 0x%02x\n",
+                    what, addr + i, data[i], shadow[addr + i]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Random, zero, erased, repeated and text-like data, so that compression,
+// fill responses and the erased map all get their cases.
+static void fillData(uint8_t* data, size_t length)
+{
+    unsigned const kind = (unsigned) rand_r(&opt.seed) % 5;
+    uint8_t const byte = (uint8_t) rand_r(&opt.seed);
+
+    for (size_t i = 0; i < length; i++)
+    {
+        switch (kind)
+        {
+        case 0:  data[i] = (uint8_t) rand_r(&opt.seed); break;
+        case 1:  data[i] = 0x00; break;
+        case 2:  data[i] = 0xFF; break;
+        case 3:  data[i] = byte; break;
+        default: data[i] = (uint8_t) "sensor=42 value=17\n"[(i + byte) % 19];
+                 break;
+        }
+    }
+}
+
+// Mostly short operations, some up to the maximum
+static size_t randomLength(void)
+{
+    size_t const max = ((rand_r(&opt.seed) % 4) == 0) ? opt.maxLength : 600;
+    size_t const limit = (max < opt.maxLength) ? max : opt.maxLength;
+
+    return 1 + ((size_t) rand_r(&opt.seed) % limit);
+}
+
+static bool hasFeature(uint32_t feature)
+{
+    return (0 != (ChanMuxNvmDriver_getFeatures(&driver) & feature));
+}